@@ -0,0 +1,145 @@
+#include "cfileoperations.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <limits>
+
+// Copies a generated tree of small files three ways and prints the best time
+// of each: a plain serial QDir/QFile::copy recursion, as pasting worked before
+// the worker pool, then copyRecursively with CEXPLORER_COPY_THREADS=1 (the
+// parallel listing feeding one copy thread) and with the default count.
+//
+//   copy-benchmark [files] [bytes per file] [runs] [work folder]
+
+namespace {
+constexpr int kFilesPerFolder = 500;
+
+bool generateTree(const QString &root, int files, int bytes) {
+    QByteArray data(bytes, '\0');
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = char('a' + i % 26);
+
+    for (int i = 0; i < files; ++i) {
+        const QString folder = QString("%1/%2").arg(root).arg(i / kFilesPerFolder);
+        if (i % kFilesPerFolder == 0 && !QDir().mkpath(folder)) return false;
+
+        QFile file(QString("%1/file%2.dat").arg(folder).arg(i));
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) return false;
+    }
+    return true;
+}
+
+// Lists and copies one entry at a time on the calling thread.
+bool copySerially(const QString &source, const QString &destination, QStringList *errors) {
+    if (!QDir().mkdir(destination)) {
+        errors->append("Failed to create folder:\n" + destination);
+        return false;
+    }
+
+    const QFileInfoList entries = QDir(source).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
+    for (const QFileInfo &info : entries) {
+        const QString target = destination + '/' + info.fileName();
+        if (info.isDir() && !info.isSymLink()) {
+            if (!copySerially(info.filePath(), target, errors)) return false;
+        } else if (!QFile::copy(info.filePath(), target)) {
+            errors->append("Failed to copy:\n" + info.filePath());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Threads is 0 for the serial recursion, or the CEXPLORER_COPY_THREADS value
+// for copyRecursively, where -1 leaves it unset.
+qint64 timeCopy(const QString &source, const QString &destination, int threads, QStringList *errors) {
+    if (threads > 0)
+        qputenv("CEXPLORER_COPY_THREADS", QByteArray::number(threads));
+    else
+        qunsetenv("CEXPLORER_COPY_THREADS");
+
+    CFileOperations::removeRecursively(destination);
+
+    QElapsedTimer timer;
+    timer.start();
+    const bool copied = threads == 0
+        ? copySerially(source, destination, errors)
+        : CFileOperations::copyRecursively(source, destination, CFileOperations::CopyOptions(), errors);
+    const qint64 elapsed = timer.elapsed();
+    return copied ? elapsed : -1;
+}
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    QTextStream out(stdout);
+
+    const int files = args.size() > 1 ? args.at(1).toInt() : 20000;
+    const int bytes = args.size() > 2 ? args.at(2).toInt() : 4096;
+    const int runs = args.size() > 3 ? std::max(1, args.at(3).toInt()) : 3;
+
+    QTemporaryDir work((args.size() > 4 ? args.at(4) : QDir::tempPath()) + "/copy-benchmark-XXXXXX");
+    if (files <= 0 || bytes < 0 || !work.isValid()) {
+        out << "usage: copy-benchmark [files] [bytes per file] [runs] [work folder]\n";
+        return 2;
+    }
+
+    const QString source = work.path() + "/source";
+    const QString destination = work.path() + "/destination";
+    out << "Generating " << files << " files of " << bytes << " bytes in " << work.path() << "\n";
+    out.flush();
+    if (!generateTree(source, files, bytes)) {
+        out << "Could not generate the source tree\n";
+        return 1;
+    }
+
+    qunsetenv("CEXPLORER_COPY_THREADS");
+    const int defaultThreads = CFileOperations::defaultCopyConcurrency();
+
+    const struct {
+        QString label;
+        int threads;
+    } modes[] = {
+        {"serial QFile::copy", 0},
+        {"walker + 1 copy thread", 1},
+        {QString("walker + %1 copy threads").arg(defaultThreads), -1},
+    };
+    const int modeCount = int(sizeof(modes) / sizeof(modes[0]));
+
+    // Runs alternate between the modes so that they see a similarly warm
+    // page cache.
+    QVector<qint64> best(modeCount, std::numeric_limits<qint64>::max());
+    for (int run = 0; run < runs; ++run) {
+        out << "run " << run + 1 << ":";
+        for (int mode = 0; mode < modeCount; ++mode) {
+            QStringList errors;
+            const qint64 elapsed = timeCopy(source, destination, modes[mode].threads, &errors);
+            if (elapsed < 0) {
+                out << "\n" << modes[mode].label << " failed:\n" << errors.join('\n') << "\n";
+                return 1;
+            }
+            best[mode] = std::min(best[mode], elapsed);
+            out << (mode ? ", " : " ") << modes[mode].label << " " << elapsed << " ms";
+        }
+        out << "\n";
+        out.flush();
+    }
+
+    out << "best:\n";
+    for (int mode = 0; mode < modeCount; ++mode) {
+        out << "  " << modes[mode].label << ": " << best[mode] << " ms";
+        if (mode > 0 && best[mode] > 0)
+            out << " (" << QString::number(double(best[0]) / double(best[mode]), 'f', 2) << "x the serial copy)";
+        out << "\n";
+    }
+    return 0;
+}
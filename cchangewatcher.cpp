@@ -0,0 +1,573 @@
+#include "cchangewatcher.h"
+#include "cdirwalker.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QMutexLocker>
+#include <QSocketNotifier>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Events are delivered once a folder has been quiet this long...
+constexpr int kSettleMs = 150;
+// ...but never later than this after the first one.
+constexpr int kMaxLatencyMs = 1000;
+// Past this many names a folder is simply listed again.
+constexpr int kMaxNamesPerDirectory = 10000;
+
+#ifdef Q_OS_LINUX
+constexpr uint32_t kInotifyMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB
+                                  | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+// Buffers of fanotify events resolved per trip to the worker thread.
+constexpr int kMaxFanotifyReads = 64;
+
+bool fileSystemId(const QString &path, quint64 &id) {
+    struct statfs sfs;
+    if (::statfs(QFile::encodeName(path).constData(), &sfs) != 0) return false;
+    static_assert(sizeof(sfs.f_fsid) == sizeof(id), "unexpected fsid size");
+    std::memcpy(&id, &sfs.f_fsid, sizeof(id));
+    return true;
+}
+
+bool isUnder(const QString &path, const QString &rootPath) {
+    if (path == rootPath) return true;
+    if (rootPath.endsWith('/')) return path.startsWith(rootPath);
+    return path.startsWith(rootPath) && path.size() > rootPath.size() && path.at(rootPath.size()) == '/';
+}
+#endif
+
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+struct FanotifyEvent {
+    enum Kind {
+        Added,
+        Removed,
+        Modified
+    };
+
+    Kind kind;
+    QString dirPath;
+    QString name;
+};
+
+// Reads what is queued on `fd` and turns the folder handles into paths, which
+// costs a lookup in the kernel per event.
+QVector<FanotifyEvent> readFanotifyEvents(int fd, const QHash<quint64, int> &mountFds, bool &overflow) {
+    QVector<FanotifyEvent> events;
+    alignas(struct fanotify_event_metadata) char buffer[64 * 1024];
+    for (int reads = 0; reads < kMaxFanotifyReads; ++reads) {
+        ssize_t length = ::read(fd, buffer, sizeof(buffer));
+        if (length <= 0) break;
+
+        auto *event = reinterpret_cast<struct fanotify_event_metadata *>(buffer);
+        for (; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+            if (event->vers != FANOTIFY_METADATA_VERSION) return events;
+            if (event->fd >= 0) ::close(event->fd);
+
+            if (event->mask & FAN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+
+            const auto *info = reinterpret_cast<const struct fanotify_event_info_fid *>(event + 1);
+            if (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) continue;
+
+            quint64 id;
+            static_assert(sizeof(info->fsid) == sizeof(id), "unexpected fsid size");
+            std::memcpy(&id, &info->fsid, sizeof(id));
+            const int mountFd = mountFds.value(id, -1);
+            if (mountFd < 0) continue;
+
+            auto *handle = reinterpret_cast<struct file_handle *>(const_cast<unsigned char *>(info->handle));
+            const char *name = reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes);
+            if (std::strcmp(name, ".") == 0) continue;
+
+            // The folder is reported as a file handle; its path comes from /proc.
+            const int dirFd = ::open_by_handle_at(mountFd, handle, O_PATH | O_CLOEXEC);
+            if (dirFd < 0) continue;
+            char target[4096];
+            const QByteArray link = "/proc/self/fd/" + QByteArray::number(dirFd);
+            const ssize_t targetLength = ::readlink(link.constData(), target, sizeof(target));
+            ::close(dirFd);
+            if (targetLength <= 0 || targetLength == ssize_t(sizeof(target))) continue;
+
+            FanotifyEvent resolved;
+            if (event->mask & (FAN_CREATE | FAN_MOVED_TO))
+                resolved.kind = FanotifyEvent::Added;
+            else if (event->mask & (FAN_DELETE | FAN_MOVED_FROM))
+                resolved.kind = FanotifyEvent::Removed;
+            else
+                resolved.kind = FanotifyEvent::Modified;
+            resolved.dirPath = QFile::decodeName(QByteArray(target, int(targetLength)));
+            resolved.name = QFile::decodeName(name);
+            events.append(resolved);
+        }
+    }
+    return events;
+}
+#endif
+}
+
+CChangeWatcher::CChangeWatcher(QObject *parent)
+    : QObject(parent) {
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(kSettleMs);
+    connect(flushTimer, &QTimer::timeout, this, &CChangeWatcher::flush);
+    treePool.setMaxThreadCount(1);
+    fanotifyPool.setMaxThreadCount(1);
+
+#ifdef Q_OS_LINUX
+    inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0) {
+        inotifyNotifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read, this);
+        connect(inotifyNotifier, &QSocketNotifier::activated, this, &CChangeWatcher::readInotify);
+        return;
+    }
+#endif
+
+    fallbackWatcher = new QFileSystemWatcher(this);
+    connect(fallbackWatcher, &QFileSystemWatcher::directoryChanged, this, &CChangeWatcher::overflowed);
+}
+
+CChangeWatcher::~CChangeWatcher() {
+    {
+        QMutexLocker locker(&walkerMutex);
+        for (CDirWalker *walker : std::as_const(activeWalkers))
+            walker->cancel();
+    }
+    treePool.clear();
+    treePool.waitForDone();
+    fanotifyPool.waitForDone();
+
+#ifdef Q_OS_LINUX
+    if (inotifyFd >= 0) ::close(inotifyFd);
+    if (fanotifyFd >= 0) ::close(fanotifyFd);
+    for (int fd : std::as_const(mountFds))
+        ::close(fd);
+#endif
+}
+
+void CChangeWatcher::watch(const QString &path) {
+    const QString dirPath = QDir::cleanPath(path);
+    if (watchCounts[dirPath]++ > 0) return;
+
+    if (fallbackWatcher) {
+        fallbackWatcher->addPath(dirPath);
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    quint64 id;
+    if (!mountFds.isEmpty() && fileSystemId(dirPath, id) && mountFds.contains(id)) return;
+    // Already watched as part of a tree.
+    if (descriptorsByPath.contains(dirPath)) return;
+
+    // When the watch limit is reached the folder goes unwatched, as it would
+    // with QFileSystemWatcher.
+    const int wd = ::inotify_add_watch(inotifyFd, QFile::encodeName(dirPath).constData(), kInotifyMask);
+    if (wd < 0) return;
+    pathsByDescriptor.insert(wd, dirPath);
+    descriptorsByPath.insert(dirPath, wd);
+#endif
+}
+
+void CChangeWatcher::unwatch(const QString &path) {
+    const QString dirPath = QDir::cleanPath(path);
+    auto it = watchCounts.find(dirPath);
+    if (it == watchCounts.end()) return;
+    if (--it.value() > 0) return;
+    watchCounts.erase(it);
+
+    if (fallbackWatcher) {
+        fallbackWatcher->removePath(dirPath);
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    if (!treeRootFor(dirPath).isEmpty()) return;
+    auto wd = descriptorsByPath.find(dirPath);
+    if (wd == descriptorsByPath.end()) return;
+    pathsByDescriptor.remove(wd.value());
+    ::inotify_rm_watch(inotifyFd, wd.value());
+    descriptorsByPath.erase(wd);
+#endif
+}
+
+bool CChangeWatcher::watchMount(const QString &path) {
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    quint64 id;
+    if (!fileSystemId(path, id)) return false;
+    if (mountFds.contains(id)) return true;
+
+    if (fanotifyFd < 0) {
+        fanotifyFd = ::fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+                                     O_RDONLY | O_CLOEXEC);
+        if (fanotifyFd < 0) {
+            qWarning("fanotify unavailable (%s); watching folders with inotify instead", std::strerror(errno));
+            return false;
+        }
+
+        fanotifyNotifier = new QSocketNotifier(fanotifyFd, QSocketNotifier::Read, this);
+        connect(fanotifyNotifier, &QSocketNotifier::activated, this, &CChangeWatcher::readFanotify);
+    }
+
+    const QByteArray encodedPath = QFile::encodeName(path);
+    const uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB
+                          | FAN_ONDIR;
+    if (::fanotify_mark(fanotifyFd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, encodedPath.constData())
+        != 0) {
+        qWarning("fanotify unavailable for %s (%s); watching folders with inotify instead",
+                 encodedPath.constData(), std::strerror(errno));
+        return false;
+    }
+
+    const int mountFd = ::open(encodedPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (mountFd < 0) {
+        ::fanotify_mark(fanotifyFd, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, encodedPath.constData());
+        return false;
+    }
+    mountFds.insert(id, mountFd);
+
+    // Folders on this file system no longer need their own inotify watches.
+    for (auto it = descriptorsByPath.begin(); it != descriptorsByPath.end();) {
+        quint64 dirId;
+        if (fileSystemId(it.key(), dirId) && dirId == id) {
+            ::inotify_rm_watch(inotifyFd, it.value());
+            pathsByDescriptor.remove(it.value());
+            it = descriptorsByPath.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = treeRoots.begin(); it != treeRoots.end(); ++it) {
+        quint64 rootId;
+        if (fileSystemId(it.key(), rootId) && rootId == id)
+            it.value() = true;
+    }
+    return true;
+#else
+    Q_UNUSED(path);
+    return false;
+#endif
+}
+
+void CChangeWatcher::watchTree(const QString &rootPath) {
+    const QString clean = QDir::cleanPath(rootPath);
+    if (treeRoots.contains(clean)) return;
+
+#ifdef Q_OS_LINUX
+    if (!fallbackWatcher) {
+        quint64 id;
+        const bool mounted = !mountFds.isEmpty() && fileSystemId(clean, id) && mountFds.contains(id);
+        treeRoots.insert(clean, mounted);
+        if (!mounted) {
+            watchSubtree(clean, clean, true);
+            return;
+        }
+    }
+#endif
+
+    const bool complete = treeRoots.contains(clean);
+    QMetaObject::invokeMethod(this, [this, clean, complete] {
+        emit treeWatched(clean, complete);
+    }, Qt::QueuedConnection);
+}
+
+void CChangeWatcher::watchSubtree(const QString &rootPath, const QString &dirPath, bool initial) {
+#ifdef Q_OS_LINUX
+    const int fd = inotifyFd;
+    treePool.start([this, fd, rootPath, dirPath, initial] {
+        CDirWalker walker;
+        {
+            QMutexLocker locker(&walkerMutex);
+            activeWalkers.append(&walker);
+        }
+
+        QMutex mutex;
+        Watches watches;
+        std::atomic<bool> exhausted{false};
+        auto add = [&](const QByteArray &path) {
+            const int wd = ::inotify_add_watch(fd, path.constData(), kInotifyMask);
+            if (wd >= 0) {
+                QMutexLocker locker(&mutex);
+                watches.append({wd, QFile::decodeName(path)});
+            } else if (errno == ENOSPC) {
+                exhausted = true;
+                walker.cancel();
+            }
+        };
+
+        add(QFile::encodeName(dirPath));
+        CDirWalker::Visitor visitor;
+        visitor.entry = [&](const CDirWalker::Entry &entry) {
+            if (entry.name[0] == '.' || entry.type != CDirWalker::Directory) return false;
+            add(entry.filePath());
+            return true;
+        };
+        if (!exhausted)
+            walker.walk(dirPath, visitor);
+
+        {
+            QMutexLocker locker(&walkerMutex);
+            activeWalkers.removeOne(&walker);
+        }
+        if (walker.isCancelled() && !exhausted) return;
+
+        const bool complete = !exhausted;
+        QMetaObject::invokeMethod(this, [this, rootPath, watches, complete, initial] {
+            addTreeWatches(rootPath, watches, complete, initial);
+        }, Qt::QueuedConnection);
+    });
+#else
+    Q_UNUSED(rootPath);
+    Q_UNUSED(dirPath);
+    Q_UNUSED(initial);
+#endif
+}
+
+void CChangeWatcher::addTreeWatches(const QString &rootPath, const Watches &watches, bool complete, bool initial) {
+#ifdef Q_OS_LINUX
+    auto root = treeRoots.constFind(rootPath);
+    const bool mounted = root != treeRoots.constEnd() && root.value();
+    if (complete && root != treeRoots.constEnd() && !mounted) {
+        for (const auto &watch : watches) {
+            pathsByDescriptor.insert(watch.first, watch.second);
+            descriptorsByPath.insert(watch.second, watch.first);
+            // Anything that happened in a new folder before its watch was
+            // known went unreported.
+            if (!initial) overflowed(watch.second);
+        }
+        if (initial) emit treeWatched(rootPath, true);
+        return;
+    }
+
+    for (const auto &watch : watches) {
+        if (!descriptorsByPath.contains(watch.second))
+            ::inotify_rm_watch(inotifyFd, watch.first);
+    }
+    if (mounted) {
+        if (initial) emit treeWatched(rootPath, true);
+        return;
+    }
+
+    // A tree with unwatched folders cannot be trusted, so the rest of it is
+    // given up too, leaving the watches for the folders being viewed.
+    qWarning("Cannot watch %s: the inotify watch limit (fs.inotify.max_user_watches) is reached",
+             qUtf8Printable(rootPath));
+    removeTreeWatches(rootPath);
+    treeRoots.remove(rootPath);
+    emit treeWatched(rootPath, false);
+#else
+    Q_UNUSED(rootPath);
+    Q_UNUSED(watches);
+    Q_UNUSED(complete);
+    Q_UNUSED(initial);
+#endif
+}
+
+void CChangeWatcher::removeTreeWatches(const QString &dirPath) {
+#ifdef Q_OS_LINUX
+    for (auto it = descriptorsByPath.begin(); it != descriptorsByPath.end();) {
+        if (isUnder(it.key(), dirPath) && !watchCounts.contains(it.key())) {
+            ::inotify_rm_watch(inotifyFd, it.value());
+            pathsByDescriptor.remove(it.value());
+            it = descriptorsByPath.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#else
+    Q_UNUSED(dirPath);
+#endif
+}
+
+QString CChangeWatcher::treeRootFor(const QString &dirPath) const {
+#ifdef Q_OS_LINUX
+    for (auto it = treeRoots.cbegin(); it != treeRoots.cend(); ++it) {
+        if (it.value() || !isUnder(dirPath, it.key())) continue;
+        if (dirPath.mid(it.key().size()).contains("/.")) continue;
+        return it.key();
+    }
+#else
+    Q_UNUSED(dirPath);
+#endif
+    return QString();
+}
+
+void CChangeWatcher::readInotify() {
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while (true) {
+        const ssize_t length = ::read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) break;
+
+        for (ssize_t offset = 0; offset < length;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (auto it = watchCounts.cbegin(); it != watchCounts.cend(); ++it)
+                    overflowed(it.key());
+                for (auto it = treeRoots.cbegin(); it != treeRoots.cend(); ++it) {
+                    if (!it.value()) emit treeOverflowed(it.key());
+                }
+                continue;
+            }
+
+            const QString dirPath = pathsByDescriptor.value(event->wd);
+            if (dirPath.isEmpty()) continue;
+
+            if (event->mask & IN_IGNORED) {
+                pathsByDescriptor.remove(event->wd);
+                descriptorsByPath.remove(dirPath);
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                overflowed(dirPath);
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            const QString name = QFile::decodeName(event->name);
+            if ((event->mask & IN_ISDIR) && event->name[0] != '.') {
+                const QString rootPath = treeRootFor(dirPath);
+                const QString childPath = QDir(dirPath).filePath(name);
+                if (!rootPath.isEmpty() && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                    watchSubtree(rootPath, childPath, false);
+                else if (!rootPath.isEmpty() && (event->mask & IN_MOVED_FROM))
+                    removeTreeWatches(childPath);
+            }
+
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                added(dirPath, name);
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                removed(dirPath, name);
+            else
+                modified(dirPath, name);
+        }
+    }
+#endif
+}
+
+void CChangeWatcher::readFanotify() {
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    // The events are read on a worker, and the notifier stays off until their
+    // paths are back.
+    fanotifyNotifier->setEnabled(false);
+    const int fd = fanotifyFd;
+    const QHash<quint64, int> fds = mountFds;
+    fanotifyPool.start([this, fd, fds] {
+        bool overflow = false;
+        const QVector<FanotifyEvent> events = readFanotifyEvents(fd, fds, overflow);
+
+        QMetaObject::invokeMethod(this, [this, events, overflow] {
+            if (overflow) {
+                for (auto it = watchCounts.cbegin(); it != watchCounts.cend(); ++it)
+                    overflowed(it.key());
+                for (auto it = treeRoots.cbegin(); it != treeRoots.cend(); ++it) {
+                    if (it.value()) emit treeOverflowed(it.key());
+                }
+            }
+            for (const FanotifyEvent &event : events) {
+                if (event.kind == FanotifyEvent::Added)
+                    added(event.dirPath, event.name);
+                else if (event.kind == FanotifyEvent::Removed)
+                    removed(event.dirPath, event.name);
+                else
+                    modified(event.dirPath, event.name);
+            }
+            fanotifyNotifier->setEnabled(true);
+        }, Qt::QueuedConnection);
+    });
+#endif
+}
+
+void CChangeWatcher::added(const QString &dirPath, const QString &name) {
+    Pending &changes = pending[dirPath];
+    if (!changes.overflow) {
+        changes.added.insert(name);
+        changes.modified.remove(name);
+        if (changes.added.size() > kMaxNamesPerDirectory) {
+            overflowed(dirPath);
+            return;
+        }
+    }
+    schedule();
+}
+
+void CChangeWatcher::removed(const QString &dirPath, const QString &name) {
+    Pending &changes = pending[dirPath];
+    if (!changes.overflow) {
+        // Something created and deleted within one batch never happened.
+        if (!changes.added.remove(name))
+            changes.removed.insert(name);
+        changes.modified.remove(name);
+        if (changes.removed.size() > kMaxNamesPerDirectory) {
+            overflowed(dirPath);
+            return;
+        }
+    }
+    schedule();
+}
+
+void CChangeWatcher::modified(const QString &dirPath, const QString &name) {
+    Pending &changes = pending[dirPath];
+    if (!changes.overflow && !changes.added.contains(name)) {
+        changes.modified.insert(name);
+        if (changes.modified.size() > kMaxNamesPerDirectory) {
+            overflowed(dirPath);
+            return;
+        }
+    }
+    schedule();
+}
+
+void CChangeWatcher::overflowed(const QString &dirPath) {
+    Pending &changes = pending[dirPath];
+    changes.overflow = true;
+    changes.added.clear();
+    changes.removed.clear();
+    changes.modified.clear();
+    schedule();
+}
+
+void CChangeWatcher::schedule() {
+    if (!pendingSince.isValid())
+        pendingSince.start();
+
+    if (pendingSince.elapsed() >= kMaxLatencyMs) {
+        flush();
+        return;
+    }
+    flushTimer->start();
+}
+
+void CChangeWatcher::flush() {
+    flushTimer->stop();
+    pendingSince.invalidate();
+
+    const QHash<QString, Pending> batches = std::exchange(pending, {});
+    for (auto it = batches.cbegin(); it != batches.cend(); ++it) {
+        const Pending &batch = it.value();
+
+        Changes changes;
+        changes.added = batch.added.values();
+        changes.removed = batch.removed.values();
+        changes.modified = batch.modified.values();
+        changes.overflow = batch.overflow;
+        emit directoryChanged(it.key(), changes);
+    }
+}
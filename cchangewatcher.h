@@ -0,0 +1,112 @@
+#ifndef CCHANGEWATCHER_H
+#define CCHANGEWATCHER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+class CDirWalker;
+class QFileSystemWatcher;
+class QSocketNotifier;
+
+// One change notification service for the whole application. Folders are
+// watched with inotify while someone is interested in them, or as part of a
+// whole file system through fanotify when the process is allowed to. Events
+// are collected per folder and delivered in batches once they settle, so a
+// checkout or an extraction arrives as a few diffs instead of a storm.
+class CChangeWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    struct Changes {
+        QStringList added;
+        QStringList removed;
+        QStringList modified;
+        // Events were lost; the folder has to be listed again.
+        bool overflow = false;
+    };
+
+    explicit CChangeWatcher(QObject *parent = nullptr);
+    ~CChangeWatcher() override;
+
+    // Reference counted; every watch() needs a matching unwatch().
+    void watch(const QString &path);
+    void unwatch(const QString &path);
+
+    // Reports changes anywhere on the file system holding `path`. Needs
+    // CAP_SYS_ADMIN, so for ordinary users this logs why fanotify is
+    // unavailable and returns false; watchTree() then falls back to inotify.
+    bool watchMount(const QString &path);
+
+    // Reports changes in every folder below `rootPath` that is not hidden,
+    // for as long as the watcher lives. A file system marked with
+    // watchMount() already covers it; elsewhere each folder gets an inotify
+    // watch, added on a worker thread. treeWatched() answers once the tree is
+    // covered, or with `complete` false if the inotify watch limit ran out,
+    // in which case the tree is not watched at all.
+    void watchTree(const QString &rootPath);
+
+signals:
+    void directoryChanged(const QString &path, const CChangeWatcher::Changes &changes);
+    void treeWatched(const QString &rootPath, bool complete);
+    // Events below a watched tree were lost.
+    void treeOverflowed(const QString &rootPath);
+
+private:
+    struct Pending {
+        QSet<QString> added;
+        QSet<QString> removed;
+        QSet<QString> modified;
+        bool overflow = false;
+    };
+
+    using Watches = QVector<QPair<int, QString>>;
+
+    void readInotify();
+    void readFanotify();
+    void watchSubtree(const QString &rootPath, const QString &dirPath, bool initial);
+    void addTreeWatches(const QString &rootPath, const Watches &watches, bool complete, bool initial);
+    void removeTreeWatches(const QString &dirPath);
+    QString treeRootFor(const QString &dirPath) const;
+    void added(const QString &dirPath, const QString &name);
+    void removed(const QString &dirPath, const QString &name);
+    void modified(const QString &dirPath, const QString &name);
+    void overflowed(const QString &dirPath);
+    void schedule();
+    void flush();
+
+    QHash<QString, int> watchCounts;
+    QHash<QString, Pending> pending;
+    QTimer *flushTimer;
+    QElapsedTimer pendingSince;
+
+    int inotifyFd = -1;
+    QSocketNotifier *inotifyNotifier = nullptr;
+    QHash<int, QString> pathsByDescriptor;
+    QHash<QString, int> descriptorsByPath;
+
+    int fanotifyFd = -1;
+    QSocketNotifier *fanotifyNotifier = nullptr;
+    // An open directory on each file system marked for fanotify, by file
+    // system id, for resolving the file handles in its events.
+    QHash<quint64, int> mountFds;
+
+    QFileSystemWatcher *fallbackWatcher = nullptr;
+
+    // Roots given to watchTree(), and whether fanotify covers each of them.
+    QHash<QString, bool> treeRoots;
+    QThreadPool treePool;
+    QThreadPool fanotifyPool;
+    QMutex walkerMutex;
+    QList<CDirWalker *> activeWalkers;
+};
+
+#endif // CCHANGEWATCHER_H
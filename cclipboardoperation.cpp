@@ -0,0 +1,134 @@
+#include "cclipboardoperation.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QMimeData>
+#include <QUrl>
+
+namespace {
+const char *const kMimeType = "application/x-cexplorer-clipboard";
+}
+
+CClipboardOperation::CClipboardOperation(QObject *parent)
+    : QObject(parent) {}
+
+void CClipboardOperation::set(Mode mode, const QStringList &paths) {
+    QStringList changed;
+    if (currentMode == Cut) {
+        for (int i = 0; i < orderedKeys.size(); ++i) {
+            if (remaining.contains(orderedKeys.at(i)))
+                changed.append(orderedPaths.at(i));
+        }
+    }
+
+    currentMode = mode;
+    ++currentId;
+    orderedPaths.clear();
+    orderedKeys.clear();
+    remaining.clear();
+    pastedInto.clear();
+
+    for (const QString &path : paths) {
+        const QString key = normalize(path);
+        if (remaining.contains(key)) continue;
+
+        remaining.insert(key);
+        orderedKeys.append(key);
+        orderedPaths.append(QDir::cleanPath(path));
+    }
+
+    if (mode == Cut)
+        changed += orderedPaths;
+    if (!changed.isEmpty())
+        emit pathsChanged(changed);
+}
+
+void CClipboardOperation::clear() {
+    set(Copy, QStringList());
+}
+
+CClipboardOperation::Mode CClipboardOperation::mode() const {
+    return currentMode;
+}
+
+bool CClipboardOperation::isCut() const {
+    return currentMode == Cut;
+}
+
+bool CClipboardOperation::isEmpty() const {
+    return remaining.isEmpty();
+}
+
+quint64 CClipboardOperation::id() const {
+    return currentId;
+}
+
+bool CClipboardOperation::contains(const QString &path) const {
+    return remaining.contains(normalize(path));
+}
+
+QStringList CClipboardOperation::paths() const {
+    QStringList result;
+    for (int i = 0; i < orderedKeys.size(); ++i) {
+        if (remaining.contains(orderedKeys.at(i)))
+            result.append(orderedPaths.at(i));
+    }
+    return result;
+}
+
+QStringList CClipboardOperation::pendingPaths(const QString &destinationDir) const {
+    const QSet<QString> pasted = pastedInto.value(normalize(destinationDir));
+
+    QStringList pending;
+    for (int i = 0; i < orderedKeys.size(); ++i) {
+        const QString &key = orderedKeys.at(i);
+        if (remaining.contains(key) && !pasted.contains(key))
+            pending.append(orderedPaths.at(i));
+    }
+    return pending;
+}
+
+void CClipboardOperation::markDone(const QString &path, const QString &destinationDir) {
+    const QString key = normalize(path);
+    if (!remaining.contains(key)) return;
+
+    if (currentMode == Copy) {
+        pastedInto[normalize(destinationDir)].insert(key);
+        return;
+    }
+
+    remaining.remove(key);
+    emit pathsChanged(QStringList{QDir::cleanPath(path)});
+}
+
+QMimeData *CClipboardOperation::createMimeData() const {
+    QList<QUrl> urls;
+    urls.reserve(orderedPaths.size());
+    for (int i = 0; i < orderedPaths.size(); ++i) {
+        if (remaining.contains(orderedKeys.at(i)))
+            urls.append(QUrl::fromLocalFile(orderedPaths.at(i)));
+    }
+
+    QMimeData *mimeData = new QMimeData();
+    mimeData->setUrls(urls);
+    mimeData->setData(kMimeType, tag());
+    return mimeData;
+}
+
+bool CClipboardOperation::matches(const QMimeData *mimeData) const {
+    return mimeData && !remaining.isEmpty() && mimeData->data(kMimeType) == tag();
+}
+
+QString CClipboardOperation::normalize(const QString &path) {
+    const QString cleanPath = QDir::cleanPath(QDir::isAbsolutePath(path) ? path : QFileInfo(path).absoluteFilePath());
+#ifdef Q_OS_WIN
+    return cleanPath.toCaseFolded();
+#else
+    return cleanPath;
+#endif
+}
+
+QByteArray CClipboardOperation::tag() const {
+    return QByteArray::number(QCoreApplication::applicationPid()) + ':' + QByteArray::number(currentId);
+}
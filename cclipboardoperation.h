@@ -0,0 +1,63 @@
+#ifndef CCLIPBOARDOPERATION_H
+#define CCLIPBOARDOPERATION_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+class QMimeData;
+
+// The items of the last copy or cut, keyed by normalized path. Items are
+// marked done as they are pasted, so a paste that stops part way can be
+// resumed by pasting again.
+class CClipboardOperation : public QObject {
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Copy,
+        Cut
+    };
+
+    explicit CClipboardOperation(QObject *parent = nullptr);
+
+    void set(Mode mode, const QStringList &paths);
+    void clear();
+
+    Mode mode() const;
+    bool isCut() const;
+    bool isEmpty() const;
+    quint64 id() const;
+
+    bool contains(const QString &path) const;
+    // Items that have not been pasted everywhere yet, in their original order.
+    QStringList paths() const;
+
+    // Sources that have not been pasted into destinationDir yet.
+    QStringList pendingPaths(const QString &destinationDir) const;
+    void markDone(const QString &path, const QString &destinationDir);
+
+    // Mime data for the system clipboard, tagged so matches() can recognise it.
+    QMimeData *createMimeData() const;
+    bool matches(const QMimeData *mimeData) const;
+
+    static QString normalize(const QString &path);
+
+signals:
+    // Paths whose cut state changed.
+    void pathsChanged(const QStringList &paths);
+
+private:
+    QByteArray tag() const;
+
+    Mode currentMode = Copy;
+    quint64 currentId = 0;
+    // Clean paths as given, and the normalized keys used for lookups, in order.
+    QStringList orderedPaths;
+    QStringList orderedKeys;
+    QSet<QString> remaining;
+    QHash<QString, QSet<QString>> pastedInto;
+};
+
+#endif // CCLIPBOARDOPERATION_H
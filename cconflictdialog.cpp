@@ -0,0 +1,130 @@
+#include "cconflictdialog.h"
+
+#include <QComboBox>
+#include <QDialogButtonBox>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QStyledItemDelegate>
+#include <QVBoxLayout>
+
+namespace {
+enum Column {
+    NameColumn,
+    DestinationColumn,
+    ActionColumn
+};
+
+QString resolutionName(CCopyJob::Resolution resolution) {
+    switch (resolution) {
+    case CCopyJob::Overwrite: return QString("Overwrite");
+    case CCopyJob::KeepBoth: return QString("Keep both");
+    case CCopyJob::Skip: return QString("Skip");
+    }
+    return QString();
+}
+
+class ResolutionDelegate : public QStyledItemDelegate {
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &, const QModelIndex &) const override {
+        QComboBox *comboBox = new QComboBox(parent);
+        for (CCopyJob::Resolution resolution : {CCopyJob::Overwrite, CCopyJob::KeepBoth, CCopyJob::Skip})
+            comboBox->addItem(resolutionName(resolution), resolution);
+        return comboBox;
+    }
+
+    void setEditorData(QWidget *editor, const QModelIndex &index) const override {
+        QComboBox *comboBox = static_cast<QComboBox *>(editor);
+        comboBox->setCurrentIndex(comboBox->findData(index.data(Qt::UserRole)));
+    }
+
+    void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const override {
+        QComboBox *comboBox = static_cast<QComboBox *>(editor);
+        model->setData(index, comboBox->currentData(), Qt::UserRole);
+        model->setData(index, comboBox->currentText(), Qt::DisplayRole);
+    }
+};
+}
+
+CConflictDialog::CConflictDialog(const QList<CCopyJob::Item> &conflicts, QWidget *parent)
+    : QDialog(parent) {
+    setWindowTitle("Conflicts Detected");
+    resize(640, 360);
+
+    QLabel *label = new QLabel(
+        QString("%1 item%2 already exist%3 in the destination. Choose what to do with each one.")
+            .arg(conflicts.size())
+            .arg(conflicts.size() == 1 ? "" : "s", conflicts.size() == 1 ? "s" : ""),
+        this);
+    label->setWordWrap(true);
+
+    table = new QTableWidget(conflicts.size(), 3, this);
+    table->setHorizontalHeaderLabels({"Name", "Destination", "Action"});
+    table->setSelectionMode(QAbstractItemView::NoSelection);
+    table->setEditTriggers(QAbstractItemView::AllEditTriggers);
+    table->setItemDelegateForColumn(ActionColumn, new ResolutionDelegate(table));
+    table->verticalHeader()->hide();
+    table->horizontalHeader()->setSectionResizeMode(DestinationColumn, QHeaderView::Stretch);
+
+    for (int row = 0; row < conflicts.size(); ++row) {
+        const QFileInfo targetInfo(conflicts.at(row).target);
+
+        QTableWidgetItem *nameItem = new QTableWidgetItem(targetInfo.fileName());
+        nameItem->setFlags(Qt::ItemIsEnabled);
+        nameItem->setToolTip(conflicts.at(row).source);
+
+        QTableWidgetItem *destinationItem = new QTableWidgetItem(targetInfo.absolutePath());
+        destinationItem->setFlags(Qt::ItemIsEnabled);
+
+        QTableWidgetItem *actionItem = new QTableWidgetItem(resolutionName(CCopyJob::KeepBoth));
+        actionItem->setData(Qt::UserRole, CCopyJob::KeepBoth);
+
+        table->setItem(row, NameColumn, nameItem);
+        table->setItem(row, DestinationColumn, destinationItem);
+        table->setItem(row, ActionColumn, actionItem);
+    }
+
+    QPushButton *overwriteAllButton = new QPushButton("Overwrite All", this);
+    QPushButton *keepBothAllButton = new QPushButton("Keep Both for All", this);
+    QPushButton *skipAllButton = new QPushButton("Skip All", this);
+
+    connect(overwriteAllButton, &QPushButton::clicked, this, [this] { applyToAll(CCopyJob::Overwrite); });
+    connect(keepBothAllButton, &QPushButton::clicked, this, [this] { applyToAll(CCopyJob::KeepBoth); });
+    connect(skipAllButton, &QPushButton::clicked, this, [this] { applyToAll(CCopyJob::Skip); });
+
+    QHBoxLayout *applyLayout = new QHBoxLayout;
+    applyLayout->addWidget(overwriteAllButton);
+    applyLayout->addWidget(keepBothAllButton);
+    applyLayout->addWidget(skipAllButton);
+    applyLayout->addStretch();
+
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(label);
+    layout->addWidget(table);
+    layout->addLayout(applyLayout);
+    layout->addWidget(buttonBox);
+}
+
+QList<CCopyJob::Resolution> CConflictDialog::resolutions() const {
+    QList<CCopyJob::Resolution> result;
+    result.reserve(table->rowCount());
+    for (int row = 0; row < table->rowCount(); ++row)
+        result.append(CCopyJob::Resolution(table->item(row, ActionColumn)->data(Qt::UserRole).toInt()));
+    return result;
+}
+
+void CConflictDialog::applyToAll(CCopyJob::Resolution resolution) {
+    for (int row = 0; row < table->rowCount(); ++row) {
+        QTableWidgetItem *actionItem = table->item(row, ActionColumn);
+        actionItem->setData(Qt::UserRole, resolution);
+        actionItem->setText(resolutionName(resolution));
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef CCONFLICTDIALOG_H
+#define CCONFLICTDIALOG_H
+
+#include "ccopyjob.h"
+
+#include <QDialog>
+#include <QTableWidget>
+
+// Lists every conflicting item of a paste at once so a resolution can be
+// picked per item or applied to all of them.
+class CConflictDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit CConflictDialog(const QList<CCopyJob::Item> &conflicts, QWidget *parent = nullptr);
+
+    QList<CCopyJob::Resolution> resolutions() const;
+
+private:
+    void applyToAll(CCopyJob::Resolution resolution);
+
+    QTableWidget *table;
+};
+
+#endif // CCONFLICTDIALOG_H
@@ -0,0 +1,193 @@
+#include "ccontentscanner.h"
+
+#include <QFile>
+
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+namespace {
+constexpr int kChunkBytes = 1024 * 1024;
+// The start of an unfinished line is carried into the next chunk, up to this
+// much, so that its preview can be shown.
+constexpr int kCarryBytes = 4096;
+constexpr int kBinaryProbeBytes = 8192;
+constexpr int kPreviewBytes = 200;
+
+inline char foldAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c;
+}
+
+bool equalsFolded(const char *text, const char *needle, int length) {
+    for (int i = 0; i < length; ++i) {
+        if (foldAscii(text[i]) != needle[i]) return false;
+    }
+    return true;
+}
+
+int countNewlines(const char *data, int length) {
+    int count = 0;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= length; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        count += qPopulationCount(quint32(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline))));
+    }
+#endif
+    for (; i < length; ++i)
+        count += data[i] == '\n';
+    return count;
+}
+
+QString previewOf(const char *data, int start, int at, int end) {
+    // Long lines are cut to a window around the hit.
+    if (end - start > kPreviewBytes) {
+        start = qMax(start, at - kPreviewBytes / 4);
+        end = qMin(end, start + kPreviewBytes);
+    }
+    return QString::fromUtf8(data + start, end - start).trimmed();
+}
+}
+
+CContentScanner::CContentScanner(const QByteArray &literal)
+    : caseSensitive(false) {
+    for (char c : literal) {
+        if (c >= 'A' && c <= 'Z') caseSensitive = true;
+    }
+    needle = literal;
+    if (!caseSensitive) {
+        for (char &c : needle)
+            c = foldAscii(c);
+    }
+}
+
+bool CContentScanner::isCaseSensitive() const {
+    return caseSensitive;
+}
+
+int CContentScanner::find(const char *data, int length, int from) const {
+    const int needleLength = int(needle.size());
+    const char *pattern = needle.constData();
+    const int last = length - needleLength;
+    int i = from;
+#ifdef __SSE2__
+    // Screens 16 starting positions at once by the first and last byte of the
+    // literal, and compares the whole literal only where both agree.
+    const __m128i head = _mm_set1_epi8(pattern[0]);
+    const __m128i tail = _mm_set1_epi8(pattern[needleLength - 1]);
+    const __m128i belowUpper = _mm_set1_epi8('A' - 1);
+    const __m128i aboveUpper = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const bool fold = !caseSensitive;
+    auto load = [&](const char *at) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(at));
+        if (!fold) return bytes;
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, belowUpper), _mm_cmplt_epi8(bytes, aboveUpper));
+        return _mm_or_si128(bytes, _mm_and_si128(upper, caseBit));
+    };
+    for (; i + 15 <= last; i += 16) {
+        const __m128i first = _mm_cmpeq_epi8(load(data + i), head);
+        const __m128i final = _mm_cmpeq_epi8(load(data + i + needleLength - 1), tail);
+        uint mask = uint(_mm_movemask_epi8(_mm_and_si128(first, final)));
+        while (mask) {
+            const int at = i + qCountTrailingZeroBits(mask);
+            if (fold ? equalsFolded(data + at, pattern, needleLength)
+                     : std::memcmp(data + at, pattern, needleLength) == 0) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        if (caseSensitive ? data[i] == pattern[0] && std::memcmp(data + i, pattern, needleLength) == 0
+                          : foldAscii(data[i]) == pattern[0] && equalsFolded(data + i, pattern, needleLength)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+CContentScanner::Result CContentScanner::scan(const QString &path, int maxHits, const std::atomic<bool> &cancelled,
+                                              QVector<Hit> &hits) const {
+    if (needle.isEmpty()) return Scanned;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) return Unreadable;
+#ifdef Q_OS_LINUX
+    ::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    const int needleLength = int(needle.size());
+    std::vector<char> buffer(qMax(kCarryBytes, needleLength) + kChunkBytes);
+    char *data = buffer.data();
+    int length = 0;
+    // The first start position that has not been searched yet.
+    int from = 0;
+    // Newlines before `counted` are included in `line`.
+    int counted = 0;
+    int line = 1;
+    int lastHitLine = 0;
+    qint64 base = 0;
+    bool firstChunk = true;
+
+    while (!cancelled && hits.size() < maxHits) {
+        const qint64 bytes = file.read(data + length, kChunkBytes);
+        if (bytes <= 0) break;
+        if (firstChunk) {
+            firstChunk = false;
+            if (std::memchr(data, 0, size_t(qMin<qint64>(bytes, kBinaryProbeBytes)))) return Binary;
+        }
+        length += int(bytes);
+
+        for (int at = find(data, length, from); at >= 0; at = find(data, length, from)) {
+            line += countNewlines(data + counted, at - counted);
+            counted = at;
+
+            const char *newline = static_cast<const char *>(std::memchr(data + at, '\n', size_t(length - at)));
+            const int end = newline ? int(newline - data) : length;
+            from = newline ? end + 1 : length;
+            if (line == lastHitLine) continue;
+
+            int start = at;
+            while (start > 0 && data[start - 1] != '\n')
+                --start;
+
+            Hit hit;
+            hit.offset = base + at;
+            hit.line = line;
+            hit.preview = previewOf(data, start, at, end);
+            hits.append(hit);
+            lastHitLine = line;
+            if (hits.size() >= maxHits) break;
+        }
+
+        // The unfinished last line is kept, along with enough bytes for a
+        // literal that spans the two chunks.
+        int lineStart = length;
+        while (lineStart > 0 && data[lineStart - 1] != '\n' && length - lineStart < kCarryBytes)
+            --lineStart;
+        const int keep = qMin(length, qMax(length - lineStart, needleLength - 1));
+        const int shift = length - keep;
+
+        if (counted < shift) {
+            line += countNewlines(data + counted, shift - counted);
+            counted = 0;
+        } else {
+            counted -= shift;
+        }
+        from = qMax(0, qMax(from, length - needleLength + 1) - shift);
+        std::memmove(data, data + shift, size_t(keep));
+        length = keep;
+        base += shift;
+    }
+    return Scanned;
+}
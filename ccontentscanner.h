@@ -0,0 +1,45 @@
+#ifndef CCONTENTSCANNER_H
+#define CCONTENTSCANNER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+// Looks for a literal inside files. Files are read front to back in large
+// chunks rather than mapped, so a file that shrinks during the scan cannot
+// fault the process. The literal matches regardless of ASCII case unless it
+// contains upper case letters itself.
+class CContentScanner {
+public:
+    struct Hit {
+        qint64 offset = 0;
+        // Counted from 1.
+        int line = 0;
+        // The matching line, cut down around the hit when it is long.
+        QString preview;
+    };
+
+    enum Result {
+        Scanned,
+        Binary,
+        Unreadable
+    };
+
+    explicit CContentScanner(const QByteArray &literal);
+
+    bool isCaseSensitive() const;
+
+    // Reports up to `maxHits` matching lines, one hit per line. Files with a
+    // NUL byte near the start are taken as binary and not searched.
+    Result scan(const QString &path, int maxHits, const std::atomic<bool> &cancelled, QVector<Hit> &hits) const;
+
+private:
+    int find(const char *data, int length, int from) const;
+
+    QByteArray needle;
+    bool caseSensitive;
+};
+
+#endif // CCONTENTSCANNER_H
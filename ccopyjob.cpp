@@ -0,0 +1,381 @@
+#include "ccopyjob.h"
+#include "cdirwalker.h"
+#include "cfilecopier.h"
+#include "cfileoperations.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QStorageInfo>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#endif
+
+namespace {
+bool pathExists(const QString &path) {
+    QFileInfo info(path);
+    return info.exists() || info.isSymLink();
+}
+
+QString availableTarget(const CCopyJob::Item &item) {
+    const QFileInfo sourceInfo(item.source);
+    const QFileInfo targetInfo(item.target);
+    const QString destinationDirPath = targetInfo.absolutePath();
+    const QString originalName = targetInfo.fileName();
+    const QString baseName = targetInfo.completeBaseName();
+    const QString extension = targetInfo.suffix();
+
+    QString targetPath = item.target;
+    for (int counter = 1; pathExists(targetPath); ++counter) {
+        QString newName;
+        if (sourceInfo.isFile()) {
+            newName = QString("%1_%2%3").arg(baseName).arg(counter)
+            .arg(extension.isEmpty() ? "" : "." + extension);
+        } else {
+            newName = QString("%1_%2").arg(originalName).arg(counter);
+        }
+
+        targetPath = destinationDirPath + QDir::separator() + newName;
+    }
+    return targetPath;
+}
+
+enum class RenameResult {
+    Renamed,
+    CrossDevice,
+    Failed
+};
+
+RenameResult renameItem(const QString &source, const QString &target, QString *error) {
+#ifdef Q_OS_LINUX
+    const QByteArray from = QFile::encodeName(source);
+    const QByteArray to = QFile::encodeName(target);
+
+    // RENAME_NOREPLACE makes the check for an existing target part of the
+    // rename itself. Kernels or file systems without it get a plain rename.
+    int result = -1;
+    bool noReplace = false;
+#ifdef SYS_renameat2
+    result = int(::syscall(SYS_renameat2, AT_FDCWD, from.constData(), AT_FDCWD, to.constData(), RENAME_NOREPLACE));
+    noReplace = result == 0 || (errno != ENOSYS && errno != EINVAL);
+#endif
+    if (!noReplace) {
+        if (pathExists(target)) {
+            errno = EEXIST;
+        } else {
+            result = ::rename(from.constData(), to.constData());
+        }
+    }
+
+    if (result == 0) return RenameResult::Renamed;
+    if (errno == EXDEV) return RenameResult::CrossDevice;
+    *error = QString::fromLocal8Bit(std::strerror(errno));
+    return RenameResult::Failed;
+#else
+    const QFileInfo info(source);
+    const bool renamed = info.isDir() && !info.isSymLink() ? QDir().rename(source, target)
+                                                           : QFile::rename(source, target);
+    if (renamed) return RenameResult::Renamed;
+
+    // Qt does not say why a rename failed, so only a move to another volume
+    // is retried as a copy.
+    if (QStorageInfo(source).rootPath() != QStorageInfo(QFileInfo(target).absolutePath()).rootPath())
+        return RenameResult::CrossDevice;
+    *error = QString("Could not rename the item");
+    return RenameResult::Failed;
+#endif
+}
+}
+
+CCopyJob::CCopyJob(const QList<Item> &items, Mode mode, QObject *parent)
+    : CFileJob(parent), items(items), mode(mode) {
+    qRegisterMetaType<CCopyJob::Item>();
+    qRegisterMetaType<QList<CCopyJob::Item>>();
+}
+
+CCopyJob::~CCopyJob() {
+    cancel();
+    wait();
+}
+
+QString CCopyJob::description() const {
+    const QString verb = mode == Move ? QString("Moving") : QString("Copying");
+    if (items.size() == 1)
+        return QString("%1 %2").arg(verb, QFileInfo(items.first().source).fileName());
+    return QString("%1 %2 items").arg(verb).arg(items.size());
+}
+
+void CCopyJob::setVerify(bool enabled) {
+    verify = enabled;
+}
+
+void CCopyJob::resolveConflicts(const QList<Resolution> &answers) {
+    QMutexLocker locker(&resolutionMutex);
+    resolutions = answers;
+    resolved = true;
+    resolutionReady.wakeAll();
+}
+
+bool CCopyJob::waitForResolutions() {
+    QList<int> conflicting;
+    QList<Item> conflicts;
+    for (int i = 0; i < items.size(); ++i) {
+        if (pathExists(items.at(i).target)) {
+            conflicting.append(i);
+            conflicts.append(items.at(i));
+        }
+    }
+
+    if (conflicts.isEmpty()) return true;
+
+    emit conflictsFound(conflicts);
+
+    {
+        QMutexLocker locker(&resolutionMutex);
+        while (!resolved && !isCancelled())
+            resolutionReady.wait(&resolutionMutex, 100);
+    }
+    if (isCancelled()) return false;
+
+    QList<bool> skipped(items.size(), false);
+    for (int i = 0; i < conflicting.size(); ++i) {
+        Item &item = items[conflicting.at(i)];
+        Resolution resolution = i < resolutions.size() ? resolutions.at(i) : Skip;
+
+        if (resolution == Overwrite &&
+            QFileInfo(item.source).absoluteFilePath() == QFileInfo(item.target).absoluteFilePath()) {
+            resolution = KeepBoth;
+        }
+
+        switch (resolution) {
+        case Overwrite: {
+            QString error;
+            if (!CFileOperations::moveToRecycleBin(item.target, &error)) {
+                addError(QString("Could not move the existing item to the trash:\n%1\n%2").arg(item.target, error));
+                skipped[conflicting.at(i)] = true;
+            }
+            break;
+        }
+        case KeepBoth:
+            item.target = availableTarget(item);
+            break;
+        case Skip:
+            skipped[conflicting.at(i)] = true;
+            break;
+        }
+    }
+
+    QList<Item> remaining;
+    for (int i = 0; i < items.size(); ++i) {
+        if (!skipped.at(i))
+            remaining.append(items.at(i));
+    }
+    items = remaining;
+    return true;
+}
+
+void CCopyJob::measure() {
+    for (const Item &item : std::as_const(items)) {
+        if (isCancelled()) return;
+        measureItem(item);
+    }
+}
+
+void CCopyJob::measureItem(const Item &item) {
+    QFileInfo info(item.source);
+    if (info.isSymLink()) {
+        // Links are recreated, not followed, so their target adds no bytes.
+        ++filesTotal;
+        return;
+    }
+    if (!info.isDir()) {
+        bytesTotal += info.size();
+        ++filesTotal;
+        return;
+    }
+
+    CDirWalker walker;
+    CDirWalker::Visitor visitor;
+    visitor.entry = [&](const CDirWalker::Entry &entry) {
+        if (isCancelled()) {
+            walker.cancel();
+            return false;
+        }
+        if (entry.type == CDirWalker::Directory)
+            return true;
+
+        CDirWalker::Stat st;
+        if (entry.type == CDirWalker::File && entry.stat(st))
+            bytesTotal += st.size;
+        ++filesTotal;
+        return false;
+    };
+    walker.walk(info.absoluteFilePath(), visitor);
+}
+
+void CCopyJob::copyItem(const Item &item) {
+    QFileInfo info(item.source);
+    if (info.isDir() && !info.isSymLink()) {
+        CFileOperations::CopyOptions options;
+        options.progress = [this](qint64 bytes) { return account(bytes); };
+        options.fileCopied = [this](const CFileCopier::Report &report) { fileCopied(report); };
+        options.isCancelled = [this] { return !checkpoint(); };
+        options.stopOnError = false;
+
+        QStringList itemErrors;
+        if (CFileOperations::copyRecursively(item.source, item.target, options, &itemErrors)) {
+            emit itemCompleted(item);
+        } else if (!isCancelled()) {
+            if (itemErrors.isEmpty())
+                itemErrors.append(QString("Failed to paste:\n%1").arg(item.source));
+            for (const QString &error : std::as_const(itemErrors))
+                addError(error);
+        }
+    } else if (info.isSymLink()) {
+        // As inside a copied folder, a link is copied as a link.
+        QString error;
+        if (CFileCopier::copyLink(item.source, item.target, &error)) {
+            ++filesDone;
+            emit itemCompleted(item);
+        } else {
+            addError(QString("Failed to paste:\n%1\n%2").arg(item.source, error));
+        }
+    } else {
+        QString error;
+        CFileCopier::Report report;
+        if (CFileCopier::copy(item.source, item.target, [this](qint64 bytes) { return account(bytes); }, &error,
+                              &report)) {
+            fileCopied(report);
+            emit itemCompleted(item);
+        } else if (!isCancelled()) {
+            addError(QString("Failed to paste:\n%1\n%2").arg(item.source, error));
+        }
+    }
+}
+
+void CCopyJob::fileCopied(const CFileCopier::Report &report) {
+    ++filesDone;
+    bytesSkipped += report.logicalBytes - report.physicalBytes;
+}
+
+void CCopyJob::moveItem(const Item &item) {
+    QString error;
+    switch (renameItem(item.source, item.target, &error)) {
+    case RenameResult::Renamed:
+        ++filesDone;
+        emit itemCompleted(item);
+        break;
+    case RenameResult::CrossDevice:
+        moveAcrossDevices(item);
+        break;
+    case RenameResult::Failed:
+        addError(QString("Failed to paste:\n%1\n%2").arg(item.source, error));
+        break;
+    }
+    publish(false);
+}
+
+void CCopyJob::moveAcrossDevices(const Item &item) {
+    // The item was counted as one file for the rename; now its contents are
+    // counted, twice over if they are read back to verify them.
+    --filesTotal;
+    const qint64 bytesBefore = bytesTotal;
+    measureItem(item);
+    if (verify)
+        bytesTotal += bytesTotal - bytesBefore;
+    publish(true);
+
+    const QFileInfo info(item.source);
+    const auto progress = [this](qint64 bytes) { return account(bytes); };
+    QStringList itemErrors;
+    bool copied = false;
+    // Only a target this move created is removed again when it fails; a
+    // folder that appeared there since the conflict check is left alone.
+    bool createdTarget = false;
+
+    if (info.isDir() && !info.isSymLink()) {
+        createdTarget = QDir().mkdir(item.target);
+        // Any failure, a FIFO, socket or device in the tree included, stops
+        // the copy, so such a tree is refused rather than moved without them.
+        CFileOperations::CopyOptions options;
+        options.progress = progress;
+        options.fileCopied = [this](const CFileCopier::Report &report) { fileCopied(report); };
+        options.isCancelled = [this] { return !checkpoint(); };
+        copied = CFileOperations::copyRecursively(item.source, item.target, options, &itemErrors);
+        if (copied && verify) {
+            options.fileCopied = nullptr;
+            copied = CFileOperations::verifyRecursively(item.source, item.target, options, &itemErrors);
+        }
+    } else if (info.isSymLink()) {
+        QString error;
+        copied = CFileCopier::copyLink(item.source, item.target, &error);
+        createdTarget = copied;
+        if (copied)
+            ++filesDone;
+        else
+            itemErrors.append(QString("Failed to paste:\n%1\n%2").arg(item.source, error));
+    } else {
+        QString error;
+        CFileCopier::Report report;
+        // The copy creates the file exclusively and removes it if it fails.
+        createdTarget = CFileCopier::copy(item.source, item.target, progress, &error, &report);
+        copied = createdTarget && (!verify || CFileCopier::verify(item.source, item.target, progress, &error));
+        if (copied)
+            fileCopied(report);
+        else
+            itemErrors.append(QString("Failed to paste:\n%1\n%2").arg(item.source, error));
+    }
+
+    // Nothing is deleted until the whole item has been copied, so a failed or
+    // cancelled move leaves the original as it was and can simply be redone.
+    if (!copied) {
+        if (createdTarget)
+            CFileOperations::removeRecursively(item.target);
+        if (isCancelled()) return;
+        if (itemErrors.isEmpty())
+            itemErrors.append(QString("Failed to paste:\n%1").arg(item.source));
+        for (const QString &error : std::as_const(itemErrors))
+            addError(error);
+        return;
+    }
+
+    QStringList removeErrors;
+    if (!CFileOperations::removeRecursively(item.source, {}, &removeErrors)) {
+        addError(QString("Copied, but could not remove the original:\n%1").arg(item.source));
+        for (const QString &error : std::as_const(removeErrors))
+            addError(error);
+    }
+    emit itemCompleted(item);
+}
+
+void CCopyJob::run() {
+    if (!waitForResolutions()) return;
+
+    if (mode == Copy) {
+        measure();
+    } else {
+        filesTotal = items.size();
+    }
+    publish(true);
+
+    for (const Item &item : std::as_const(items)) {
+        if (!checkpoint()) break;
+
+        if (mode == Copy) {
+            copyItem(item);
+        } else {
+            moveItem(item);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef CCOPYJOB_H
+#define CCOPYJOB_H
+
+#include "cfilecopier.h"
+#include "cfilejob.h"
+
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+class CCopyJob : public CFileJob {
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Copy,
+        Move
+    };
+
+    enum Resolution {
+        Overwrite,
+        KeepBoth,
+        Skip
+    };
+
+    struct Item {
+        QString source;
+        QString target;
+    };
+
+    explicit CCopyJob(const QList<Item> &items, Mode mode = Copy, QObject *parent = nullptr);
+    ~CCopyJob() override;
+
+    QString description() const override;
+
+    // Moves that cannot be renamed in place are copied, then compared with
+    // the original before it is deleted. Off by default.
+    void setVerify(bool enabled);
+
+    // Answers conflictsFound() with one resolution per conflicting item.
+    void resolveConflicts(const QList<Resolution> &resolutions);
+
+signals:
+    // Emitted from the job thread when targets already exist. The job waits
+    // until resolveConflicts() is called or it is cancelled.
+    void conflictsFound(const QList<CCopyJob::Item> &conflicts);
+    // Emitted from the job thread for each item that was pasted completely.
+    void itemCompleted(const CCopyJob::Item &item);
+
+protected:
+    void run() override;
+
+private:
+    bool waitForResolutions();
+    void measure();
+    void measureItem(const Item &item);
+    void copyItem(const Item &item);
+    void moveItem(const Item &item);
+    void moveAcrossDevices(const Item &item);
+    void fileCopied(const CFileCopier::Report &report);
+
+    QList<Item> items;
+    Mode mode;
+    bool verify = false;
+
+    QMutex resolutionMutex;
+    QWaitCondition resolutionReady;
+    QList<Resolution> resolutions;
+    bool resolved = false;
+};
+
+Q_DECLARE_METATYPE(CCopyJob::Item)
+
+#endif // CCOPYJOB_H
@@ -0,0 +1,110 @@
+#include "cdeletejob.h"
+#include "cdirwalker.h"
+#include "cfileoperations.h"
+#include "ctrash.h"
+
+#include <QFileInfo>
+
+CDeleteJob::CDeleteJob(const QStringList &paths, Mode mode, QObject *parent)
+    : CFileJob(parent), paths(paths), mode(mode) {
+}
+
+CDeleteJob::~CDeleteJob() {
+    cancel();
+    wait();
+}
+
+void CDeleteJob::setDescription(const QString &text) {
+    title = text;
+}
+
+QString CDeleteJob::description() const {
+    if (!title.isEmpty())
+        return title;
+    if (mode == EmptyTrash)
+        return QString("Emptying the trash");
+
+    if (mode == Trash) {
+        if (paths.size() == 1)
+            return QString("Moving %1 to the trash").arg(QFileInfo(paths.first()).fileName());
+        return QString("Moving %1 items to the trash").arg(paths.size());
+    }
+
+    if (paths.size() == 1)
+        return QString("Deleting %1").arg(QFileInfo(paths.first()).fileName());
+    return QString("Deleting %1 items").arg(paths.size());
+}
+
+void CDeleteJob::measure() {
+    for (const QString &path : std::as_const(paths)) {
+        if (isCancelled()) return;
+
+        ++filesTotal;
+
+        QFileInfo info(path);
+        if (!info.isDir() || info.isSymLink())
+            continue;
+
+        CDirWalker walker;
+        CDirWalker::Visitor visitor;
+        visitor.entry = [&](const CDirWalker::Entry &entry) {
+            if (isCancelled()) {
+                walker.cancel();
+                return false;
+            }
+            ++filesTotal;
+            return entry.type == CDirWalker::Directory;
+        };
+        walker.walk(info.absoluteFilePath(), visitor);
+    }
+}
+
+void CDeleteJob::moveToTrash() {
+    filesTotal = paths.size();
+    publish(true);
+
+    for (const QString &path : std::as_const(paths)) {
+        if (!checkpoint()) break;
+
+        QString error;
+        if (CTrash::moveToTrash(path, &error)) {
+            ++filesDone;
+        } else {
+            addError(QString("Failed to move to the trash:\n%1\n%2").arg(path, error));
+        }
+        publish(false);
+    }
+}
+
+void CDeleteJob::removePermanently() {
+    measure();
+    publish(true);
+
+    auto onRemoved = [this] {
+        ++filesDone;
+        publish(false);
+        return checkpoint();
+    };
+
+    for (const QString &path : std::as_const(paths)) {
+        if (!checkpoint()) break;
+
+        QStringList itemErrors;
+        if (!CFileOperations::removeRecursively(path, onRemoved, &itemErrors) && !isCancelled()) {
+            if (itemErrors.isEmpty())
+                itemErrors.append("Failed to delete:\n" + path);
+            for (const QString &error : std::as_const(itemErrors))
+                addError(error);
+        }
+    }
+}
+
+void CDeleteJob::run() {
+    if (mode == Trash) {
+        moveToTrash();
+    } else {
+        if (mode == EmptyTrash)
+            paths = CTrash::empty();
+        removePermanently();
+    }
+}
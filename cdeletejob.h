@@ -0,0 +1,38 @@
+#ifndef CDELETEJOB_H
+#define CDELETEJOB_H
+
+#include "cfilejob.h"
+
+class CDeleteJob : public CFileJob {
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Trash,
+        Permanent,
+        // Stages the contents of every trash with CTrash::empty() and then
+        // deletes them, on the job's thread since finding the trashes means
+        // visiting every mount point.
+        EmptyTrash
+    };
+
+    explicit CDeleteJob(const QStringList &paths, Mode mode = Permanent, QObject *parent = nullptr);
+    ~CDeleteJob() override;
+
+    void setDescription(const QString &text);
+    QString description() const override;
+
+protected:
+    void run() override;
+
+private:
+    void measure();
+    void moveToTrash();
+    void removePermanently();
+
+    QStringList paths;
+    Mode mode;
+    QString title;
+};
+
+#endif // CDELETEJOB_H
@@ -0,0 +1,1465 @@
+#include "cdirlistingmodel.h"
+#include "cdirwalker.h"
+
+#include <QBrush>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QMimeDatabase>
+#include <QThread>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// A small first read gets the first screen up quickly; later reads are large.
+constexpr size_t kFirstReadSize = 32 * 1024;
+constexpr size_t kReadSize = 1024 * 1024;
+constexpr int kBatchEntries = 16384;
+constexpr int kStatChunk = 4096;
+// Larger change batches are applied by listing the folder again.
+constexpr int kMaxIncrementalChanges = 2000;
+// Below this, splitting a sort across threads costs more than it saves.
+constexpr int kMinSortChunk = 16384;
+constexpr int kResortDelayMs = 100;
+constexpr int kListingCacheBytes = 64 * 1024 * 1024;
+// Rough heap size of one collation key.
+constexpr int kNameKeyBytes = 64;
+constexpr int kMinFilterChunk = 65536;
+
+#ifdef Q_OS_LINUX
+CDirWalker::EntryType typeFromMode(mode_t mode) {
+    if (S_ISREG(mode)) return CDirWalker::File;
+    if (S_ISDIR(mode)) return CDirWalker::Directory;
+    if (S_ISLNK(mode)) return CDirWalker::SymLink;
+    return CDirWalker::Other;
+}
+
+// Symbolic links are listed as what they point to, as QFileSystemModel does.
+CDirWalker::EntryType entryType(int dirFd, const char *name, unsigned char direntType) {
+    switch (direntType) {
+    case DT_REG: return CDirWalker::File;
+    case DT_DIR: return CDirWalker::Directory;
+    case DT_LNK:
+    case DT_UNKNOWN: {
+        struct stat st;
+        if (::fstatat(dirFd, name, &st, 0) == 0) return typeFromMode(st.st_mode);
+        return CDirWalker::SymLink;
+    }
+    default: return CDirWalker::Other;
+    }
+}
+
+bool statEntry(int dirFd, const char *name, bool wantSize, bool wantTime, qint64 &size, qint64 &modifiedMs) {
+#ifdef STATX_SIZE
+    unsigned int mask = 0;
+    if (wantSize) mask |= STATX_SIZE;
+    if (wantTime) mask |= STATX_MTIME;
+
+    struct statx stx;
+    if (::statx(dirFd, name, AT_STATX_DONT_SYNC, mask, &stx) != 0) return false;
+    if (stx.stx_mask & STATX_SIZE) size = qint64(stx.stx_size);
+    if (stx.stx_mask & STATX_MTIME)
+        modifiedMs = qint64(stx.stx_mtime.tv_sec) * 1000 + stx.stx_mtime.tv_nsec / 1000000;
+    return true;
+#else
+    Q_UNUSED(wantSize);
+    Q_UNUSED(wantTime);
+    struct stat st;
+    if (::fstatat(dirFd, name, &st, 0) != 0) return false;
+    size = st.st_size;
+    modifiedMs = qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+    return true;
+#endif
+}
+#endif
+
+// The type of a file that appeared after the folder was listed, or false if
+// it is already gone again.
+bool entryTypeOf(const QByteArray &filePath, quint8 &type) {
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (::stat(filePath.constData(), &st) == 0) {
+        type = typeFromMode(st.st_mode);
+        return true;
+    }
+    if (::lstat(filePath.constData(), &st) == 0) {
+        type = CDirWalker::SymLink;
+        return true;
+    }
+    return false;
+#else
+    const QFileInfo info(QFile::decodeName(filePath));
+    if (!info.exists() && !info.isSymLink()) return false;
+    type = info.isDir() ? CDirWalker::Directory : info.isFile() ? CDirWalker::File : CDirWalker::Other;
+    return true;
+#endif
+}
+
+inline char foldAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c;
+}
+
+bool equalsFolded(const char *text, const char *needle, int length) {
+    for (int i = 0; i < length; ++i) {
+        if (foldAscii(text[i]) != needle[i]) return false;
+    }
+    return true;
+}
+
+// The first position at or after `from` where `needle` occurs in `data`,
+// ignoring ASCII case, or -1. `needle` is lower case and not empty.
+int findFolded(const char *data, int length, const QByteArray &needle, int from) {
+    const int needleLength = int(needle.size());
+    const char *pattern = needle.constData();
+    const int last = length - needleLength;
+    int i = from;
+#ifdef __SSE2__
+    // Checks 16 starting positions at once by their first and last byte, and
+    // compares the whole needle only where both agree.
+    const __m128i head = _mm_set1_epi8(pattern[0]);
+    const __m128i tail = _mm_set1_epi8(pattern[needleLength - 1]);
+    const __m128i belowUpper = _mm_set1_epi8('A' - 1);
+    const __m128i aboveUpper = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    auto load = [&](const char *at) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(at));
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, belowUpper), _mm_cmplt_epi8(bytes, aboveUpper));
+        return _mm_or_si128(bytes, _mm_and_si128(upper, caseBit));
+    };
+    for (; i + 15 <= last; i += 16) {
+        const __m128i first = _mm_cmpeq_epi8(load(data + i), head);
+        const __m128i final = _mm_cmpeq_epi8(load(data + i + needleLength - 1), tail);
+        uint mask = uint(_mm_movemask_epi8(_mm_and_si128(first, final)));
+        while (mask) {
+            const int at = i + qCountTrailingZeroBits(mask);
+            if (equalsFolded(data + at, pattern, needleLength)) return at;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        if (foldAscii(data[i]) == pattern[0] && equalsFolded(data + i, pattern, needleLength)) return i;
+    }
+    return -1;
+}
+
+QCollator nameCollator() {
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    return collator;
+}
+
+// Sorts chunks on the pool, then merges neighbouring runs level by level.
+template <typename Less>
+void parallelSort(QVector<int> &items, Less less, QThreadPool &pool) {
+    const int count = int(items.size());
+    const int chunks = qBound(1, count / kMinSortChunk, pool.maxThreadCount());
+    int *data = items.data();
+    if (chunks == 1) {
+        std::sort(data, data + count, less);
+        return;
+    }
+
+    QVector<int> bounds;
+    for (int c = 0; c <= chunks; ++c)
+        bounds.append(int(qint64(count) * c / chunks));
+
+    for (int c = 0; c < chunks; ++c) {
+        const int first = bounds[c];
+        const int last = bounds[c + 1];
+        pool.start([data, first, last, less] { std::sort(data + first, data + last, less); });
+    }
+    pool.waitForDone();
+
+    for (int width = 1; width < chunks; width *= 2) {
+        for (int c = 0; c + width < chunks; c += 2 * width) {
+            const int first = bounds[c];
+            const int middle = bounds[c + width];
+            const int last = bounds[qMin(c + 2 * width, chunks)];
+            pool.start([data, first, middle, last, less] {
+                std::inplace_merge(data + first, data + middle, data + last, less);
+            });
+        }
+        pool.waitForDone();
+    }
+}
+}
+
+CDirListingModel::CDirListingModel(QObject *parent)
+    : QAbstractTableModel(parent) {
+    loadPool.setMaxThreadCount(1);
+    statPool.setMaxThreadCount(2);
+    sortPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    prefetchPool.setMaxThreadCount(1);
+    listingCache.setMaxCost(kListingCacheBytes);
+
+    statTimer = new QTimer(this);
+    statTimer->setSingleShot(true);
+    statTimer->setInterval(0);
+    connect(statTimer, &QTimer::timeout, this, &CDirListingModel::flushStatRequests);
+
+    // Metadata arrives in many small results; the order is redone once they settle.
+    sortTimer = new QTimer(this);
+    sortTimer->setSingleShot(true);
+    sortTimer->setInterval(kResortDelayMs);
+    connect(sortTimer, &QTimer::timeout, this, &CDirListingModel::applySort);
+}
+
+CDirListingModel::~CDirListingModel() {
+    if (changeWatcher && !path.isEmpty())
+        changeWatcher->unwatch(path);
+    if (loadCancelled) *loadCancelled = true;
+    shuttingDown = true;
+    loadPool.clear();
+    statPool.clear();
+    prefetchPool.clear();
+    loadPool.waitForDone();
+    statPool.waitForDone();
+    prefetchPool.waitForDone();
+}
+
+int CDirListingModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : int(rowOrder.size());
+}
+
+int CDirListingModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant CDirListingModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case NameColumn: return QString("Name");
+    case SizeColumn: return QString("Size");
+    case TypeColumn: return QString("Type");
+    case DateColumn: return QString("Date Modified");
+    }
+    return QVariant();
+}
+
+QVariant CDirListingModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= rowOrder.size())
+        return QVariant();
+
+    const int n = nodeAt(index.row());
+    const Node &node = nodes[n];
+    const bool dir = node.type == CDirWalker::Directory;
+
+    if (role == Qt::ForegroundRole)
+        return node.flags & Cut ? QVariant(QBrush(Qt::gray)) : QVariant();
+
+    if (role == Qt::TextAlignmentRole && index.column() == SizeColumn)
+        return int(Qt::AlignTrailing | Qt::AlignVCenter);
+
+    if (role == Qt::DecorationRole && index.column() == NameColumn) {
+        if (path.isEmpty()) return iconProvider.icon(QFileIconProvider::Drive);
+
+        const TypeInfo &info = typeInfo(n);
+        if (info.hasThumbnail && iconService) {
+            if (!(node.flags & HasTime)) {
+                requestStat(n, TimeRequested);
+            } else if (node.modifiedMs >= 0) {
+                const QString filePath = nodePath(n);
+                const QIcon thumbnail = iconService->thumbnail(filePath, QDateTime::fromMSecsSinceEpoch(node.modifiedMs));
+                if (!thumbnail.isNull()) return thumbnail;
+                waitingNodes.insert(filePath, n);
+            }
+        }
+        return info.icon;
+    }
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (index.column()) {
+    case NameColumn:
+        return QFile::decodeName(nameBytes(n));
+    case SizeColumn: {
+        if (dir) {
+            const qint64 bytes = folderSize(index);
+            return bytes >= 0 ? QLocale::system().formattedDataSize(bytes) : QString();
+        }
+        if (!(node.flags & HasSize)) {
+            requestStat(n, SizeRequested);
+            return QString();
+        }
+        return node.size >= 0 ? QLocale::system().formattedDataSize(node.size) : QString();
+    }
+    case TypeColumn:
+        return path.isEmpty() ? QString("Drive") : typeInfo(n).name;
+    case DateColumn:
+        if (!(node.flags & HasTime)) {
+            requestStat(n, TimeRequested);
+            return QString();
+        }
+        return node.modifiedMs >= 0 ? QDateTime::fromMSecsSinceEpoch(node.modifiedMs).toString("yyyy-MM-dd hh:mm")
+                                    : QString();
+    }
+    return QVariant();
+}
+
+void CDirListingModel::sort(int column, Qt::SortOrder order) {
+    sortColumn = column >= 0 && column < ColumnCount ? column : -1;
+    sortOrder = order;
+    sortTimer->stop();
+
+    fetchMetadata(sortColumn);
+    applySort();
+}
+
+void CDirListingModel::applySort() {
+    if (rowOrder.isEmpty()) return;
+
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    const QModelIndexList from = persistentIndexList();
+    QVector<int> fromNodes;
+    fromNodes.reserve(from.size());
+    for (const QModelIndex &index : from)
+        fromNodes.append(nodeAt(index.row()));
+
+    QVector<int> order = fullOrder();
+    if (!filterText.isEmpty()) {
+        // The filter has not changed, so the same entries stay shown.
+        order.erase(std::remove_if(order.begin(), order.end(), [this](int n) { return rowOfNode[n] < 0; }),
+                    order.end());
+    }
+    rowOrder = order;
+    rebuildRowOfNode();
+
+    QModelIndexList to;
+    to.reserve(from.size());
+    for (int i = 0; i < from.size(); ++i)
+        to.append(index(rowOfNode[fromNodes[i]], from[i].column()));
+    changePersistentIndexList(from, to);
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+QVector<int> CDirListingModel::fullOrder() {
+    QVector<int> order;
+    if (sortColumn < 0) {
+        order.resize(nodes.size());
+        std::iota(order.begin(), order.end(), 0);
+    } else if (sortOrder == Qt::AscendingOrder) {
+        order = sortedNodes(sortColumn);
+    } else {
+        const QVector<int> &ascending = sortedNodes(sortColumn);
+        order.resize(ascending.size());
+        std::reverse_copy(ascending.cbegin(), ascending.cend(), order.begin());
+    }
+    return order;
+}
+
+const QVector<int> &CDirListingModel::sortedNodes(int column) {
+    // Entries are only ever appended between resets, so a cached order that is
+    // short is brought up to date by merging in the new entries.
+    QVector<int> &sorted = sortCache[column];
+    const int known = int(sorted.size());
+    if (known == nodes.size()) return sorted;
+
+    ensureNameKeys();
+
+    QVector<qint64> values;
+    if (column == TypeColumn) {
+        // Type names are ranked once, so entries compare by an integer.
+        QHash<QString, qint64> ranks;
+        for (int n = 0; n < nodes.size(); ++n)
+            ranks.insert(typeInfo(n).name, 0);
+
+        QStringList typeNames = ranks.keys();
+        const QCollator collator = nameCollator();
+        std::sort(typeNames.begin(), typeNames.end(), [&collator](const QString &a, const QString &b) {
+            return collator.compare(a, b) < 0;
+        });
+        for (int i = 0; i < typeNames.size(); ++i)
+            ranks[typeNames.at(i)] = i;
+
+        values.resize(nodes.size());
+        for (int n = 0; n < nodes.size(); ++n)
+            values[n] = ranks.value(typeInfo(n).name);
+    } else if (column == SizeColumn) {
+        values.resize(nodes.size());
+        for (int n = 0; n < nodes.size(); ++n) {
+            const Node &node = nodes[n];
+            if (node.type == CDirWalker::Directory)
+                values[n] = folderSizeProvider && !path.isEmpty() ? folderSizeProvider->size(nodePath(n)).bytes : -1;
+            else
+                values[n] = node.flags & HasSize ? node.size : -1;
+        }
+    } else if (column == DateColumn) {
+        values.resize(nodes.size());
+        for (int n = 0; n < nodes.size(); ++n)
+            values[n] = nodes[n].flags & HasTime ? nodes[n].modifiedMs : -1;
+    }
+
+    const Node *entries = nodes.constData();
+    const QCollatorSortKey *keys = nameKeys.data();
+    const qint64 *sortValues = values.isEmpty() ? nullptr : values.constData();
+    auto less = [entries, keys, sortValues](int a, int b) {
+        const bool aIsDir = entries[a].type == CDirWalker::Directory;
+        const bool bIsDir = entries[b].type == CDirWalker::Directory;
+        if (aIsDir != bIsDir) return aIsDir;
+        if (sortValues && sortValues[a] != sortValues[b]) return sortValues[a] < sortValues[b];
+
+        const int cmp = keys[a].compare(keys[b]);
+        if (cmp != 0) return cmp < 0;
+        return a < b;
+    };
+
+    QVector<int> added(nodes.size() - known);
+    std::iota(added.begin(), added.end(), known);
+    parallelSort(added, less, sortPool);
+
+    if (known == 0) {
+        sorted = added;
+    } else {
+        QVector<int> merged(nodes.size());
+        std::merge(sorted.cbegin(), sorted.cend(), added.cbegin(), added.cend(), merged.begin(), less);
+        sorted = merged;
+    }
+    return sorted;
+}
+
+void CDirListingModel::ensureNameKeys() {
+    const int known = int(nameKeys.size());
+    const int count = int(nodes.size()) - known;
+    if (count <= 0) return;
+
+    const int chunks = qBound(1, count / kMinSortChunk, sortPool.maxThreadCount());
+    std::vector<std::vector<QCollatorSortKey>> parts(chunks);
+    for (int c = 0; c < chunks; ++c) {
+        const int first = known + int(qint64(count) * c / chunks);
+        const int last = known + int(qint64(count) * (c + 1) / chunks);
+        std::vector<QCollatorSortKey> *part = &parts[c];
+        sortPool.start([this, part, first, last] {
+            // Each thread gets its own collator.
+            const QCollator collator = nameCollator();
+            part->reserve(last - first);
+            for (int n = first; n < last; ++n)
+                part->push_back(collator.sortKey(QFile::decodeName(nameBytes(n))));
+        });
+    }
+    sortPool.waitForDone();
+
+    nameKeys.reserve(nodes.size());
+    for (std::vector<QCollatorSortKey> &part : parts) {
+        for (QCollatorSortKey &key : part)
+            nameKeys.push_back(std::move(key));
+    }
+}
+
+void CDirListingModel::invalidateSort(int column) {
+    sortCache.remove(column);
+    if (column == sortColumn)
+        sortTimer->start();
+}
+
+void CDirListingModel::rebuildRowOfNode() {
+    // Entries hidden by the filter have no row.
+    rowOfNode.fill(-1, nodes.size());
+    for (int row = 0; row < rowOrder.size(); ++row)
+        rowOfNode[rowOrder[row]] = row;
+}
+
+void CDirListingModel::setDirectory(const QString &newPath) {
+    if (loadCancelled) *loadCancelled = true;
+    ++generation;
+    if (changeWatcher && !path.isEmpty())
+        changeWatcher->unwatch(path);
+    stashListing();
+
+    const QString cleanPath = newPath.isEmpty() ? QString() : QDir::cleanPath(newPath);
+    const std::unique_ptr<CachedListing> cached(cleanPath.isEmpty() ? nullptr : takeCachedListing(cleanPath));
+
+    beginResetModel();
+    path = cleanPath;
+    encodedPath = QFile::encodeName(path);
+    names = QByteArray();
+    nodes = QVector<Node>();
+    rowOrder = QVector<int>();
+    rowOfNode = QVector<int>();
+    std::vector<QCollatorSortKey>().swap(nameKeys);
+    sortCache.clear();
+    sortTimer->stop();
+    nodesByName.clear();
+    statQueue.clear();
+    waitingNodes.clear();
+    loading = false;
+    reloadQueued = false;
+    topName.clear();
+    filterText.clear();
+    foldedFilter.clear();
+    updateCutNames();
+
+    if (cached) {
+        names = std::move(cached->names);
+        nodes = std::move(cached->nodes);
+        nameKeys = std::move(cached->nameKeys);
+        topName = cached->topName;
+
+        rowOrder.resize(nodes.size());
+        std::iota(rowOrder.begin(), rowOrder.end(), 0);
+        rowOfNode = rowOrder;
+        if (!cutNames.isEmpty()) {
+            for (int n = 0; n < nodes.size(); ++n) {
+                if (cutNames.contains(nameBytes(n)))
+                    nodes[n].flags |= Cut;
+            }
+        }
+    }
+    endResetModel();
+
+    if (folderSizeProvider)
+        folderSizeProvider->cancelPending();
+
+    if (path.isEmpty()) {
+        Batch drives;
+        const QFileInfoList infos = QDir::drives();
+        for (const QFileInfo &info : infos) {
+            const QByteArray name = QFile::encodeName(info.absoluteFilePath());
+            Node node;
+            node.nameOffset = quint32(drives.names.size());
+            node.nameLength = quint16(name.size());
+            node.type = CDirWalker::Directory;
+            node.flags = HasSize | HasTime;
+            drives.names.append(name);
+            drives.nodes.append(node);
+        }
+        appendNodes(drives);
+        emit directoryLoaded(path);
+        return;
+    }
+
+    if (changeWatcher)
+        changeWatcher->watch(path);
+
+    if (cached) {
+        if (sortColumn >= 0) {
+            fetchMetadata(sortColumn);
+            applySort();
+        }
+        emit directoryLoaded(path);
+        return;
+    }
+    startLoad(true);
+}
+
+void CDirListingModel::stashListing() {
+    if (path.isEmpty() || loading || nodes.isEmpty()) return;
+
+    CDirWalker::Stat st;
+    if (!CDirWalker::stat(encodedPath, st)) return;
+
+    // Metadata is left behind: files can change without their folder changing.
+    auto *entry = new CachedListing;
+    entry->modifiedMs = st.modifiedMs;
+    entry->names = names;
+    entry->nodes = nodes;
+    for (Node &node : entry->nodes) {
+        node.flags = 0;
+        node.size = -1;
+        node.modifiedMs = -1;
+    }
+    entry->nameKeys = std::move(nameKeys);
+    entry->topName = topName;
+
+    const qsizetype cost = entry->names.size() + entry->nodes.size() * qsizetype(sizeof(Node))
+                           + qsizetype(entry->nameKeys.size()) * kNameKeyBytes;
+    listingCache.insert(path, entry, cost);
+}
+
+CDirListingModel::CachedListing *CDirListingModel::takeCachedListing(const QString &dirPath) {
+    CachedListing *entry = listingCache.take(dirPath);
+    if (!entry) return nullptr;
+
+    CDirWalker::Stat st;
+    if (!CDirWalker::stat(QFile::encodeName(dirPath), st) || st.modifiedMs != entry->modifiedMs) {
+        delete entry;
+        return nullptr;
+    }
+    return entry;
+}
+
+void CDirListingModel::prefetch(const QStringList &paths) {
+    for (const QString &candidate : paths) {
+        if (candidate.isEmpty()) continue;
+
+        const QString dirPath = QDir::cleanPath(candidate);
+        if (dirPath == path || prefetching.contains(dirPath)) continue;
+
+        const CachedListing *entry = listingCache.object(dirPath);
+        const qint64 cachedMs = entry ? entry->modifiedMs : -1;
+        prefetching.insert(dirPath);
+
+        prefetchPool.start([this, dirPath, cachedMs] {
+            const QByteArray encodedDirPath = QFile::encodeName(dirPath);
+            CDirWalker::Stat st;
+            const bool listable = CDirWalker::stat(encodedDirPath, st) && st.type == CDirWalker::Directory
+                                  && st.modifiedMs != cachedMs;
+
+            Batch listing;
+            if (listable) {
+                readDirectory(encodedDirPath, shuttingDown, [&listing](Batch &batch) {
+                    const quint32 base = quint32(listing.names.size());
+                    listing.names.append(batch.names);
+                    for (Node node : std::as_const(batch.nodes)) {
+                        node.nameOffset += base;
+                        listing.nodes.append(node);
+                    }
+                });
+            }
+            if (shuttingDown) return;
+
+            QMetaObject::invokeMethod(this, [this, dirPath, listable, st, listing] {
+                prefetching.remove(dirPath);
+                if (listable)
+                    storePrefetched(dirPath, st.modifiedMs, listing);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void CDirListingModel::storePrefetched(const QString &dirPath, qint64 modifiedMs, const Batch &listing) {
+    if (dirPath == path || listing.nodes.isEmpty()) return;
+
+    auto *entry = new CachedListing;
+    entry->modifiedMs = modifiedMs;
+    entry->names = listing.names;
+    entry->nodes = listing.nodes;
+    for (Node &node : entry->nodes) {
+        node.flags = 0;
+        node.size = -1;
+        node.modifiedMs = -1;
+    }
+
+    const qsizetype cost = entry->names.size() + entry->nodes.size() * qsizetype(sizeof(Node));
+    listingCache.insert(dirPath, entry, cost);
+}
+
+void CDirListingModel::setTopRow(int row) {
+    if (row < 0 || row >= rowOrder.size()) {
+        topName.clear();
+        return;
+    }
+    topName = QByteArray(nameBytes(nodeAt(row)));
+}
+
+QModelIndex CDirListingModel::topIndex() const {
+    if (topName.isEmpty()) return QModelIndex();
+
+    const int n = nodeForName(topName);
+    return n >= 0 ? index(rowOfNode[n], NameColumn) : QModelIndex();
+}
+
+void CDirListingModel::setFilter(const QString &text) {
+    if (text == filterText) return;
+
+    // A query that contains the previous one can only match entries that the
+    // previous one matched, so only the rows shown now are looked at.
+    const bool narrowing = !filterText.isEmpty() && text.contains(filterText, Qt::CaseInsensitive);
+    filterText = text;
+    foldedFilter.clear();
+    bool ascii = true;
+    for (const QChar c : text)
+        ascii = ascii && c.unicode() < 0x80;
+    if (ascii)
+        foldedFilter = text.toLatin1().toLower();
+
+    QVector<int> shown;
+    if (filterText.isEmpty())
+        shown = fullOrder();
+    else if (narrowing)
+        shown = matchingNodes(rowOrder);
+    else
+        shown = matchingNodes(fullOrder());
+
+    beginResetModel();
+    rowOrder = shown;
+    rebuildRowOfNode();
+    endResetModel();
+}
+
+QString CDirListingModel::filter() const {
+    return filterText;
+}
+
+QVector<int> CDirListingModel::matchingNodes(const QVector<int> &candidates) {
+    if (filterText.isEmpty() || candidates.isEmpty()) return candidates;
+
+    // One byte per entry, so threads never write to the same word.
+    QVector<quint8> matched(nodes.size(), 0);
+    quint8 *flags = matched.data();
+    const int count = int(candidates.size());
+    const bool wholeListing = count == nodes.size();
+    const int chunks = qBound(1, count / kMinFilterChunk, sortPool.maxThreadCount());
+
+    for (int c = 0; c < chunks; ++c) {
+        const int first = int(qint64(count) * c / chunks);
+        const int last = int(qint64(count) * (c + 1) / chunks);
+        sortPool.start([this, &candidates, flags, wholeListing, first, last] {
+            if (foldedFilter.isEmpty()) {
+                for (int i = first; i < last; ++i) {
+                    const int n = candidates[i];
+                    flags[n] = QFile::decodeName(nameBytes(n)).contains(filterText, Qt::CaseInsensitive);
+                }
+                return;
+            }
+
+            if (!wholeListing) {
+                for (int i = first; i < last; ++i) {
+                    const int n = candidates[i];
+                    flags[n] = findFolded(names.constData() + nodes[n].nameOffset, nodes[n].nameLength,
+                                            foldedFilter, 0) >= 0;
+                }
+                return;
+            }
+
+            // Every entry is a candidate, so entries first..last are scanned
+            // as one run of the arena, where names lie in entry order. A hit
+            // counts only when it falls inside a single name.
+            const char *arena = names.constData();
+            const int end = int(nodes[last - 1].nameOffset + nodes[last - 1].nameLength);
+            const int needleLength = int(foldedFilter.size());
+            int n = first;
+            int at = findFolded(arena, end, foldedFilter, int(nodes[first].nameOffset));
+            while (at >= 0 && n < last) {
+                while (n < last && int(nodes[n].nameOffset + nodes[n].nameLength) < at + needleLength)
+                    ++n;
+                if (n == last) break;
+
+                int next = at + 1;
+                if (int(nodes[n].nameOffset) <= at) {
+                    flags[n] = 1;
+                    next = int(nodes[n].nameOffset + nodes[n].nameLength);
+                    ++n;
+                }
+                at = findFolded(arena, end, foldedFilter, next);
+            }
+        });
+    }
+    sortPool.waitForDone();
+
+    QVector<int> result;
+    result.reserve(count);
+    for (int n : candidates) {
+        if (matched[n]) result.append(n);
+    }
+    return result;
+}
+
+QString CDirListingModel::directory() const {
+    return path;
+}
+
+bool CDirListingModel::isLoading() const {
+    return loading;
+}
+
+void CDirListingModel::reload() {
+    if (path.isEmpty()) return;
+
+    if (loading) {
+        reloadQueued = true;
+        return;
+    }
+    startLoad(false);
+}
+
+void CDirListingModel::readDirectory(const QByteArray &dirPath, const std::atomic<bool> &cancelled,
+                                     const std::function<void(Batch &)> &publish) {
+    Batch batch;
+#ifdef Q_OS_LINUX
+    const int fd = ::open(dirPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    std::vector<char> buffer(kReadSize);
+    size_t readSize = kFirstReadSize;
+    while (!cancelled) {
+        const long bytes = ::syscall(SYS_getdents64, fd, buffer.data(), readSize);
+        if (bytes <= 0) break;
+        readSize = kReadSize;
+
+        for (long offset = 0; offset < bytes;) {
+            auto *dirent = reinterpret_cast<struct dirent64 *>(buffer.data() + offset);
+            offset += dirent->d_reclen;
+
+            // Hidden entries are left out, as in QFileSystemModel's default filter.
+            const char *name = dirent->d_name;
+            if (name[0] == '.') continue;
+
+            const size_t length = std::strlen(name);
+            Node node;
+            node.nameOffset = quint32(batch.names.size());
+            node.nameLength = quint16(length);
+            node.type = quint8(entryType(fd, name, dirent->d_type));
+            batch.names.append(name, int(length));
+            batch.nodes.append(node);
+        }
+
+        publish(batch);
+        batch = Batch();
+    }
+    ::close(fd);
+#else
+    QDirIterator it(QFile::decodeName(dirPath), QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System);
+    while (!cancelled && it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        const QByteArray name = QFile::encodeName(info.fileName());
+
+        Node node;
+        node.nameOffset = quint32(batch.names.size());
+        node.nameLength = quint16(name.size());
+        node.type = info.isDir() ? CDirWalker::Directory : info.isFile() ? CDirWalker::File : CDirWalker::Other;
+        node.flags = HasSize | HasTime;
+        node.size = info.isDir() ? -1 : info.size();
+        node.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+        batch.names.append(name);
+        batch.nodes.append(node);
+
+        if (batch.nodes.size() >= kBatchEntries) {
+            publish(batch);
+            batch = Batch();
+        }
+    }
+    publish(batch);
+#endif
+}
+
+void CDirListingModel::startLoad(bool progressive) {
+    if (loadCancelled) *loadCancelled = true;
+    loadCancelled = std::make_shared<std::atomic<bool>>(false);
+    loading = true;
+
+    const quint64 loadGeneration = generation;
+    const QByteArray dirPath = encodedPath;
+    const std::shared_ptr<std::atomic<bool>> cancelled = loadCancelled;
+
+    loadPool.start([this, loadGeneration, dirPath, cancelled, progressive] {
+        Batch listing;
+        readDirectory(dirPath, *cancelled, [&](Batch &batch) {
+            if (batch.nodes.isEmpty()) return;
+
+            if (progressive) {
+                QMetaObject::invokeMethod(this, [this, loadGeneration, batch] {
+                    appendBatch(loadGeneration, batch);
+                }, Qt::QueuedConnection);
+                return;
+            }
+
+            const quint32 base = quint32(listing.names.size());
+            listing.names.append(batch.names);
+            for (Node node : std::as_const(batch.nodes)) {
+                node.nameOffset += base;
+                listing.nodes.append(node);
+            }
+        });
+
+        if (*cancelled) return;
+
+        if (progressive) {
+            QMetaObject::invokeMethod(this, [this, loadGeneration] {
+                finishLoad(loadGeneration);
+            }, Qt::QueuedConnection);
+        } else {
+            QMetaObject::invokeMethod(this, [this, loadGeneration, listing] {
+                applyReload(loadGeneration, listing);
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+void CDirListingModel::appendBatch(quint64 loadGeneration, const Batch &batch) {
+    if (loadGeneration != generation) return;
+    appendNodes(batch);
+}
+
+void CDirListingModel::finishLoad(quint64 loadGeneration) {
+    if (loadGeneration != generation) return;
+
+    loading = false;
+    emit directoryLoaded(path);
+
+    if (reloadQueued) {
+        reloadQueued = false;
+        reload();
+    }
+}
+
+void CDirListingModel::appendNodes(const Batch &batch) {
+    if (batch.nodes.isEmpty()) return;
+
+    // Entries are added first and get rows below, once it is known which of
+    // them the filter shows.
+    const int first = int(nodes.size());
+    const quint32 base = quint32(names.size());
+    names.append(batch.names);
+    nodesByName.clear();
+    nodes.reserve(first + batch.nodes.size());
+    for (Node node : batch.nodes) {
+        node.nameOffset += base;
+        if (!cutNames.isEmpty()
+            && cutNames.contains(QByteArray::fromRawData(names.constData() + node.nameOffset, node.nameLength))) {
+            node.flags |= Cut;
+        }
+        nodes.append(node);
+    }
+    rowOfNode.insert(rowOfNode.size(), nodes.size() - first, -1);
+
+    QVector<int> added(nodes.size() - first);
+    std::iota(added.begin(), added.end(), first);
+    added = matchingNodes(added);
+
+    if (!added.isEmpty()) {
+        const int firstRow = int(rowOrder.size());
+        beginInsertRows(QModelIndex(), firstRow, firstRow + int(added.size()) - 1);
+        rowOrder.reserve(firstRow + added.size());
+        for (int n : std::as_const(added)) {
+            rowOfNode[n] = int(rowOrder.size());
+            rowOrder.append(n);
+        }
+        endInsertRows();
+    }
+
+    // New rows are placed by merging them into the current order.
+    if (sortColumn >= 0) {
+        fetchMetadata(sortColumn, first);
+        applySort();
+    }
+}
+
+void CDirListingModel::applyReload(quint64 loadGeneration, const Batch &listing) {
+    if (loadGeneration != generation) return;
+    loading = false;
+
+    QHash<QByteArray, int> oldNodes;
+    oldNodes.reserve(nodes.size());
+    for (int n = 0; n < nodes.size(); ++n)
+        oldNodes.insert(nameBytes(n), n);
+
+    QVector<bool> kept(nodes.size(), false);
+    Batch added;
+    for (const Node &node : listing.nodes) {
+        const QByteArray name = QByteArray::fromRawData(listing.names.constData() + node.nameOffset, node.nameLength);
+        auto it = oldNodes.constFind(name);
+        if (it != oldNodes.constEnd() && nodes[it.value()].type == node.type) {
+            kept[it.value()] = true;
+            continue;
+        }
+
+        Node fresh = node;
+        fresh.nameOffset = quint32(added.names.size());
+        added.names.append(name);
+        added.nodes.append(fresh);
+    }
+    oldNodes.clear();
+
+    removeNodes(kept);
+
+    // Files that stayed may have changed, so their metadata is fetched again.
+    for (Node &node : nodes)
+        node.flags &= Cut;
+    sortCache.remove(SizeColumn);
+    sortCache.remove(DateColumn);
+    if (!rowOrder.isEmpty())
+        emit dataChanged(index(0, NameColumn), index(int(rowOrder.size()) - 1, DateColumn));
+
+    if (sortColumn >= 0)
+        fetchMetadata(sortColumn);
+    appendNodes(added);
+
+    if (reloadQueued) {
+        reloadQueued = false;
+        reload();
+    }
+}
+
+void CDirListingModel::applyChanges(const QString &dirPath, const CChangeWatcher::Changes &changes) {
+    if (path.isEmpty() || dirPath != path) return;
+
+    if (loading) {
+        reloadQueued = true;
+        return;
+    }
+    if (changes.overflow || changes.added.size() + changes.removed.size() > kMaxIncrementalChanges) {
+        reload();
+        return;
+    }
+
+    QVector<bool> kept(nodes.size(), true);
+    bool anyRemoved = false;
+    for (const QString &name : changes.removed) {
+        const int n = nodeForName(QFile::encodeName(name));
+        if (n < 0) continue;
+        kept[n] = false;
+        anyRemoved = true;
+    }
+    if (anyRemoved) {
+        removeNodes(kept);
+        // Rows whose metadata requests were dropped ask again when painted.
+        if (!rowOrder.isEmpty())
+            emit dataChanged(index(0, NameColumn), index(int(rowOrder.size()) - 1, DateColumn));
+    }
+
+    QVector<int> changed;
+    for (const QString &name : changes.modified) {
+        const int n = nodeForName(QFile::encodeName(name));
+        if (n < 0) continue;
+        nodes[n].flags &= Cut;
+        changed.append(n);
+    }
+
+    Batch added;
+    for (const QString &name : changes.added) {
+        const QByteArray encodedName = QFile::encodeName(name);
+        if (encodedName.startsWith('.')) continue;
+
+        quint8 type;
+        if (!entryTypeOf(encodedPath + '/' + encodedName, type)) continue;
+
+        const int n = nodeForName(encodedName);
+        if (n >= 0) {
+            // Replaced by something of another kind; rare enough to list again.
+            if (nodes[n].type != type) {
+                reload();
+                return;
+            }
+            nodes[n].flags &= Cut;
+            changed.append(n);
+            continue;
+        }
+
+        Node node;
+        node.nameOffset = quint32(added.names.size());
+        node.nameLength = quint16(encodedName.size());
+        node.type = type;
+        added.names.append(encodedName);
+        added.nodes.append(node);
+    }
+
+    emitRowRanges(changed, NameColumn, DateColumn);
+    if (!changed.isEmpty()) {
+        invalidateSort(SizeColumn);
+        invalidateSort(DateColumn);
+        if (sortColumn >= 0)
+            fetchMetadata(sortColumn);
+    }
+    appendNodes(added);
+}
+
+void CDirListingModel::removeNodes(const QVector<bool> &kept) {
+    // Outstanding metadata requests refer to the old entry numbers.
+    ++generation;
+    statQueue.clear();
+    waitingNodes.clear();
+    nodesByName.clear();
+
+    for (int row = int(rowOrder.size()) - 1; row >= 0;) {
+        if (kept[rowOrder[row]]) {
+            --row;
+            continue;
+        }
+
+        int first = row;
+        while (first > 0 && !kept[rowOrder[first - 1]])
+            --first;
+
+        beginRemoveRows(QModelIndex(), first, row);
+        rowOrder.remove(first, row - first + 1);
+        endRemoveRows();
+        row = first - 1;
+    }
+
+    // Entries are compacted and renumbered; the shown order stays as it is.
+    QVector<int> renumbered(nodes.size(), -1);
+    std::vector<QCollatorSortKey> keptKeys;
+    int live = 0;
+    for (int n = 0; n < nodes.size(); ++n) {
+        if (!kept[n]) continue;
+
+        renumbered[n] = live;
+        nodes[live] = nodes[n];
+        if (n < int(nameKeys.size()))
+            keptKeys.push_back(std::move(nameKeys[n]));
+        ++live;
+    }
+    nodes.resize(live);
+    nameKeys.swap(keptKeys);
+
+    auto renumber = [&renumbered](QVector<int> &order) {
+        int out = 0;
+        for (int i = 0; i < order.size(); ++i) {
+            const int n = renumbered[order.at(i)];
+            if (n >= 0) order[out++] = n;
+        }
+        order.resize(out);
+    };
+    renumber(rowOrder);
+    for (auto it = sortCache.begin(); it != sortCache.end(); ++it)
+        renumber(it.value());
+    rebuildRowOfNode();
+
+    qint64 liveBytes = 0;
+    for (const Node &node : std::as_const(nodes))
+        liveBytes += node.nameLength;
+    if (names.size() > 2 * liveBytes + 4096) {
+        QByteArray compacted;
+        compacted.reserve(liveBytes);
+        for (Node &node : nodes) {
+            const quint32 offset = quint32(compacted.size());
+            compacted.append(names.constData() + node.nameOffset, node.nameLength);
+            node.nameOffset = offset;
+        }
+        names = compacted;
+    }
+
+    // Requests in flight were dropped with the old numbering.
+    for (Node &node : nodes)
+        node.flags &= ~(SizeRequested | TimeRequested);
+}
+
+void CDirListingModel::requestStat(int n, quint8 flags) const {
+    Node &node = nodes[n];
+    if (flags & SizeRequested && node.flags & (HasSize | SizeRequested))
+        flags &= ~SizeRequested;
+    if (flags & TimeRequested && node.flags & (HasTime | TimeRequested))
+        flags &= ~TimeRequested;
+    if (!flags) return;
+
+    if (!(node.flags & (SizeRequested | TimeRequested)))
+        statQueue.append(n);
+    node.flags |= flags;
+    if (!statTimer->isActive())
+        statTimer->start();
+}
+
+void CDirListingModel::flushStatRequests() {
+    if (statQueue.isEmpty()) return;
+
+    const QVector<int> queued = statQueue;
+    statQueue.clear();
+
+    for (int begin = 0; begin < queued.size(); begin += kStatChunk) {
+        const int end = qMin(begin + kStatChunk, int(queued.size()));
+
+        QVector<int> chunkNodes;
+        QVector<QByteArray> chunkNames;
+        QVector<quint8> wanted;
+        chunkNodes.reserve(end - begin);
+        chunkNames.reserve(end - begin);
+        wanted.reserve(end - begin);
+        for (int i = begin; i < end; ++i) {
+            const int n = queued[i];
+            chunkNodes.append(n);
+            chunkNames.append(QByteArray(names.constData() + nodes[n].nameOffset, nodes[n].nameLength));
+            wanted.append(nodes[n].flags & (SizeRequested | TimeRequested));
+        }
+
+        const quint64 statGeneration = generation;
+        const QByteArray dirPath = encodedPath;
+        statPool.start([this, statGeneration, dirPath, chunkNodes, chunkNames, wanted] {
+            QVector<StatResult> results;
+            results.reserve(chunkNodes.size());
+#ifdef Q_OS_LINUX
+            const int fd = ::open(dirPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+            for (int i = 0; i < chunkNodes.size(); ++i) {
+                // Failures are recorded as known too, so they are not retried on every paint.
+                StatResult result{chunkNodes[i], 0, -1, -1};
+                if (wanted[i] & SizeRequested) result.flags |= HasSize;
+                if (wanted[i] & TimeRequested) result.flags |= HasTime;
+#ifdef Q_OS_LINUX
+                if (fd >= 0) {
+                    statEntry(fd, chunkNames[i].constData(), wanted[i] & SizeRequested, wanted[i] & TimeRequested,
+                              result.size, result.modifiedMs);
+                }
+#else
+                const QFileInfo info(QFile::decodeName(dirPath + '/' + chunkNames[i]));
+                if (info.exists()) {
+                    result.size = info.size();
+                    result.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+                }
+#endif
+                results.append(result);
+            }
+#ifdef Q_OS_LINUX
+            if (fd >= 0) ::close(fd);
+#endif
+
+            QMetaObject::invokeMethod(this, [this, statGeneration, results] {
+                applyStats(statGeneration, results);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void CDirListingModel::applyStats(quint64 statGeneration, const QVector<StatResult> &results) {
+    if (statGeneration != generation) return;
+
+    QVector<int> changed;
+    changed.reserve(results.size());
+    quint8 fetched = 0;
+    for (const StatResult &result : results) {
+        if (result.node >= nodes.size()) continue;
+
+        Node &node = nodes[result.node];
+        if (result.flags & HasSize) node.size = result.size;
+        if (result.flags & HasTime) node.modifiedMs = result.modifiedMs;
+        node.flags |= result.flags;
+        node.flags &= ~(SizeRequested | TimeRequested);
+        fetched |= result.flags;
+        changed.append(result.node);
+    }
+
+    emitRowRanges(changed, NameColumn, DateColumn);
+
+    if (fetched & HasSize) invalidateSort(SizeColumn);
+    if (fetched & HasTime) invalidateSort(DateColumn);
+}
+
+void CDirListingModel::emitRowRanges(const QVector<int> &changedNodes, int firstColumn, int lastColumn) {
+    if (changedNodes.isEmpty()) return;
+
+    QVector<int> rows;
+    rows.reserve(changedNodes.size());
+    for (int n : changedNodes) {
+        if (rowOfNode[n] >= 0) rows.append(rowOfNode[n]);
+    }
+    std::sort(rows.begin(), rows.end());
+
+    int start = 0;
+    for (int i = 1; i <= rows.size(); ++i) {
+        if (i < rows.size() && rows.at(i) <= rows.at(i - 1) + 1) continue;
+
+        emit dataChanged(index(rows.at(start), firstColumn), index(rows.at(i - 1), lastColumn));
+        start = i;
+    }
+}
+
+void CDirListingModel::fetchMetadata(int column, int firstNode) {
+    if (column != SizeColumn && column != DateColumn) return;
+
+    for (int n = firstNode; n < nodes.size(); ++n) {
+        if (column == DateColumn)
+            requestStat(n, TimeRequested);
+        else if (nodes[n].type != CDirWalker::Directory)
+            requestStat(n, SizeRequested);
+    }
+}
+
+QString CDirListingModel::filePath(const QModelIndex &index) const {
+    if (!index.isValid() || index.row() >= rowOrder.size()) return QString();
+    return nodePath(nodeAt(index.row()));
+}
+
+QString CDirListingModel::fileName(const QModelIndex &index) const {
+    if (!index.isValid() || index.row() >= rowOrder.size()) return QString();
+    return QFile::decodeName(nameBytes(nodeAt(index.row())));
+}
+
+bool CDirListingModel::isDir(const QModelIndex &index) const {
+    if (!index.isValid() || index.row() >= rowOrder.size()) return false;
+    return nodes[nodeAt(index.row())].type == CDirWalker::Directory;
+}
+
+qint64 CDirListingModel::size(const QModelIndex &index) const {
+    if (!index.isValid() || index.row() >= rowOrder.size()) return -1;
+    const Node &node = nodes[nodeAt(index.row())];
+    return node.flags & HasSize ? node.size : -1;
+}
+
+qint64 CDirListingModel::lastModifiedMs(const QModelIndex &index) const {
+    if (!index.isValid() || index.row() >= rowOrder.size()) return -1;
+    const Node &node = nodes[nodeAt(index.row())];
+    return node.flags & HasTime ? node.modifiedMs : -1;
+}
+
+qint64 CDirListingModel::folderSize(const QModelIndex &index) const {
+    if (!folderSizeProvider || path.isEmpty() || !isDir(index)) return -1;
+
+    const int n = nodeAt(index.row());
+    const QString filePath = nodePath(n);
+    const CFolderSizeProvider::Size size = folderSizeProvider->size(filePath);
+    if (!size.isValid())
+        waitingNodes.insert(filePath, n);
+    return size.bytes;
+}
+
+void CDirListingModel::setChangeWatcher(CChangeWatcher *watcher) {
+    if (changeWatcher) {
+        disconnect(changeWatcher, nullptr, this, nullptr);
+        if (!path.isEmpty())
+            changeWatcher->unwatch(path);
+    }
+
+    changeWatcher = watcher;
+    if (changeWatcher) {
+        connect(changeWatcher, &CChangeWatcher::directoryChanged, this, &CDirListingModel::applyChanges);
+        if (!path.isEmpty())
+            changeWatcher->watch(path);
+    }
+}
+
+void CDirListingModel::setClipboardOperation(CClipboardOperation *operation) {
+    if (clipboardOperation)
+        disconnect(clipboardOperation, nullptr, this, nullptr);
+
+    clipboardOperation = operation;
+    if (clipboardOperation)
+        connect(clipboardOperation, &CClipboardOperation::pathsChanged, this, &CDirListingModel::refreshCutState);
+    updateCutNames();
+}
+
+void CDirListingModel::setFolderSizeProvider(CFolderSizeProvider *provider) {
+    if (folderSizeProvider)
+        disconnect(folderSizeProvider, nullptr, this, nullptr);
+
+    folderSizeProvider = provider;
+    if (folderSizeProvider)
+        connect(folderSizeProvider, &CFolderSizeProvider::sizeChanged, this, &CDirListingModel::refreshFolderSize);
+}
+
+void CDirListingModel::setIconService(CIconService *service) {
+    if (iconService)
+        disconnect(iconService, nullptr, this, nullptr);
+
+    iconService = service;
+    typeCache.clear();
+    if (iconService)
+        connect(iconService, &CIconService::thumbnailReady, this, &CDirListingModel::refreshRow);
+}
+
+void CDirListingModel::refreshRow(const QString &filePath) {
+    auto it = waitingNodes.find(filePath);
+    if (it == waitingNodes.end()) return;
+
+    const int n = it.value();
+    waitingNodes.erase(it);
+    if (n < nodes.size() && nodePath(n) == filePath) {
+        const int row = rowOfNode[n];
+        if (row >= 0)
+            emit dataChanged(index(row, NameColumn), index(row, DateColumn));
+    }
+}
+
+void CDirListingModel::refreshFolderSize(const QString &filePath) {
+    refreshRow(filePath);
+    if (!path.isEmpty() && QFileInfo(filePath).path() == path)
+        invalidateSort(SizeColumn);
+}
+
+void CDirListingModel::updateCutNames() {
+    cutNames.clear();
+    if (!clipboardOperation || !clipboardOperation->isCut() || path.isEmpty()) return;
+
+    const QString key = CClipboardOperation::normalize(path);
+    const QStringList cutPaths = clipboardOperation->paths();
+    for (const QString &cutPath : cutPaths) {
+        const QFileInfo info(cutPath);
+        if (CClipboardOperation::normalize(info.absolutePath()) == key)
+            cutNames.insert(QFile::encodeName(info.fileName()));
+    }
+}
+
+void CDirListingModel::refreshCutState(const QStringList &paths) {
+    updateCutNames();
+    if (path.isEmpty()) return;
+
+    const QString key = CClipboardOperation::normalize(path);
+    QVector<int> changed;
+    for (const QString &changedPath : paths) {
+        const QFileInfo info(changedPath);
+        if (CClipboardOperation::normalize(info.absolutePath()) != key) continue;
+
+        const QByteArray name = QFile::encodeName(info.fileName());
+        const int n = nodeForName(name);
+        if (n < 0) continue;
+
+        Node &node = nodes[n];
+        const bool isCut = cutNames.contains(name);
+        if (bool(node.flags & Cut) == isCut) continue;
+
+        node.flags ^= Cut;
+        changed.append(n);
+    }
+
+    emitRowRanges(changed, NameColumn, DateColumn);
+}
+
+int CDirListingModel::nodeAt(int row) const {
+    return rowOrder[row];
+}
+
+QByteArray CDirListingModel::nameBytes(int n) const {
+    const Node &node = nodes[n];
+    return QByteArray::fromRawData(names.constData() + node.nameOffset, node.nameLength);
+}
+
+QString CDirListingModel::nodePath(int n) const {
+    const QString name = QFile::decodeName(nameBytes(n));
+    if (path.isEmpty()) return name;
+    return path.endsWith('/') ? path + name : path + '/' + name;
+}
+
+int CDirListingModel::nodeForName(const QByteArray &name) const {
+    if (nodesByName.isEmpty() && !nodes.isEmpty()) {
+        nodesByName.reserve(nodes.size());
+        for (int n = 0; n < nodes.size(); ++n)
+            nodesByName.insert(nameBytes(n), n);
+    }
+    return nodesByName.value(name, -1);
+}
+
+const CDirListingModel::TypeInfo &CDirListingModel::typeInfo(int n) const {
+    const bool dir = nodes[n].type == CDirWalker::Directory;
+    const QByteArray name = nameBytes(n);
+
+    QByteArray key;
+    if (dir) {
+        key = "/";
+    } else {
+        const int dot = name.lastIndexOf('.');
+        key = dot > 0 ? name.mid(dot + 1).toLower() : QByteArray();
+    }
+
+    auto it = typeCache.find(key);
+    if (it != typeCache.end()) return it.value();
+
+    TypeInfo info;
+    if (dir) {
+        info.name = QString("Folder");
+        info.icon = iconProvider.icon(QFileIconProvider::Folder);
+    } else {
+        const QString fileName = QFile::decodeName(name);
+        QMimeDatabase mimeDatabase;
+        const QMimeType mime = mimeDatabase.mimeTypeForFile(fileName, QMimeDatabase::MatchExtension);
+        info.name = key.isEmpty() ? QString("File") : QString("%1 File").arg(QString::fromUtf8(key));
+        info.icon = QIcon::fromTheme(mime.iconName(),
+                                     QIcon::fromTheme(mime.genericIconName(),
+                                                      iconProvider.icon(QFileIconProvider::File)));
+        info.hasThumbnail = iconService && iconService->canThumbnail(fileName);
+    }
+    return typeCache.insert(key, info).value();
+}
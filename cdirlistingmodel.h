@@ -0,0 +1,234 @@
+#ifndef CDIRLISTINGMODEL_H
+#define CDIRLISTINGMODEL_H
+
+#include "cchangewatcher.h"
+#include "cclipboardoperation.h"
+#include "cfoldersizeprovider.h"
+#include "ciconservice.h"
+
+#include <QAbstractTableModel>
+#include <QCache>
+#include <QCollator>
+#include <QFileIconProvider>
+#include <QHash>
+#include <QIcon>
+#include <QPointer>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A flat listing of one folder for the content view. Names are read in
+// large getdents64 batches into a single arena and published as they come,
+// and metadata is fetched with statx only for the rows that are shown.
+// Rows are shown through a permutation of the entries, so sorting never
+// moves the entries themselves. Changes on disk come from CChangeWatcher and
+// are applied as row inserts and removals. Recently shown folders are kept
+// in memory and come back instantly while their modification time matches.
+// A name filter narrows the shown rows in place as it is typed.
+class CDirListingModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        NameColumn,
+        SizeColumn,
+        TypeColumn,
+        DateColumn,
+        ColumnCount
+    };
+
+    explicit CDirListingModel(QObject *parent = nullptr);
+    ~CDirListingModel() override;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    // Lists `path`. An empty path lists the drives.
+    void setDirectory(const QString &path);
+    QString directory() const;
+    bool isLoading() const;
+
+    // Lists `paths` in the background so that visiting them later is instant.
+    void prefetch(const QStringList &paths);
+    // The row at the top of the view, remembered with the cached listing.
+    void setTopRow(int row);
+    QModelIndex topIndex() const;
+
+    // Shows only the entries whose name contains `text`, ignoring case.
+    // Cleared when another folder is listed.
+    void setFilter(const QString &text);
+    QString filter() const;
+
+    QString filePath(const QModelIndex &index) const;
+    QString fileName(const QModelIndex &index) const;
+    bool isDir(const QModelIndex &index) const;
+    // -1 until the metadata of the row has been fetched.
+    qint64 size(const QModelIndex &index) const;
+    qint64 lastModifiedMs(const QModelIndex &index) const;
+    qint64 folderSize(const QModelIndex &index) const;
+
+    // Changes reported by `watcher` are applied as row inserts and removals.
+    void setChangeWatcher(CChangeWatcher *watcher);
+    void setClipboardOperation(CClipboardOperation *operation);
+    void setFolderSizeProvider(CFolderSizeProvider *provider);
+    void setIconService(CIconService *service);
+
+public slots:
+    void reload();
+
+signals:
+    void directoryLoaded(const QString &path);
+
+private slots:
+    void applyChanges(const QString &dirPath, const CChangeWatcher::Changes &changes);
+    void refreshCutState(const QStringList &paths);
+    void refreshRow(const QString &path);
+    void refreshFolderSize(const QString &path);
+    void flushStatRequests();
+    void applySort();
+
+private:
+    enum NodeFlag : quint8 {
+        HasSize = 0x01,
+        HasTime = 0x02,
+        SizeRequested = 0x04,
+        TimeRequested = 0x08,
+        Cut = 0x10
+    };
+
+    // Fixed-size record per entry; the name lives in the arena.
+    struct Node {
+        quint32 nameOffset = 0;
+        quint16 nameLength = 0;
+        quint8 type = 0;
+        quint8 flags = 0;
+        qint64 size = -1;
+        qint64 modifiedMs = -1;
+    };
+
+    struct Batch {
+        QByteArray names;
+        QVector<Node> nodes;
+    };
+
+    struct StatResult {
+        int node;
+        quint8 flags;
+        qint64 size;
+        qint64 modifiedMs;
+    };
+
+    struct CachedListing {
+        qint64 modifiedMs = -1;
+        QByteArray names;
+        QVector<Node> nodes;
+        std::vector<QCollatorSortKey> nameKeys;
+        QByteArray topName;
+    };
+
+    struct TypeInfo {
+        QString name;
+        QIcon icon;
+        bool hasThumbnail = false;
+    };
+
+    static void readDirectory(const QByteArray &dirPath, const std::atomic<bool> &cancelled,
+                              const std::function<void(Batch &)> &publish);
+
+    void startLoad(bool progressive);
+    void appendBatch(quint64 loadGeneration, const Batch &batch);
+    void finishLoad(quint64 loadGeneration);
+    void applyReload(quint64 loadGeneration, const Batch &listing);
+    void appendNodes(const Batch &batch);
+    void removeNodes(const QVector<bool> &kept);
+    void stashListing();
+    CachedListing *takeCachedListing(const QString &dirPath);
+    void storePrefetched(const QString &dirPath, qint64 modifiedMs, const Batch &listing);
+    void requestStat(int node, quint8 flags) const;
+    void applyStats(quint64 statGeneration, const QVector<StatResult> &results);
+    void emitRowRanges(const QVector<int> &changedNodes, int firstColumn, int lastColumn);
+    void updateCutNames();
+    // Requests what sorting by `column` needs for the entries from `firstNode` on.
+    void fetchMetadata(int column, int firstNode = 0);
+
+    void ensureNameKeys();
+    // Every entry, in the current sort order.
+    QVector<int> fullOrder();
+    const QVector<int> &sortedNodes(int column);
+    // The candidates the filter shows, in the same order.
+    QVector<int> matchingNodes(const QVector<int> &candidates);
+    void invalidateSort(int column);
+    void rebuildRowOfNode();
+
+    int nodeAt(int row) const;
+    QByteArray nameBytes(int node) const;
+    QString nodePath(int node) const;
+    int nodeForName(const QByteArray &name) const;
+    const TypeInfo &typeInfo(int node) const;
+
+    QString path;
+    QByteArray encodedPath;
+    QByteArray names;
+    // Mutable because metadata is filled in lazily as rows are shown.
+    mutable QVector<Node> nodes;
+    // Built on demand; keys point into the arena.
+    mutable QHash<QByteArray, int> nodesByName;
+
+    // Shown row to entry and back; -1 for entries hidden by the filter.
+    // Entries keep their load order, and so do their names in the arena.
+    QVector<int> rowOrder;
+    QVector<int> rowOfNode;
+    QString filterText;
+    // Lower case for matching the arena directly; empty if the filter is not ASCII.
+    QByteArray foldedFilter;
+    int sortColumn = -1;
+    Qt::SortOrder sortOrder = Qt::AscendingOrder;
+    // Collation keys, computed once per entry in load order.
+    std::vector<QCollatorSortKey> nameKeys;
+    // Ascending entry order per column, kept so that switching back to a
+    // column or reversing the order does not sort again.
+    QHash<int, QVector<int>> sortCache;
+    QThreadPool sortPool;
+    QTimer *sortTimer;
+
+    quint64 generation = 0;
+    bool loading = false;
+    bool reloadQueued = false;
+    std::shared_ptr<std::atomic<bool>> loadCancelled;
+    QThreadPool loadPool;
+    QThreadPool statPool;
+
+    mutable QVector<int> statQueue;
+    QTimer *statTimer;
+
+    QPointer<CChangeWatcher> changeWatcher;
+
+    // Costs are in bytes.
+    QCache<QString, CachedListing> listingCache;
+    QSet<QString> prefetching;
+    QThreadPool prefetchPool;
+    std::atomic<bool> shuttingDown{false};
+    QByteArray topName;
+
+    QPointer<CClipboardOperation> clipboardOperation;
+    QPointer<CFolderSizeProvider> folderSizeProvider;
+    QPointer<CIconService> iconService;
+    QSet<QByteArray> cutNames;
+    // Entries waiting for a folder size or thumbnail, by path.
+    mutable QHash<QString, int> waitingNodes;
+
+    QFileIconProvider iconProvider;
+    mutable QHash<QByteArray, TypeInfo> typeCache;
+};
+
+#endif // CDIRLISTINGMODEL_H
@@ -0,0 +1,348 @@
+#include "cdirwalker.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+
+namespace {
+constexpr size_t kDirentBufferSize = 64 * 1024;
+
+#ifdef Q_OS_LINUX
+CDirWalker::EntryType typeFromMode(mode_t mode) {
+    if (S_ISREG(mode)) return CDirWalker::File;
+    if (S_ISDIR(mode)) return CDirWalker::Directory;
+    if (S_ISLNK(mode)) return CDirWalker::SymLink;
+    return CDirWalker::Other;
+}
+
+CDirWalker::EntryType typeFromDirent(unsigned char type) {
+    switch (type) {
+    case DT_REG: return CDirWalker::File;
+    case DT_DIR: return CDirWalker::Directory;
+    case DT_LNK: return CDirWalker::SymLink;
+    case DT_UNKNOWN: return CDirWalker::Unknown;
+    default: return CDirWalker::Other;
+    }
+}
+
+void fillStat(const struct stat &st, CDirWalker::Stat &out) {
+    out.device = st.st_dev;
+    out.inode = st.st_ino;
+    out.size = st.st_size;
+    out.allocatedSize = qint64(st.st_blocks) * 512;
+    out.modifiedMs = qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+    out.mode = st.st_mode;
+    out.linkCount = st.st_nlink;
+    out.type = typeFromMode(st.st_mode);
+}
+#else
+CDirWalker::EntryType typeFromInfo(const QFileInfo &info) {
+    if (info.isSymLink()) return CDirWalker::SymLink;
+    if (info.isDir()) return CDirWalker::Directory;
+    if (info.isFile()) return CDirWalker::File;
+    return CDirWalker::Other;
+}
+
+bool fillStat(const QFileInfo &info, CDirWalker::Stat &out) {
+    if (!info.exists() && !info.isSymLink()) return false;
+    out.size = info.isDir() ? 0 : info.size();
+    out.allocatedSize = out.size;
+    out.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+    out.mode = quint32(info.permissions());
+    out.type = typeFromInfo(info);
+    return true;
+}
+#endif
+
+QByteArray childPath(const QByteArray &dirPath, const char *name) {
+    if (dirPath.endsWith('/')) return dirPath + name;
+    return dirPath + '/' + name;
+}
+}
+
+struct CDirWalker::Task {
+    std::shared_ptr<Dir> parent;
+    QByteArray name;
+    QByteArray path;
+    int depth = 0;
+    quint64 tag = 0;
+};
+
+struct CDirWalker::Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::vector<char> buffer;
+};
+
+struct CDirWalker::Run {
+    explicit Run(const Visitor &visitor) : visitor(visitor) {}
+
+    const Visitor &visitor;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<long> outstanding{0};
+    std::atomic<bool> rootFailed{false};
+    std::mutex idleMutex;
+    std::condition_variable idleCv;
+
+    void push(Worker &worker, Task task) {
+        ++outstanding;
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        idleCv.notify_one();
+    }
+};
+
+CDirWalker::Dir::~Dir() {
+#ifdef Q_OS_LINUX
+    if (fd >= 0) ::close(fd);
+#endif
+}
+
+QByteArray CDirWalker::Entry::filePath() const {
+    return childPath(dir.path, name);
+}
+
+QString CDirWalker::Entry::fileName() const {
+    return QFile::decodeName(name);
+}
+
+bool CDirWalker::Entry::stat(Stat &out) const {
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (dir.fd >= 0) {
+        if (::fstatat(dir.fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return false;
+    } else if (::lstat(filePath().constData(), &st) != 0) {
+        return false;
+    }
+    fillStat(st, out);
+    return true;
+#else
+    return CDirWalker::stat(filePath(), out);
+#endif
+}
+
+bool CDirWalker::stat(const QByteArray &path, Stat &out) {
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (::lstat(path.constData(), &st) != 0) return false;
+    fillStat(st, out);
+    return true;
+#else
+    return fillStat(QFileInfo(QFile::decodeName(path)), out);
+#endif
+}
+
+CDirWalker::CDirWalker(int threadCount)
+    : threadCount(threadCount > 0 ? threadCount : qMax(1, QThread::idealThreadCount())) {}
+
+CDirWalker::~CDirWalker() = default;
+
+void CDirWalker::cancel() {
+    cancelled = true;
+}
+
+bool CDirWalker::isCancelled() const {
+    return cancelled;
+}
+
+bool CDirWalker::walk(const QString &rootPath, const Visitor &visitor, quint64 rootTag) {
+    Run run(visitor);
+    for (int i = 0; i < threadCount; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->buffer.resize(kDirentBufferSize);
+        run.workers.push_back(std::move(worker));
+    }
+
+    Task root;
+    root.path = QFile::encodeName(QDir::cleanPath(rootPath));
+    root.tag = rootTag;
+    run.push(*run.workers.front(), std::move(root));
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (int i = 1; i < threadCount; ++i) {
+        threads.emplace_back([this, &run, i] { workerLoop(run, i); });
+    }
+    workerLoop(run, 0);
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    return !cancelled && !run.rootFailed;
+}
+
+void CDirWalker::workerLoop(Run &run, int self) {
+    const int count = int(run.workers.size());
+    Worker &own = *run.workers[self];
+
+    while (true) {
+        Task task;
+        bool found = false;
+
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                found = true;
+            }
+        }
+
+        for (int i = 1; !found && i < count; ++i) {
+            Worker &victim = *run.workers[(self + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                found = true;
+            }
+        }
+
+        if (found) {
+            if (cancelled) {
+                if (task.parent) release(run, task.parent);
+            } else {
+                processTask(run, own, task);
+            }
+
+            if (--run.outstanding == 0) {
+                run.idleCv.notify_all();
+            }
+            continue;
+        }
+
+        if (run.outstanding == 0) return;
+
+        std::unique_lock<std::mutex> lock(run.idleMutex);
+        run.idleCv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+}
+
+void CDirWalker::processTask(Run &run, Worker &worker, Task &task) {
+    auto dir = std::make_shared<Dir>();
+    dir->path = task.path;
+    dir->name = task.name;
+    dir->depth = task.depth;
+    dir->tag = task.tag;
+    dir->parent = task.parent;
+
+    auto visit = [&](const char *name, EntryType type, quint64 inode) {
+        Entry entry{*dir, name, type, inode};
+        bool descend = run.visitor.entry ? run.visitor.entry(entry) : true;
+
+        if (descend && type == Directory) {
+            Task child;
+            child.parent = dir;
+            child.name = name;
+            child.path = childPath(dir->path, name);
+            child.depth = dir->depth + 1;
+            child.tag = entry.childTag;
+            ++dir->pending;
+            run.push(worker, std::move(child));
+        }
+    };
+
+    auto fail = [&](int error) {
+        if (!task.parent) run.rootFailed = true;
+        if (run.visitor.error) run.visitor.error(task.path, error);
+        if (task.parent) release(run, task.parent);
+    };
+
+#ifdef Q_OS_LINUX
+    const int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    dir->fd = task.parent && task.parent->fd >= 0
+                  ? ::openat(task.parent->fd, task.name.constData(), flags | O_NOFOLLOW)
+                  : ::open(task.path.constData(), flags);
+    if (dir->fd < 0) {
+        fail(errno);
+        return;
+    }
+
+    char *buffer = worker.buffer.data();
+    while (!cancelled) {
+        long bytes = ::syscall(SYS_getdents64, dir->fd, buffer, worker.buffer.size());
+        if (bytes < 0) {
+            if (run.visitor.error) run.visitor.error(dir->path, errno);
+            break;
+        }
+        if (bytes == 0) break;
+
+        for (long offset = 0; offset < bytes && !cancelled;) {
+            auto *dirent = reinterpret_cast<struct dirent64 *>(buffer + offset);
+            offset += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            EntryType type = typeFromDirent(dirent->d_type);
+            if (type == Unknown) {
+                struct stat st;
+                if (::fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+                    type = typeFromMode(st.st_mode);
+            }
+
+            visit(name, type, dirent->d_ino);
+        }
+    }
+#else
+    QDir qdir(QFile::decodeName(task.path));
+    if (!qdir.exists()) {
+        fail(ENOENT);
+        return;
+    }
+
+    const QFileInfoList entries = qdir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot
+                                                     | QDir::Hidden | QDir::System);
+    for (const QFileInfo &info : entries) {
+        if (cancelled) break;
+        QByteArray name = QFile::encodeName(info.fileName());
+        visit(name.constData(), typeFromInfo(info), 0);
+    }
+#endif
+
+    if (!cancelled && run.visitor.directoryListed)
+        run.visitor.directoryListed(*dir);
+
+    release(run, dir);
+}
+
+void CDirWalker::release(Run &run, const std::shared_ptr<Dir> &dir) {
+    if (--dir->pending != 0) return;
+
+    if (!cancelled && run.visitor.leaveDirectory) {
+        run.visitor.leaveDirectory(*dir);
+    }
+
+#ifdef Q_OS_LINUX
+    if (dir->fd >= 0) {
+        ::close(dir->fd);
+        dir->fd = -1;
+    }
+#endif
+
+    if (dir->parent) {
+        release(run, dir->parent);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef CDIRWALKER_H
+#define CDIRWALKER_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class CDirWalker {
+public:
+    enum EntryType {
+        Unknown,
+        File,
+        Directory,
+        SymLink,
+        Other
+    };
+
+    struct Stat {
+        quint64 device = 0;
+        quint64 inode = 0;
+        qint64 size = 0;
+        qint64 allocatedSize = 0;
+        qint64 modifiedMs = 0;
+        quint32 mode = 0;
+        quint32 linkCount = 1;
+        EntryType type = Unknown;
+    };
+
+    struct Dir {
+        QByteArray path;
+        QByteArray name;
+        int fd = -1;
+        int depth = 0;
+        quint64 tag = 0;
+        std::shared_ptr<Dir> parent;
+
+        ~Dir();
+
+    private:
+        friend class CDirWalker;
+        std::atomic<int> pending{1};
+    };
+
+    struct Entry {
+        const Dir &dir;
+        const char *name;
+        EntryType type;
+        quint64 inode;
+        // Copied into Dir::tag when the walker descends into this entry.
+        mutable quint64 childTag = 0;
+
+        QByteArray filePath() const;
+        QString fileName() const;
+        bool stat(Stat &out) const;
+    };
+
+    // Callbacks run concurrently on the walker threads.
+    struct Visitor {
+        // Returns true to descend into a Directory entry.
+        std::function<bool(const Entry &)> entry;
+        // Called after the last entry of a directory, before its subdirectories finish.
+        std::function<void(const Dir &)> directoryListed;
+        // Called once every entry below the directory has been visited.
+        std::function<void(const Dir &)> leaveDirectory;
+        std::function<void(const QByteArray &path, int error)> error;
+    };
+
+    explicit CDirWalker(int threadCount = 0);
+    ~CDirWalker();
+
+    bool walk(const QString &rootPath, const Visitor &visitor, quint64 rootTag = 0);
+    void cancel();
+    bool isCancelled() const;
+
+    static bool stat(const QByteArray &path, Stat &out);
+
+private:
+    struct Task;
+    struct Worker;
+    struct Run;
+
+    void workerLoop(Run &run, int self);
+    void processTask(Run &run, Worker &worker, Task &task);
+    void release(Run &run, const std::shared_ptr<Dir> &dir);
+
+    int threadCount;
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // CDIRWALKER_H
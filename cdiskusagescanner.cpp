@@ -0,0 +1,276 @@
+#include "cdiskusagescanner.h"
+#include "cdirwalker.h"
+
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QSet>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace {
+// Entries below this are only kept as part of their folder's total once the
+// folder is finished.
+constexpr qint64 kCollapseBytes = 1024 * 1024;
+constexpr int kUpdateIntervalMs = 250;
+}
+
+struct CDiskUsageScanner::Node {
+    QByteArray name;
+    Node *parent = nullptr;
+    bool isDir = false;
+    std::atomic<qint64> bytes{0};
+    std::atomic<qint64> files{0};
+    std::atomic<bool> complete{false};
+
+    // Guarded by the session's tree mutex.
+    std::vector<std::unique_ptr<Node>> children;
+    qint64 otherBytes = 0;
+    qint64 otherFiles = 0;
+    qint64 otherCount = 0;
+
+    // Only touched by the thread listing the directory.
+    qint64 listedBytes = 0;
+    qint64 listedFiles = 0;
+    qint64 listedOtherBytes = 0;
+    qint64 listedOtherCount = 0;
+};
+
+struct CDiskUsageScanner::Session {
+    QString rootPath;
+    quint64 rootDevice = 0;
+    Node root;
+    CDirWalker walker;
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> done{false};
+
+    mutable QMutex treeMutex;
+
+    // Files with several hard links are counted once.
+    QMutex linkMutex;
+    QSet<QPair<quint64, quint64>> seenLinks;
+};
+
+CDiskUsageScanner::CDiskUsageScanner(QObject *parent)
+    : QObject(parent) {
+    pool.setMaxThreadCount(1);
+
+    updateTimer = new QTimer(this);
+    updateTimer->setInterval(kUpdateIntervalMs);
+    connect(updateTimer, &QTimer::timeout, this, &CDiskUsageScanner::updated);
+}
+
+CDiskUsageScanner::~CDiskUsageScanner() {
+    cancel();
+    pool.waitForDone();
+}
+
+void CDiskUsageScanner::start(const QString &rootPath) {
+    cancel();
+
+    auto session = std::make_shared<Session>();
+    session->rootPath = QDir::cleanPath(rootPath);
+    session->root.isDir = true;
+    session->root.name = QFile::encodeName(session->rootPath);
+    current = session;
+    updateTimer->start();
+
+    pool.start([this, session] { run(session); });
+}
+
+void CDiskUsageScanner::cancel() {
+    if (current && !current->done) {
+        current->cancelled = true;
+        current->walker.cancel();
+    }
+    updateTimer->stop();
+}
+
+QString CDiskUsageScanner::rootPath() const {
+    return current ? current->rootPath : QString();
+}
+
+bool CDiskUsageScanner::isRunning() const {
+    return current && !current->done && !current->cancelled;
+}
+
+bool CDiskUsageScanner::covers(const QString &path) const {
+    if (!current || current->cancelled) return false;
+
+    const QString cleanPath = QDir::cleanPath(path);
+    const QString &root = current->rootPath;
+    if (cleanPath == root) return true;
+    return cleanPath.startsWith(root.endsWith('/') ? root : root + '/');
+}
+
+bool CDiskUsageScanner::snapshot(const QString &path, int depth, qint64 minBytes, Item &out) const {
+    if (!covers(path)) return false;
+
+    const QString cleanPath = QDir::cleanPath(path);
+    const QStringList parts = cleanPath.mid(current->rootPath.size()).split('/', Qt::SkipEmptyParts);
+
+    QMutexLocker locker(&current->treeMutex);
+    const Node *node = &current->root;
+    for (const QString &part : parts) {
+        const QByteArray name = QFile::encodeName(part);
+        const Node *next = nullptr;
+        for (const std::unique_ptr<Node> &child : node->children) {
+            if (child->isDir && child->name == name) {
+                next = child.get();
+                break;
+            }
+        }
+        if (!next) return false;
+        node = next;
+    }
+
+    out = Item();
+    copyNode(*node, cleanPath, depth, minBytes, out);
+    return true;
+}
+
+void CDiskUsageScanner::copyNode(const Node &node, const QString &path, int depth, qint64 minBytes, Item &out) {
+    out.name = node.parent ? QFile::decodeName(node.name) : path;
+    out.path = path;
+    out.bytes = node.bytes;
+    out.files = node.files;
+    out.isDir = node.isDir;
+    out.complete = node.complete;
+    if (depth <= 0 || !node.isDir) return;
+
+    qint64 otherBytes = node.otherBytes;
+    qint64 otherFiles = node.otherFiles;
+    qint64 otherCount = node.otherCount;
+    const QString prefix = path.endsWith('/') ? path : path + '/';
+    for (const std::unique_ptr<Node> &child : node.children) {
+        const qint64 bytes = child->bytes;
+        if (bytes < minBytes || bytes <= 0) {
+            otherBytes += bytes;
+            otherFiles += child->files;
+            ++otherCount;
+            continue;
+        }
+        Item item;
+        copyNode(*child, prefix + QFile::decodeName(child->name), depth - 1, minBytes, item);
+        out.children.append(std::move(item));
+    }
+
+    if (otherBytes > 0) {
+        Item item;
+        item.name = QString("%1 smaller items").arg(otherCount);
+        item.path = path;
+        item.bytes = otherBytes;
+        item.files = otherFiles;
+        item.complete = true;
+        item.isOther = true;
+        out.children.append(item);
+    }
+
+    std::sort(out.children.begin(), out.children.end(), [](const Item &a, const Item &b) {
+        return a.bytes > b.bytes;
+    });
+}
+
+void CDiskUsageScanner::run(const std::shared_ptr<Session> &session) {
+    const QByteArray encodedRoot = QFile::encodeName(session->rootPath);
+    CDirWalker::Stat rootStat;
+    if (CDirWalker::stat(encodedRoot, rootStat))
+        session->rootDevice = rootStat.device;
+
+    CDirWalker::Visitor visitor;
+    visitor.entry = [&session](const CDirWalker::Entry &entry) {
+        Node *dirNode = reinterpret_cast<Node *>(quintptr(entry.dir.tag));
+        // Links are not followed, and their own size is negligible.
+        if (entry.type == CDirWalker::SymLink) return false;
+
+        CDirWalker::Stat st;
+        if (!entry.stat(st)) return false;
+
+        if (st.type == CDirWalker::Directory) {
+            // Like du -x: other file systems mounted below are left out.
+            if (st.device != session->rootDevice) return false;
+
+            auto child = std::make_unique<Node>();
+            child->name = entry.name;
+            child->parent = dirNode;
+            child->isDir = true;
+            entry.childTag = quintptr(child.get());
+
+            QMutexLocker locker(&session->treeMutex);
+            dirNode->children.push_back(std::move(child));
+            return true;
+        }
+
+        if (st.linkCount > 1) {
+            QMutexLocker locker(&session->linkMutex);
+            const QPair<quint64, quint64> key(st.device, st.inode);
+            if (session->seenLinks.contains(key)) return false;
+            session->seenLinks.insert(key);
+        }
+
+        dirNode->listedBytes += st.allocatedSize;
+        ++dirNode->listedFiles;
+        if (st.allocatedSize < kCollapseBytes) {
+            dirNode->listedOtherBytes += st.allocatedSize;
+            ++dirNode->listedOtherCount;
+            return false;
+        }
+
+        auto child = std::make_unique<Node>();
+        child->name = entry.name;
+        child->parent = dirNode;
+        child->bytes = st.allocatedSize;
+        child->files = 1;
+        child->complete = true;
+
+        QMutexLocker locker(&session->treeMutex);
+        dirNode->children.push_back(std::move(child));
+        return false;
+    };
+    visitor.directoryListed = [&session](const CDirWalker::Dir &dir) {
+        Node *dirNode = reinterpret_cast<Node *>(quintptr(dir.tag));
+        {
+            QMutexLocker locker(&session->treeMutex);
+            dirNode->otherBytes += dirNode->listedOtherBytes;
+            dirNode->otherFiles += dirNode->listedOtherCount;
+            dirNode->otherCount += dirNode->listedOtherCount;
+        }
+        // The folder's own files count towards every folder above it right
+        // away, so partial totals are shown while subfolders are walked.
+        for (Node *node = dirNode; node; node = node->parent) {
+            node->bytes += dirNode->listedBytes;
+            node->files += dirNode->listedFiles;
+        }
+    };
+    visitor.leaveDirectory = [&session](const CDirWalker::Dir &dir) {
+        Node *dirNode = reinterpret_cast<Node *>(quintptr(dir.tag));
+        dirNode->complete = true;
+
+        QMutexLocker locker(&session->treeMutex);
+        auto small = std::partition(dirNode->children.begin(), dirNode->children.end(),
+                                    [](const std::unique_ptr<Node> &child) {
+                                        return child->bytes >= kCollapseBytes;
+                                    });
+        for (auto it = small; it != dirNode->children.end(); ++it) {
+            dirNode->otherBytes += (*it)->bytes;
+            dirNode->otherFiles += (*it)->files;
+            ++dirNode->otherCount;
+        }
+        dirNode->children.erase(small, dirNode->children.end());
+    };
+
+    session->walker.walk(session->rootPath, visitor, quintptr(&session->root));
+    session->root.complete = true;
+    session->done = true;
+
+    QMetaObject::invokeMethod(this, [this, session] {
+        if (session != current) return;
+        updateTimer->stop();
+        emit updated();
+        emit finished(session->cancelled);
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,68 @@
+#ifndef CDISKUSAGESCANNER_H
+#define CDISKUSAGESCANNER_H
+
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include <memory>
+
+// Adds up the disk space used below a folder on a background walk. Totals
+// grow while the walk runs, one listed directory at a time, and can be read
+// at any point. Once a directory is finished, entries below it that use
+// less than a megabyte are folded into a single "smaller items" total, which
+// keeps the tree small on file systems with many millions of files.
+class CDiskUsageScanner : public QObject {
+    Q_OBJECT
+
+public:
+    struct Item {
+        QString name;
+        QString path;
+        qint64 bytes = 0;
+        qint64 files = 0;
+        bool isDir = false;
+        // False while entries below it are still being counted.
+        bool complete = false;
+        // Stands for entries too small to be listed on their own.
+        bool isOther = false;
+        // Largest first.
+        QVector<Item> children;
+    };
+
+    explicit CDiskUsageScanner(QObject *parent = nullptr);
+    ~CDiskUsageScanner() override;
+
+    void start(const QString &rootPath);
+    void cancel();
+
+    QString rootPath() const;
+    bool isRunning() const;
+    // True if `path` is the scanned folder or lies below it.
+    bool covers(const QString &path) const;
+
+    // Copies `depth` levels of the tree at `path`. Entries smaller than
+    // `minBytes` are merged into one item per folder. Returns false if the
+    // folder is not in the tree, e.g. because it was too small to keep.
+    bool snapshot(const QString &path, int depth, qint64 minBytes, Item &out) const;
+
+signals:
+    // Sent every few hundred milliseconds while the walk runs.
+    void updated();
+    void finished(bool cancelled);
+
+private:
+    struct Node;
+    struct Session;
+
+    void run(const std::shared_ptr<Session> &session);
+    static void copyNode(const Node &node, const QString &path, int depth, qint64 minBytes, Item &out);
+
+    QThreadPool pool;
+    QTimer *updateTimer;
+    std::shared_ptr<Session> current;
+};
+
+#endif // CDISKUSAGESCANNER_H
@@ -0,0 +1,313 @@
+#include "cdiskusageview.h"
+
+#include <QContextMenuEvent>
+#include <QLocale>
+#include <QMenu>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QToolTip>
+
+#include <cmath>
+
+namespace {
+constexpr int kTreemapDepth = 4;
+constexpr int kSunburstRings = 5;
+constexpr qreal kHeaderHeight = 16;
+constexpr qreal kPadding = 2;
+// Entries are merged into their folder's "smaller items" below these sizes.
+constexpr qreal kMinTileArea = 24;
+constexpr qreal kMinSliceDegrees = 0.5;
+constexpr qreal kSqrtHalf = 0.70710678118654752;
+
+// Splits `rect` into tiles with areas in proportion to `sizes`, which are
+// sorted largest first, keeping each tile as close to square as it can
+// (Bruls, Huizing and van Wijk).
+QVector<QRectF> squarify(const QVector<qreal> &sizes, QRectF rect) {
+    QVector<QRectF> tiles;
+    tiles.reserve(sizes.size());
+
+    qreal total = 0;
+    for (qreal size : sizes)
+        total += size;
+    if (total <= 0) return tiles;
+
+    const qreal scale = rect.width() * rect.height() / total;
+    auto worst = [](qreal sum, qreal largest, qreal smallest, qreal side) {
+        const qreal sideSquared = side * side;
+        const qreal sumSquared = sum * sum;
+        return qMax(sideSquared * largest / sumSquared, sumSquared / (sideSquared * smallest));
+    };
+
+    int first = 0;
+    while (first < sizes.size()) {
+        const qreal side = qMin(rect.width(), rect.height());
+        qreal rowSum = sizes[first] * scale;
+        qreal rowWorst = worst(rowSum, rowSum, rowSum, side);
+        int last = first + 1;
+        for (; last < sizes.size(); ++last) {
+            const qreal area = sizes[last] * scale;
+            const qreal candidate = worst(rowSum + area, sizes[first] * scale, area, side);
+            if (candidate > rowWorst) break;
+            rowSum += area;
+            rowWorst = candidate;
+        }
+
+        // The row is laid along the shorter side and the rest of the
+        // rectangle is left for the next one.
+        const qreal thickness = rowSum / side;
+        qreal offset = 0;
+        for (int i = first; i < last; ++i) {
+            const qreal length = sizes[i] * scale / thickness;
+            if (rect.width() >= rect.height())
+                tiles.append(QRectF(rect.left(), rect.top() + offset, thickness, length));
+            else
+                tiles.append(QRectF(rect.left() + offset, rect.top(), length, thickness));
+            offset += length;
+        }
+        if (rect.width() >= rect.height())
+            rect.setLeft(rect.left() + thickness);
+        else
+            rect.setTop(rect.top() + thickness);
+        first = last;
+    }
+    return tiles;
+}
+
+QColor childColor(const QColor &parentColor, int depth, int index) {
+    // Top level folders get hues spread by the golden ratio; their contents
+    // take the same hue, a little darker at every level.
+    if (depth == 0) return QColor::fromHsvF(std::fmod(0.6 + index * 0.618034, 1.0), 0.45, 0.95);
+    return parentColor.darker(108);
+}
+
+QRectF circleRect(const QPointF &center, qreal radius) {
+    return QRectF(center.x() - radius, center.y() - radius, 2 * radius, 2 * radius);
+}
+}
+
+CDiskUsageView::CDiskUsageView(QWidget *parent)
+    : QWidget(parent) {
+    setMouseTracking(true);
+    setBackgroundRole(QPalette::Base);
+    setAutoFillBackground(true);
+
+    scanner = new CDiskUsageScanner(this);
+    connect(scanner, &CDiskUsageScanner::updated, this, &CDiskUsageView::refresh);
+}
+
+QString CDiskUsageView::path() const {
+    return currentPath;
+}
+
+void CDiskUsageView::showPath(const QString &path) {
+    currentPath = path;
+    if (!scanner->covers(path) || !scanner->snapshot(path, 0, 0, root))
+        scanner->start(path);
+    refresh();
+}
+
+void CDiskUsageView::rescan() {
+    if (currentPath.isEmpty()) return;
+    scanner->start(currentPath);
+    refresh();
+}
+
+CDiskUsageView::Mode CDiskUsageView::mode() const {
+    return currentMode;
+}
+
+void CDiskUsageView::setMode(Mode mode) {
+    if (mode == currentMode) return;
+    currentMode = mode;
+    refresh();
+}
+
+void CDiskUsageView::refresh() {
+    shapes.clear();
+    hasRoot = false;
+
+    const QRectF area = QRectF(rect()).adjusted(kPadding, kPadding, -kPadding, -kPadding);
+    if (!currentPath.isEmpty() && area.width() > 0 && area.height() > 0
+        && scanner->snapshot(currentPath, 0, 0, root)) {
+        // Entries too small to see are merged before they are copied.
+        const qint64 total = qMax<qint64>(1, root.bytes);
+        if (currentMode == Treemap) {
+            const qint64 minBytes = qint64(total * kMinTileArea / (area.width() * area.height()));
+            hasRoot = scanner->snapshot(currentPath, kTreemapDepth, qMax<qint64>(1, minBytes), root);
+            if (hasRoot) layoutTreemap(root, area, 0, palette().window().color());
+        } else {
+            const qint64 minBytes = qint64(total * kMinSliceDegrees / 360);
+            hasRoot = scanner->snapshot(currentPath, kSunburstRings, qMax<qint64>(1, minBytes), root);
+            if (hasRoot) layoutSunburst(root, 90, 360, 0, palette().window().color());
+        }
+    }
+    update();
+}
+
+void CDiskUsageView::addShape(const CDiskUsageScanner::Item &item, const QPainterPath &outline,
+                              const QRectF &labelRect, const QColor &color) {
+    Shape shape;
+    shape.outline = outline;
+    shape.labelRect = labelRect;
+    shape.name = item.name;
+    shape.path = item.path;
+    shape.bytes = item.bytes;
+    shape.files = item.files;
+    shape.isDir = item.isDir;
+    shape.isOther = item.isOther;
+    shape.color = item.isOther ? palette().mid().color() : color;
+    shapes.append(shape);
+}
+
+void CDiskUsageView::layoutTreemap(const CDiskUsageScanner::Item &item, const QRectF &rect, int depth,
+                                   const QColor &color) {
+    QPainterPath outline;
+    outline.addRect(rect);
+    const bool hasHeader = item.isDir && rect.height() > 3 * kHeaderHeight;
+    addShape(item, outline, hasHeader ? QRectF(rect.left(), rect.top(), rect.width(), kHeaderHeight) : rect, color);
+
+    if (item.children.isEmpty() || depth >= kTreemapDepth) return;
+
+    QRectF inner = rect.adjusted(kPadding, kPadding, -kPadding, -kPadding);
+    if (hasHeader) inner.setTop(rect.top() + kHeaderHeight);
+    if (inner.width() < 4 || inner.height() < 4) return;
+
+    QVector<qreal> sizes;
+    sizes.reserve(item.children.size());
+    for (const CDiskUsageScanner::Item &child : item.children)
+        sizes.append(qreal(child.bytes));
+
+    const QVector<QRectF> tiles = squarify(sizes, inner);
+    for (int i = 0; i < tiles.size(); ++i)
+        layoutTreemap(item.children[i], tiles[i], depth + 1, childColor(color, depth, i));
+}
+
+void CDiskUsageView::layoutSunburst(const CDiskUsageScanner::Item &item, double startAngle, double spanAngle,
+                                    int depth, const QColor &color) {
+    const QPointF center = QRectF(rect()).center();
+    const qreal ringWidth = (qMin(width(), height()) / 2.0 - kPadding) / (kSunburstRings + 1);
+    if (ringWidth <= 0) return;
+
+    QPainterPath outline;
+    QRectF labelRect;
+    if (depth == 0) {
+        outline.addEllipse(circleRect(center, ringWidth));
+        // The largest square inside the middle circle.
+        labelRect = circleRect(center, ringWidth * kSqrtHalf);
+    } else {
+        const QRectF outer = circleRect(center, (depth + 1) * ringWidth);
+        const QRectF inner = circleRect(center, depth * ringWidth);
+        outline.arcMoveTo(outer, startAngle);
+        outline.arcTo(outer, startAngle, spanAngle);
+        outline.arcTo(inner, startAngle + spanAngle, -spanAngle);
+        outline.closeSubpath();
+    }
+    addShape(item, outline, labelRect, color);
+
+    if (depth >= kSunburstRings) return;
+
+    qint64 total = 0;
+    for (const CDiskUsageScanner::Item &child : item.children)
+        total += child.bytes;
+    if (total <= 0) return;
+
+    double angle = startAngle;
+    for (int i = 0; i < item.children.size(); ++i) {
+        const CDiskUsageScanner::Item &child = item.children[i];
+        const double span = spanAngle * double(child.bytes) / double(total);
+        if (span < kMinSliceDegrees) break;
+        layoutSunburst(child, angle, span, depth + 1, childColor(color, depth, i));
+        angle += span;
+    }
+}
+
+const CDiskUsageView::Shape *CDiskUsageView::shapeAt(const QPointF &point) const {
+    for (int i = shapes.size() - 1; i >= 0; --i) {
+        if (shapes[i].outline.contains(point)) return &shapes[i];
+    }
+    return nullptr;
+}
+
+void CDiskUsageView::paintEvent(QPaintEvent *) {
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing, currentMode == Sunburst);
+
+    const QLocale locale = QLocale::system();
+    const QFontMetrics metrics = fontMetrics();
+    const QColor border = palette().base().color();
+
+    for (const Shape &shape : std::as_const(shapes)) {
+        painter.setPen(border);
+        painter.setBrush(shape.color);
+        painter.drawPath(shape.outline);
+
+        if (shape.labelRect.width() < 40 || shape.labelRect.height() < metrics.height()) continue;
+        const QString label = QString("%1  %2").arg(shape.name, locale.formattedDataSize(shape.bytes));
+        const QRectF textRect = shape.labelRect.adjusted(3, 0, -3, 0);
+        painter.setPen(palette().text().color());
+        painter.drawText(textRect, Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap,
+                         metrics.elidedText(label, Qt::ElideMiddle, int(textRect.width())));
+    }
+
+    if (scanner->isRunning()) {
+        const QString status = QString("Counting... %1 so far").arg(locale.formattedDataSize(root.bytes));
+        const QRectF statusRect = QRectF(rect()).adjusted(6, 0, -6, -4);
+        painter.setPen(palette().text().color());
+        painter.drawText(statusRect, Qt::AlignRight | Qt::AlignBottom, status);
+    } else if (!hasRoot && !currentPath.isEmpty()) {
+        painter.setPen(palette().text().color());
+        painter.drawText(rect(), Qt::AlignCenter, "Nothing to show");
+    }
+}
+
+void CDiskUsageView::resizeEvent(QResizeEvent *event) {
+    QWidget::resizeEvent(event);
+    refresh();
+}
+
+void CDiskUsageView::mouseMoveEvent(QMouseEvent *event) {
+    const Shape *shape = shapeAt(event->pos());
+    if (!shape) {
+        QToolTip::hideText();
+        return;
+    }
+
+    const QLocale locale = QLocale::system();
+    QString text = QString("%1\n%2").arg(shape->isOther ? shape->name : shape->path,
+                                         locale.formattedDataSize(shape->bytes));
+    if (shape->isDir || shape->isOther)
+        text += QString(" in %1 file%2").arg(shape->files).arg(shape->files == 1 ? "" : "s");
+    QToolTip::showText(mapToGlobal(event->pos()), text, this);
+}
+
+void CDiskUsageView::mousePressEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton) {
+        QWidget::mousePressEvent(event);
+        return;
+    }
+
+    const Shape *shape = shapeAt(event->pos());
+    if (!shape || shape->isOther || shape->path == currentPath) return;
+
+    if (shape->isDir)
+        emit folderActivated(shape->path);
+    else
+        emit fileActivated(shape->path);
+}
+
+void CDiskUsageView::contextMenuEvent(QContextMenuEvent *event) {
+    QMenu menu(this);
+    QAction *treemapAction = menu.addAction("Treemap");
+    QAction *sunburstAction = menu.addAction("Sunburst");
+    treemapAction->setCheckable(true);
+    sunburstAction->setCheckable(true);
+    treemapAction->setChecked(currentMode == Treemap);
+    sunburstAction->setChecked(currentMode == Sunburst);
+    menu.addSeparator();
+    QAction *rescanAction = menu.addAction("Rescan");
+
+    connect(treemapAction, &QAction::triggered, this, [this] { setMode(Treemap); });
+    connect(sunburstAction, &QAction::triggered, this, [this] { setMode(Sunburst); });
+    connect(rescanAction, &QAction::triggered, this, &CDiskUsageView::rescan);
+    menu.exec(event->globalPos());
+}
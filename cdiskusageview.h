@@ -0,0 +1,73 @@
+#ifndef CDISKUSAGEVIEW_H
+#define CDISKUSAGEVIEW_H
+
+#include "cdiskusagescanner.h"
+
+#include <QColor>
+#include <QPainterPath>
+#include <QWidget>
+
+// Shows what takes up the space below a folder, as a squarified treemap or
+// a sunburst, redrawn as the scan streams in. Showing a folder that is part
+// of the last scan reuses its totals instead of walking it again.
+class CDiskUsageView : public QWidget {
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Treemap,
+        Sunburst
+    };
+
+    explicit CDiskUsageView(QWidget *parent = nullptr);
+
+    QString path() const;
+    void showPath(const QString &path);
+    void rescan();
+
+    Mode mode() const;
+    void setMode(Mode mode);
+
+signals:
+    // A folder was clicked to look inside it.
+    void folderActivated(const QString &path);
+    void fileActivated(const QString &path);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void contextMenuEvent(QContextMenuEvent *event) override;
+
+private:
+    struct Shape {
+        QPainterPath outline;
+        QRectF labelRect;
+        QString name;
+        QString path;
+        qint64 bytes = 0;
+        qint64 files = 0;
+        bool isDir = false;
+        bool isOther = false;
+        QColor color;
+    };
+
+    void refresh();
+    void layoutTreemap(const CDiskUsageScanner::Item &item, const QRectF &rect, int depth, const QColor &color);
+    void layoutSunburst(const CDiskUsageScanner::Item &item, double startAngle, double spanAngle, int depth,
+                        const QColor &color);
+    void addShape(const CDiskUsageScanner::Item &item, const QPainterPath &outline, const QRectF &labelRect,
+                  const QColor &color);
+    const Shape *shapeAt(const QPointF &point) const;
+
+    CDiskUsageScanner *scanner;
+    Mode currentMode = Treemap;
+    QString currentPath;
+    CDiskUsageScanner::Item root;
+    bool hasRoot = false;
+    // Inner shapes come after the ones that contain them.
+    QVector<Shape> shapes;
+};
+
+#endif // CDISKUSAGEVIEW_H
@@ -0,0 +1,554 @@
+#include "cduplicatefinder.h"
+#include "cdirwalker.h"
+
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThread>
+#include <QtEndian>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+namespace {
+constexpr char kMagic[8] = {'C', 'E', 'X', 'D', 'U', 'P', '0', '1'};
+constexpr quint32 kVersion = 1;
+// Large files are kept first; they are the expensive ones to read again.
+constexpr int kMaxSavedRecords = 500000;
+// The partial hash covers this much at each end of a file; smaller files
+// are read whole right away.
+constexpr qint64 kBlockBytes = 4096;
+constexpr qint64 kChunkBytes = 1024 * 1024;
+constexpr qint64 kProgressInterval = 256;
+// Reading many large files at once only makes a disk seek between them.
+constexpr int kMaxHashThreads = 4;
+
+struct FileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 reserved;
+    quint64 count;
+};
+
+struct FileRecord {
+    quint64 device;
+    quint64 inode;
+    qint64 size;
+    qint64 modifiedMs;
+    quint64 partialHash;
+    quint64 fullHash;
+    quint32 flags;
+    quint32 reserved;
+};
+
+enum RecordFlag : quint32 {
+    HasPartial = 1,
+    HasFull = 2
+};
+
+QPair<quint64, quint64> keyFor(const CDirWalker::Stat &st, const QByteArray &path) {
+    // Platforms without inode numbers fall back to the path.
+    if (st.inode == 0) return qMakePair(quint64(0), quint64(qHash(path)));
+    return qMakePair(st.device, st.inode);
+}
+
+// XXH64, streamed.
+class Hasher {
+public:
+    Hasher() {
+        v[0] = kPrime1 + kPrime2;
+        v[1] = kPrime2;
+        v[2] = 0;
+        v[3] = 0 - kPrime1;
+    }
+
+    void update(const char *data, qint64 length) {
+        const uchar *p = reinterpret_cast<const uchar *>(data);
+        const uchar *end = p + length;
+        total += quint64(length);
+
+        if (pending + length < 32) {
+            std::memcpy(buffer + pending, p, size_t(length));
+            pending += int(length);
+            return;
+        }
+        if (pending > 0) {
+            const int fill = 32 - pending;
+            std::memcpy(buffer + pending, p, size_t(fill));
+            consume(buffer);
+            p += fill;
+            pending = 0;
+        }
+        for (; end - p >= 32; p += 32)
+            consume(p);
+        pending = int(end - p);
+        std::memcpy(buffer, p, size_t(pending));
+    }
+
+    quint64 digest() const {
+        quint64 h;
+        if (total >= 32) {
+            h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+            for (quint64 lane : v) {
+                h ^= round(0, lane);
+                h = h * kPrime1 + kPrime4;
+            }
+        } else {
+            h = kPrime5;
+        }
+        h += total;
+
+        const uchar *p = buffer;
+        const uchar *end = buffer + pending;
+        for (; end - p >= 8; p += 8) {
+            h ^= round(0, qFromLittleEndian<quint64>(p));
+            h = rotl(h, 27) * kPrime1 + kPrime4;
+        }
+        if (end - p >= 4) {
+            h ^= quint64(qFromLittleEndian<quint32>(p)) * kPrime1;
+            h = rotl(h, 23) * kPrime2 + kPrime3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            h ^= *p * kPrime5;
+            h = rotl(h, 11) * kPrime1;
+        }
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr quint64 kPrime1 = 0x9E3779B185EBCA87ULL;
+    static constexpr quint64 kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr quint64 kPrime3 = 0x165667B19E3779F9ULL;
+    static constexpr quint64 kPrime4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr quint64 kPrime5 = 0x27D4EB2F165667C5ULL;
+
+    static quint64 rotl(quint64 x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static quint64 round(quint64 acc, quint64 input) {
+        acc += input * kPrime2;
+        return rotl(acc, 31) * kPrime1;
+    }
+
+    void consume(const uchar *p) {
+        for (int lane = 0; lane < 4; ++lane)
+            v[lane] = round(v[lane], qFromLittleEndian<quint64>(p + lane * 8));
+    }
+
+    quint64 v[4];
+    quint64 total = 0;
+    uchar buffer[32];
+    int pending = 0;
+};
+
+bool readFully(QFile &file, char *data, qint64 length) {
+    qint64 done = 0;
+    while (done < length) {
+        const qint64 bytes = file.read(data + done, length - done);
+        if (bytes <= 0) return false;
+        done += bytes;
+    }
+    return true;
+}
+}
+
+struct CDuplicateFinder::Candidate {
+    QByteArray path;
+    Key key;
+    qint64 size = 0;
+    qint64 modifiedMs = 0;
+    quint64 partialHash = 0;
+    quint64 fullHash = 0;
+    bool failed = false;
+    // The partial group the file is in while full hashes are computed.
+    int group = -1;
+};
+
+struct CDuplicateFinder::Session {
+    quint64 id = 0;
+    std::atomic<bool> cancelled{false};
+    CDirWalker walker;
+
+    QMutex mutex;
+    std::deque<Candidate> candidates;
+    QSet<Key> seen;
+    std::atomic<qint64> scanned{0};
+};
+
+CDuplicateFinder::CDuplicateFinder(QObject *parent)
+    : QObject(parent) {
+    qRegisterMetaType<CDuplicateFinder::Group>();
+    qRegisterMetaType<CDuplicateFinder::Stage>();
+
+    const QString cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(cacheDirectory);
+    cacheFileName = cacheDirectory + "/duplicates.cache";
+    pool.setMaxThreadCount(1);
+    hashPool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), kMaxHashThreads));
+
+    load();
+}
+
+CDuplicateFinder::~CDuplicateFinder() {
+    cancel();
+    pool.waitForDone();
+    save();
+}
+
+quint64 CDuplicateFinder::start(const QString &rootPath) {
+    cancel();
+
+    auto session = std::make_shared<Session>();
+    session->id = nextRunId++;
+    current = session;
+
+    pool.start([this, session, rootPath] {
+        run(session, rootPath);
+    });
+    return session->id;
+}
+
+void CDuplicateFinder::cancel() {
+    if (current) {
+        current->cancelled = true;
+        current->walker.cancel();
+        current.reset();
+    }
+}
+
+void CDuplicateFinder::run(const std::shared_ptr<Session> &session, const QString &rootPath) {
+    if (!collect(session, rootPath) || session->cancelled) {
+        emit finished(session->id, session->cancelled);
+        return;
+    }
+
+    // Only sizes shared by two files or more can hold duplicates. Larger
+    // files go first, so the groups that free the most space show up early.
+    std::vector<Candidate *> bySize;
+    bySize.reserve(session->candidates.size());
+    for (Candidate &candidate : session->candidates)
+        bySize.push_back(&candidate);
+    std::sort(bySize.begin(), bySize.end(), [](const Candidate *a, const Candidate *b) {
+        return a->size > b->size;
+    });
+
+    QVector<Candidate *> sized;
+    for (size_t i = 0; i < bySize.size();) {
+        size_t j = i + 1;
+        while (j < bySize.size() && bySize[j]->size == bySize[i]->size)
+            ++j;
+        if (j - i > 1) {
+            for (size_t k = i; k < j; ++k)
+                sized.append(bySize[k]);
+        }
+        i = j;
+    }
+    bySize.clear();
+
+    hashAll(session, sized, PartialHashing, nullptr);
+    if (session->cancelled) {
+        emit finished(session->id, true);
+        return;
+    }
+
+    auto emitGroups = [this, &session](QVector<Candidate *> members, bool full) {
+        std::sort(members.begin(), members.end(), [full](const Candidate *a, const Candidate *b) {
+            const quint64 ha = full ? a->fullHash : a->partialHash;
+            const quint64 hb = full ? b->fullHash : b->partialHash;
+            if (ha != hb) return ha < hb;
+            return a->path < b->path;
+        });
+        for (int i = 0; i < members.size();) {
+            const quint64 hash = full ? members[i]->fullHash : members[i]->partialHash;
+            int j = i + 1;
+            while (j < members.size() && (full ? members[j]->fullHash : members[j]->partialHash) == hash)
+                ++j;
+            if (j - i > 1 && !session->cancelled) {
+                Group group;
+                group.size = members[i]->size;
+                group.hash = hash;
+                for (int k = i; k < j; ++k)
+                    group.paths.append(QFile::decodeName(members[k]->path));
+                emit groupFound(session->id, group);
+            }
+            i = j;
+        }
+    };
+
+    // Files that agree on size and partial hash are read in full. Small files
+    // were read whole already, so their partial hash is the full one.
+    struct Pending {
+        QVector<Candidate *> members;
+        std::atomic<int> remaining{0};
+    };
+    std::deque<Pending> pending;
+    QVector<Candidate *> unresolved;
+
+    std::sort(sized.begin(), sized.end(), [](const Candidate *a, const Candidate *b) {
+        if (a->size != b->size) return a->size > b->size;
+        return a->partialHash < b->partialHash;
+    });
+    for (int i = 0; i < sized.size();) {
+        int j = i;
+        QVector<Candidate *> members;
+        for (; j < sized.size() && sized[j]->size == sized[i]->size && sized[j]->partialHash == sized[i]->partialHash;
+             ++j) {
+            if (!sized[j]->failed) members.append(sized[j]);
+        }
+        i = j;
+        if (members.size() < 2) continue;
+
+        if (members.first()->size <= 2 * kBlockBytes) {
+            emitGroups(members, false);
+            continue;
+        }
+
+        Pending &group = pending.emplace_back();
+        group.remaining = int(members.size());
+        for (Candidate *member : std::as_const(members)) {
+            member->group = int(pending.size()) - 1;
+            unresolved.append(member);
+        }
+        group.members = std::move(members);
+    }
+
+    hashAll(session, unresolved, FullHashing, [&pending, &emitGroups](Candidate *candidate) {
+        Pending &group = pending[size_t(candidate->group)];
+        if (--group.remaining > 0) return;
+
+        QVector<Candidate *> members;
+        for (Candidate *member : std::as_const(group.members)) {
+            if (!member->failed) members.append(member);
+        }
+        emitGroups(members, true);
+    });
+
+    emit finished(session->id, session->cancelled);
+}
+
+bool CDuplicateFinder::collect(const std::shared_ptr<Session> &session, const QString &rootPath) {
+    CDirWalker::Visitor visitor;
+    visitor.entry = [this, &session](const CDirWalker::Entry &entry) {
+        if (entry.name[0] == '.') return false;
+        // Links would only report their target a second time.
+        if (entry.type == CDirWalker::SymLink || entry.type == CDirWalker::Other) return false;
+
+        CDirWalker::Stat st;
+        if (!entry.stat(st)) return false;
+        if (st.type == CDirWalker::Directory) return true;
+        if (st.type != CDirWalker::File || st.size <= 0) return false;
+
+        const QByteArray path = entry.filePath();
+        const Key key = keyFor(st, path);
+        {
+            QMutexLocker locker(&session->mutex);
+            // Hard links share their data, so only one of them takes part.
+            if (session->seen.contains(key)) return false;
+            session->seen.insert(key);
+
+            Candidate &candidate = session->candidates.emplace_back();
+            candidate.path = path;
+            candidate.key = key;
+            candidate.size = st.size;
+            candidate.modifiedMs = st.modifiedMs;
+        }
+
+        const qint64 scanned = ++session->scanned;
+        if (scanned % kProgressInterval == 0)
+            emit progress(session->id, Scanning, scanned, 0);
+        return false;
+    };
+
+    const bool walked = session->walker.walk(rootPath, visitor);
+    session->seen.clear();
+    emit progress(session->id, Scanning, session->scanned, 0);
+    return walked;
+}
+
+void CDuplicateFinder::hashAll(const std::shared_ptr<Session> &session, const QVector<Candidate *> &candidates,
+                               Stage stage, const std::function<void(Candidate *)> &hashed) {
+    const int count = int(candidates.size());
+    emit progress(session->id, stage, 0, count);
+    if (count == 0) return;
+
+    std::atomic<int> next{0};
+    std::atomic<qint64> done{0};
+    const int workers = qMin(count, hashPool.maxThreadCount());
+    for (int w = 0; w < workers; ++w) {
+        hashPool.start([&] {
+            for (int i = next++; i < count && !session->cancelled; i = next++) {
+                Candidate *candidate = candidates[i];
+                if (!hashCandidate(session, *candidate, stage))
+                    candidate->failed = true;
+                if (hashed) hashed(candidate);
+
+                const qint64 completed = ++done;
+                if (completed % kProgressInterval == 0 || completed == count)
+                    emit progress(session->id, stage, completed, count);
+            }
+        });
+    }
+    hashPool.waitForDone();
+}
+
+bool CDuplicateFinder::hashCandidate(const std::shared_ptr<Session> &session, Candidate &candidate, Stage stage) {
+    const bool whole = candidate.size <= 2 * kBlockBytes;
+    const bool full = stage == FullHashing;
+    {
+        QMutexLocker locker(&cacheMutex);
+        auto it = cache.constFind(candidate.key);
+        if (it != cache.constEnd() && it->size == candidate.size && it->modifiedMs == candidate.modifiedMs) {
+            if (!full && it->hasPartial) {
+                candidate.partialHash = it->partialHash;
+                return true;
+            }
+            if (full && it->hasFull) {
+                candidate.fullHash = it->fullHash;
+                return true;
+            }
+        }
+    }
+
+    QFile file(QFile::decodeName(candidate.path));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) return false;
+
+    Hasher hasher;
+    if (!full) {
+        char block[2 * kBlockBytes];
+        if (whole) {
+            if (!readFully(file, block, candidate.size)) return false;
+            hasher.update(block, candidate.size);
+        } else {
+            if (!readFully(file, block, kBlockBytes) || !file.seek(candidate.size - kBlockBytes)
+                || !readFully(file, block + kBlockBytes, kBlockBytes)) {
+                return false;
+            }
+            hasher.update(block, 2 * kBlockBytes);
+        }
+    } else {
+#ifdef Q_OS_LINUX
+        ::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        std::vector<char> buffer(kChunkBytes);
+        qint64 total = 0;
+        while (!session->cancelled) {
+            const qint64 bytes = file.read(buffer.data(), kChunkBytes);
+            if (bytes < 0) return false;
+            if (bytes == 0) break;
+            hasher.update(buffer.data(), bytes);
+            total += bytes;
+        }
+        // A file that changed size since the walk cannot be trusted.
+        if (session->cancelled || total != candidate.size) return false;
+    }
+
+    const quint64 hash = hasher.digest();
+    if (full)
+        candidate.fullHash = hash;
+    else
+        candidate.partialHash = hash;
+
+    QMutexLocker locker(&cacheMutex);
+    Record &record = cache[candidate.key];
+    if (record.size != candidate.size || record.modifiedMs != candidate.modifiedMs)
+        record = Record();
+    record.size = candidate.size;
+    record.modifiedMs = candidate.modifiedMs;
+    if (full) {
+        record.fullHash = hash;
+        record.hasFull = true;
+    } else {
+        record.partialHash = hash;
+        record.hasPartial = true;
+        if (whole) {
+            record.fullHash = hash;
+            record.hasFull = true;
+        }
+    }
+    return true;
+}
+
+void CDuplicateFinder::load() {
+    QFile file(cacheFileName);
+    if (!file.open(QIODevice::ReadOnly)) return;
+
+    FileHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != qint64(sizeof(header))
+        || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion
+        || header.count > quint64(file.size()) / sizeof(FileRecord)) {
+        return;
+    }
+
+    std::vector<FileRecord> records(header.count);
+    const qint64 bytes = qint64(records.size() * sizeof(FileRecord));
+    if (file.read(reinterpret_cast<char *>(records.data()), bytes) != bytes) return;
+
+    QMutexLocker locker(&cacheMutex);
+    cache.reserve(qsizetype(records.size()));
+    for (const FileRecord &record : records) {
+        Record &entry = cache[qMakePair(record.device, record.inode)];
+        entry.size = record.size;
+        entry.modifiedMs = record.modifiedMs;
+        entry.partialHash = record.partialHash;
+        entry.fullHash = record.fullHash;
+        entry.hasPartial = record.flags & HasPartial;
+        entry.hasFull = record.flags & HasFull;
+    }
+}
+
+void CDuplicateFinder::save() {
+    std::vector<FileRecord> records;
+    {
+        QMutexLocker locker(&cacheMutex);
+        records.reserve(size_t(cache.size()));
+        for (auto it = cache.constBegin(); it != cache.constEnd(); ++it) {
+            const Record &record = it.value();
+            const quint32 flags = (record.hasPartial ? HasPartial : 0) | (record.hasFull ? HasFull : 0);
+            records.push_back({it.key().first, it.key().second, record.size, record.modifiedMs,
+                               record.partialHash, record.fullHash, flags, 0});
+        }
+    }
+
+    if (records.size() > size_t(kMaxSavedRecords)) {
+        std::nth_element(records.begin(), records.begin() + kMaxSavedRecords, records.end(),
+                         [](const FileRecord &a, const FileRecord &b) {
+                             return a.size > b.size;
+                         });
+        records.resize(kMaxSavedRecords);
+    }
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.count = records.size();
+
+    QSaveFile out(cacheFileName);
+    if (!out.open(QIODevice::WriteOnly)) return;
+
+    const qint64 bytes = qint64(records.size() * sizeof(FileRecord));
+    if (out.write(reinterpret_cast<const char *>(&header), sizeof(header)) != qint64(sizeof(header))
+        || out.write(reinterpret_cast<const char *>(records.data()), bytes) != bytes) {
+        out.cancelWriting();
+        return;
+    }
+    out.commit();
+}
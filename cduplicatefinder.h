@@ -0,0 +1,85 @@
+#ifndef CDUPLICATEFINDER_H
+#define CDUPLICATEFINDER_H
+
+#include <QHash>
+#include <QMetaType>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+#include <functional>
+#include <memory>
+
+// Finds files with identical contents below a folder. Files are grouped by
+// size first, then by a hash of their first and last blocks, and only files
+// that still collide are read in full. Hashes are cached by (device, inode)
+// and reused while the size and mtime are unchanged.
+class CDuplicateFinder : public QObject {
+    Q_OBJECT
+
+public:
+    enum Stage {
+        Scanning,
+        PartialHashing,
+        FullHashing
+    };
+    Q_ENUM(Stage)
+
+    struct Group {
+        qint64 size = 0;
+        quint64 hash = 0;
+        QStringList paths;
+    };
+
+    explicit CDuplicateFinder(QObject *parent = nullptr);
+    ~CDuplicateFinder() override;
+
+    quint64 start(const QString &rootPath);
+    void cancel();
+
+signals:
+    // `total` is 0 while scanning, as it is not known yet.
+    void progress(quint64 runId, CDuplicateFinder::Stage stage, qint64 done, qint64 total);
+    void groupFound(quint64 runId, const CDuplicateFinder::Group &group);
+    void finished(quint64 runId, bool cancelled);
+
+private:
+    using Key = QPair<quint64, quint64>;
+
+    struct Record {
+        qint64 size = 0;
+        qint64 modifiedMs = 0;
+        quint64 partialHash = 0;
+        quint64 fullHash = 0;
+        bool hasPartial = false;
+        bool hasFull = false;
+    };
+
+    struct Candidate;
+    struct Session;
+
+    void run(const std::shared_ptr<Session> &session, const QString &rootPath);
+    bool collect(const std::shared_ptr<Session> &session, const QString &rootPath);
+    void hashAll(const std::shared_ptr<Session> &session, const QVector<Candidate *> &candidates, Stage stage,
+                 const std::function<void(Candidate *)> &hashed);
+    bool hashCandidate(const std::shared_ptr<Session> &session, Candidate &candidate, Stage stage);
+    void load();
+    void save();
+
+    QString cacheFileName;
+    QThreadPool pool;
+    QThreadPool hashPool;
+
+    QMutex cacheMutex;
+    QHash<Key, Record> cache;
+
+    std::shared_ptr<Session> current;
+    quint64 nextRunId = 1;
+};
+
+Q_DECLARE_METATYPE(CDuplicateFinder::Group)
+
+#endif // CDUPLICATEFINDER_H
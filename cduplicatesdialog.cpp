@@ -0,0 +1,131 @@
+#include "cduplicatesdialog.h"
+
+#include <QDialogButtonBox>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QLocale>
+#include <QVBoxLayout>
+
+namespace {
+enum Column {
+    NameColumn,
+    FolderColumn,
+    SizeColumn
+};
+
+// Top level items keep the bytes their group would free in this role.
+constexpr int kReclaimableRole = Qt::UserRole + 1;
+}
+
+CDuplicatesDialog::CDuplicatesDialog(CDuplicateFinder *duplicateFinder, const QString &rootPath, QWidget *parent)
+    : QDialog(parent), finder(duplicateFinder) {
+    setWindowTitle(QString("Duplicates in %1").arg(QFileInfo(rootPath).fileName().isEmpty()
+                                                       ? rootPath : QFileInfo(rootPath).fileName()));
+    resize(760, 480);
+
+    statusLabel = new QLabel(this);
+
+    tree = new QTreeWidget(this);
+    tree->setColumnCount(3);
+    tree->setHeaderLabels({"Name", "Folder", "Size"});
+    tree->setUniformRowHeights(true);
+    tree->header()->setSectionResizeMode(FolderColumn, QHeaderView::Stretch);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    cancelButton = buttons->addButton("Stop", QDialogButtonBox::ActionRole);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(statusLabel);
+    layout->addWidget(tree, 1);
+    layout->addWidget(buttons);
+
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    connect(cancelButton, &QPushButton::clicked, this, [this] {
+        if (finder && running) finder->cancel();
+    });
+    connect(tree, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item) {
+        const QString path = item->data(NameColumn, Qt::UserRole).toString();
+        if (!path.isEmpty()) emit showInFolder(path);
+    });
+
+    connect(finder, &CDuplicateFinder::groupFound, this, &CDuplicatesDialog::addGroup);
+    connect(finder, &CDuplicateFinder::progress, this, &CDuplicatesDialog::updateProgress);
+    connect(finder, &CDuplicateFinder::finished, this, &CDuplicatesDialog::finishRun);
+
+    running = true;
+    runId = finder->start(rootPath);
+    statusLabel->setText("Looking for files...");
+}
+
+CDuplicatesDialog::~CDuplicatesDialog() {
+    if (finder && running) finder->cancel();
+}
+
+void CDuplicatesDialog::addGroup(quint64 id, const CDuplicateFinder::Group &group) {
+    if (id != runId) return;
+
+    const QLocale locale = QLocale::system();
+    const qint64 freed = group.size * (group.paths.size() - 1);
+    ++groupCount;
+    reclaimable += freed;
+
+    QTreeWidgetItem *groupItem = new QTreeWidgetItem;
+    groupItem->setText(NameColumn, QString("%1 copies of %2")
+                                       .arg(group.paths.size())
+                                       .arg(QFileInfo(group.paths.first()).fileName()));
+    groupItem->setText(FolderColumn, QString("%1 reclaimable").arg(locale.formattedDataSize(freed)));
+    groupItem->setText(SizeColumn, locale.formattedDataSize(group.size));
+    groupItem->setData(NameColumn, kReclaimableRole, freed);
+
+    for (const QString &path : group.paths) {
+        const QFileInfo info(path);
+        QTreeWidgetItem *fileItem = new QTreeWidgetItem(groupItem);
+        fileItem->setText(NameColumn, info.fileName());
+        fileItem->setText(FolderColumn, info.path());
+        fileItem->setText(SizeColumn, locale.formattedDataSize(group.size));
+        fileItem->setData(NameColumn, Qt::UserRole, path);
+        fileItem->setToolTip(NameColumn, path);
+    }
+
+    // Groups arrive roughly by size; each one still goes in its place.
+    int low = 0;
+    int high = tree->topLevelItemCount();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (tree->topLevelItem(middle)->data(NameColumn, kReclaimableRole).toLongLong() >= freed)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    tree->insertTopLevelItem(low, groupItem);
+    groupItem->setExpanded(true);
+}
+
+void CDuplicatesDialog::updateProgress(quint64 id, CDuplicateFinder::Stage stage, qint64 done, qint64 total) {
+    if (id != runId) return;
+
+    switch (stage) {
+    case CDuplicateFinder::Scanning:
+        statusLabel->setText(QString("Looking for files... %1 found").arg(done));
+        break;
+    case CDuplicateFinder::PartialHashing:
+        statusLabel->setText(QString("Comparing files of equal size... %1 of %2").arg(done).arg(total));
+        break;
+    case CDuplicateFinder::FullHashing:
+        statusLabel->setText(QString("Comparing contents... %1 of %2, %3 groups so far")
+                                 .arg(done).arg(total).arg(groupCount));
+        break;
+    }
+}
+
+void CDuplicatesDialog::finishRun(quint64 id, bool cancelled) {
+    if (id != runId) return;
+
+    running = false;
+    cancelButton->setEnabled(false);
+    statusLabel->setText(QString("%1%2 group%3 of duplicates, %4 reclaimable")
+                             .arg(cancelled ? "Stopped. " : "")
+                             .arg(groupCount)
+                             .arg(groupCount == 1 ? "" : "s")
+                             .arg(QLocale::system().formattedDataSize(reclaimable)));
+}
@@ -0,0 +1,41 @@
+#ifndef CDUPLICATESDIALOG_H
+#define CDUPLICATESDIALOG_H
+
+#include "cduplicatefinder.h"
+
+#include <QDialog>
+#include <QLabel>
+#include <QPointer>
+#include <QPushButton>
+#include <QTreeWidget>
+
+// Runs a duplicate search over one folder and lists the groups as they are
+// found, those that free the most space first.
+class CDuplicatesDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    CDuplicatesDialog(CDuplicateFinder *finder, const QString &rootPath, QWidget *parent = nullptr);
+    ~CDuplicatesDialog() override;
+
+signals:
+    void showInFolder(const QString &path);
+
+private slots:
+    void addGroup(quint64 id, const CDuplicateFinder::Group &group);
+    void updateProgress(quint64 id, CDuplicateFinder::Stage stage, qint64 done, qint64 total);
+    void finishRun(quint64 id, bool cancelled);
+
+private:
+    QPointer<CDuplicateFinder> finder;
+    quint64 runId = 0;
+    bool running = false;
+    qint64 groupCount = 0;
+    qint64 reclaimable = 0;
+
+    QLabel *statusLabel;
+    QTreeWidget *tree;
+    QPushButton *cancelButton;
+};
+
+#endif // CDUPLICATESDIALOG_H
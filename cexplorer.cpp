@@ -1,5 +1,10 @@
 #include "cexplorer.h"
 #include "cfilesystemmodel.h"
+#include "cfileoperations.h"
+#include "cconflictdialog.h"
+#include "cduplicatesdialog.h"
+#include "cpropertiesdialog.h"
+#include "ctrash.h"
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -25,6 +30,7 @@
 #include <QSplitter>
 #include <QHeaderView>
 #include <QToolButton>
+#include <QSettings>
 
 CExplorer::CExplorer() {
     QWidget *centralWidget = new QWidget(this);
@@ -35,12 +41,30 @@ CExplorer::CExplorer() {
     backButton->setText("<");
     forwardButton = new QToolButton(this);
     forwardButton->setText(">");
+    diskUsageButton = new QToolButton(this);
+    diskUsageButton->setText("Usage");
+    diskUsageButton->setCheckable(true);
+    diskUsageButton->setToolTip("Show what takes up the space in this folder");
+
+    verifyMovesAction = new QAction("Verify Moves Between Drives", this);
+    verifyMovesAction->setCheckable(true);
+    verifyMovesAction->setToolTip("Read moved files back and compare them before deleting the originals");
+    verifyMovesAction->setChecked(QSettings("C-Explorer", "C-Explorer").value("verifyMoves", false).toBool());
+    connect(verifyMovesAction, &QAction::toggled, this, [](bool checked) {
+        QSettings("C-Explorer", "C-Explorer").setValue("verifyMoves", checked);
+    });
 
-    searchResultsModel = new QStandardItemModel(this);
+    searchResultsModel = new CSearchResultsModel(this);
+    searchIndex = new CSearchIndex(this);
+    searchEngine = new CSearchEngine(this);
+    searchEngine->setIndex(searchIndex);
 
     locationBar = new QLineEdit(QString("This PC"), this);
     searchBar = new QLineEdit(this);
     searchBar->setPlaceholderText("Search");
+    searchBar->setToolTip("Filters this folder as you type; Enter searches below it.\n"
+                          "Queries can use *.log, /regex/, ext:jpg,png, size:>10M, modified:<7d,\n"
+                          "type:dir, content:\"text in files\", \"quoted phrases\", OR, -exclude and parentheses.");
 
     searchBar->setFixedHeight(30);
     locationBar->setFixedHeight(30);
@@ -62,6 +86,7 @@ CExplorer::CExplorer() {
     navLayout->addWidget(backButton);
     navLayout->addWidget(forwardButton);
     navLayout->addWidget(locationSearchWidget);
+    navLayout->addWidget(diskUsageButton);
 
     mainLayout->addLayout(navLayout);
 
@@ -79,8 +104,29 @@ CExplorer::CExplorer() {
     pinnedList->setFixedHeight(140);
     leftLay->addWidget(pinnedList);
 
+    clipboardOperation = new CClipboardOperation(this);
+
     model = new CFileSystemModel(this);
     model->setRootPath(QString{});
+    model->setClipboardOperation(clipboardOperation);
+
+    folderSizeProvider = new CFolderSizeProvider(this);
+    duplicateFinder = new CDuplicateFinder(this);
+
+    iconService = new CIconService(this);
+    model->setIconService(iconService);
+
+    changeWatcher = new CChangeWatcher(this);
+    changeWatcher->watchMount(QDir::homePath());
+    searchIndex->setChangeWatcher(changeWatcher);
+
+    listingModel = new CDirListingModel(this);
+    listingModel->setChangeWatcher(changeWatcher);
+    listingModel->setClipboardOperation(clipboardOperation);
+    listingModel->setFolderSizeProvider(folderSizeProvider);
+    listingModel->setIconService(iconService);
+    listingModel->setDirectory(QString());
+
     treeView = new QTreeView(this);
     treeView->setModel(model);
     treeView->setRootIndex(QModelIndex());
@@ -90,8 +136,7 @@ CExplorer::CExplorer() {
     splitter->addWidget(leftPanel);
 
     contentView = new QTableView(this);
-    contentView->setModel(model);
-    contentView->setRootIndex(QModelIndex());
+    contentView->setModel(listingModel);
     contentView->setSelectionMode(QAbstractItemView::ExtendedSelection);
     contentView->setSelectionBehavior(QAbstractItemView::SelectRows);
     contentView->setAlternatingRowColors(true);
@@ -99,14 +144,34 @@ CExplorer::CExplorer() {
     contentView->horizontalHeader()->setStretchLastSection(true);
     contentView->setShowGrid(false);
 
-    splitter->addWidget(contentView);
+    diskUsageView = new CDiskUsageView(this);
+
+    contentStack = new QStackedWidget(this);
+    contentStack->addWidget(contentView);
+    contentStack->addWidget(diskUsageView);
+
+    splitter->addWidget(contentStack);
     splitter->setStretchFactor(1, 3);
     mainLayout->addWidget(splitter);
 
     setCentralWidget(centralWidget);
 
+    jobQueue = new CJobQueue(this);
+    transferManager = new CTransferManager(jobQueue, this);
+    addDockWidget(Qt::BottomDockWidgetArea, transferManager);
+
     populatePinnedFolders();
 
+    // Finding the trashes visits every mount point, which can stall on a
+    // stale network mount, so it is kept off the GUI thread. A job is only
+    // queued when an earlier empty left something behind.
+    trashPool.setMaxThreadCount(1);
+    trashPool.start([this] {
+        const QStringList pending = CTrash::pendingExpunges();
+        if (pending.isEmpty()) return;
+        QMetaObject::invokeMethod(this, [this, pending] { expungeTrash(pending); }, Qt::QueuedConnection);
+    });
+
     connect(treeView, &QTreeView::clicked, this, [=](const QModelIndex &index) {
         if (model->isDir(index)) {
             navigateTo(model->filePath(index));
@@ -125,26 +190,53 @@ CExplorer::CExplorer() {
             return;
 
         if (inSearchMode) {
-            QString path = searchResultsModel->item(index.row(), 4)->text();
+            QString path = searchResultsModel->filePath(index.row());
             navigateTo(path);
-            contentView->setModel(model);
+            contentView->setModel(listingModel);
             inSearchMode = false;
             return;
         }
 
-        QString path = model->filePath(index);
-        if (model->isDir(index)) {
+        QString path = listingModel->filePath(index);
+        if (listingModel->isDir(index)) {
             navigateTo(path);
         } else {
             QDesktopServices::openUrl(QUrl::fromLocalFile(path));
         }
     });
 
+    connect(diskUsageButton, &QToolButton::toggled, this, [=](bool checked) {
+        const QString directory = listingModel->directory();
+        if (checked && (directory.isEmpty() || inSearchMode)) {
+            diskUsageButton->setChecked(false);
+            return;
+        }
+        if (checked)
+            diskUsageView->showPath(directory);
+        contentStack->setCurrentWidget(checked ? static_cast<QWidget *>(diskUsageView) : contentView);
+    });
+
+    connect(diskUsageView, &CDiskUsageView::folderActivated, this, &CExplorer::navigateTo);
+    connect(diskUsageView, &CDiskUsageView::fileActivated, this, [](const QString &path) {
+        QDesktopServices::openUrl(QUrl::fromLocalFile(path));
+    });
+
     connect(pinnedList, &QListWidget::itemClicked, this, [this](QListWidgetItem *item) {
         const QString path = item->data(Qt::UserRole).toString();
         navigateTo(path);
     });
 
+    pinnedList->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(pinnedList, &QListWidget::customContextMenuRequested, this, [this](const QPoint &pos) {
+        QListWidgetItem *item = pinnedList->itemAt(pos);
+        if (!item || !item->data(Qt::UserRole + 1).toBool()) return;
+
+        QMenu menu(this);
+        QAction *emptyAction = menu.addAction("Empty Trash");
+        connect(emptyAction, &QAction::triggered, this, &CExplorer::emptyTrash);
+        menu.exec(pinnedList->viewport()->mapToGlobal(pos));
+    });
+
     connect(backButton, &QToolButton::clicked, this, [=] {
         if (!backHistory.isEmpty()) {
             forwardHistory.push(locationBar->text());
@@ -174,11 +266,47 @@ CExplorer::CExplorer() {
         navigateTo(inputPath);
     });
 
+    connect(searchEngine, &CSearchEngine::resultsReady, this, &CExplorer::appendSearchResults);
+
+    connect(QGuiApplication::clipboard(), &QClipboard::dataChanged, this, [this] {
+        if (!clipboardOperation->isEmpty() && !clipboardOperation->matches(QGuiApplication::clipboard()->mimeData()))
+            clipboardOperation->clear();
+    });
+    connect(jobQueue, &CJobQueue::jobFinished, this, &CExplorer::reportJobErrors);
+
+    connect(iconService, &CIconService::iconReady, this, [this](const QString &path) {
+        for (int row = 0; row < pinnedList->count(); ++row) {
+            QListWidgetItem *item = pinnedList->item(row);
+            if (item->data(Qt::UserRole).toString() == path && !item->data(Qt::UserRole + 1).toBool())
+                item->setIcon(iconService->icon(path, QFileIconProvider::Folder));
+        }
+    });
+
+    // The tree model also inserts rows while it populates a folder on
+    // expand, so only real changes from the watcher invalidate anything.
+    connect(changeWatcher, &CChangeWatcher::directoryChanged, this, [=](const QString &path) {
+        folderSizeProvider->invalidate(path);
+    });
+
+    // Typing narrows the current folder in place; Enter searches below it.
+    connect(searchBar, &QLineEdit::textEdited, this, [=](const QString &text) {
+        searchEngine->cancel();
+        activeSearchId = 0;
+        if (!inSearchMode)
+            listingModel->setFilter(text.trimmed());
+    });
+
     connect(searchBar, &QLineEdit::returnPressed, this, [=] {
         QString currentLocation = locationBar->text();
         QString query = searchBar->text().trimmed();
 
         if (!query.isEmpty()) {
+            const CSearchQuery compiled(query);
+            if (!compiled.isValid()) {
+                QMessageBox::warning(this, "Search", compiled.errorString());
+                return;
+            }
+
             QString searchUri = QString("search:query=%1&location=%2")
             .arg(QUrl::toPercentEncoding(query),
                  QUrl::toPercentEncoding(currentLocation));
@@ -196,8 +324,14 @@ CExplorer::CExplorer() {
 }
 
 void CExplorer::navigateTo(const QString &path) {
+    searchEngine->cancel();
+    activeSearchId = 0;
+    iconService->cancelPending();
+
+    if (!inSearchMode)
+        listingModel->setTopRow(contentView->rowAt(0));
     if (inSearchMode) {
-        contentView->setModel(model);
+        contentView->setModel(listingModel);
         inSearchMode = false;
     }
 
@@ -209,8 +343,12 @@ void CExplorer::navigateTo(const QString &path) {
                 forwardHistory.clear();
             }
         }
-        contentView->setRootIndex(QModelIndex());
+        searchBar->clear();
+        diskUsageButton->setChecked(false);
+        listingModel->setDirectory(QString());
+        contentView->scrollToTop();
         locationBar->setText("This PC");
+        prefetchHistory();
         return;
     }
 
@@ -236,6 +374,7 @@ void CExplorer::navigateTo(const QString &path) {
             locationBar->setText("Search Results");
         }
 
+        diskUsageButton->setChecked(false);
         performSearch(query, location);
         return;
     }
@@ -243,8 +382,8 @@ void CExplorer::navigateTo(const QString &path) {
     QString cleanPath = QDir::cleanPath(path);
     QFileInfo info(cleanPath);
     if (!info.exists()) {
-        QModelIndex currentIndex = contentView->rootIndex();
-        locationBar->setText(model->filePath(currentIndex));
+        const QString currentPath = listingModel->directory();
+        locationBar->setText(currentPath.isEmpty() ? QString("This PC") : currentPath);
         return;
     }
 
@@ -257,56 +396,50 @@ void CExplorer::navigateTo(const QString &path) {
     }
 
     if (info.isDir()) {
-        QModelIndex index = model->index(cleanPath);
-        if (index.isValid()) {
-            contentView->setRootIndex(index);
-            locationBar->setText(model->filePath(index));
-        }
+        searchBar->clear();
+        listingModel->setDirectory(cleanPath);
+        const QModelIndex top = listingModel->topIndex();
+        if (top.isValid())
+            contentView->scrollTo(top, QAbstractItemView::PositionAtTop);
+        else
+            contentView->scrollToTop();
+        locationBar->setText(cleanPath);
+        if (diskUsageButton->isChecked())
+            diskUsageView->showPath(cleanPath);
+        prefetchHistory();
     } else if (info.isFile()) {
         QDesktopServices::openUrl(QUrl::fromLocalFile(cleanPath));
     }
 }
 
+void CExplorer::prefetchHistory() {
+    QStringList paths;
+    for (const QStack<QString> *history : {&backHistory, &forwardHistory}) {
+        int taken = 0;
+        for (int i = history->size() - 1; i >= 0 && taken < 2; --i) {
+            const QString &entry = history->at(i);
+            if (entry.isEmpty() || entry == "This PC" || entry.startsWith("search:")
+                || entry.startsWith("Search Results"))
+                continue;
+            paths.append(entry);
+            ++taken;
+        }
+    }
+    listingModel->prefetch(paths);
+}
+
 void CExplorer::performSearch(const QString &query, const QString &location) {
     if (location.isEmpty()) return;
 
-    QModelIndex rootIndex = model->index(location);
-    if (!rootIndex.isValid()) return;
+    QFileInfo rootInfo(location);
+    if (!rootInfo.isDir()) return;
 
-    searchResultsModel->clear();
-    searchResultsModel->setHorizontalHeaderLabels({"Name", "Size", "Type", "Date Modified", "Path"});
-
-    std::function<void(const QModelIndex&)> searchRecursive = [&](const QModelIndex &parent) {
-        int rowCount = model->rowCount(parent);
-        for (int row = 0; row < rowCount; ++row) {
-            QModelIndex index = model->index(row, 0, parent);
-            QString name = model->fileName(index);
-
-            if (name.contains(query, Qt::CaseInsensitive)) {
-                QFileInfo info = model->fileInfo(index);
-
-                QStandardItem *nameItem = new QStandardItem(model->fileIcon(index), name);
-                QStandardItem *sizeItem = new QStandardItem(info.isDir() ? "" : QString::number(info.size()));
-                QStandardItem *typeItem = new QStandardItem(model->type(index));
-                QStandardItem *dateItem = new QStandardItem(info.lastModified().toString("yyyy-MM-dd hh:mm"));
-                QStandardItem *pathItem = new QStandardItem(info.absoluteFilePath());
-
-                nameItem->setEditable(false);
-                sizeItem->setEditable(false);
-                typeItem->setEditable(false);
-                dateItem->setEditable(false);
-                pathItem->setEditable(false);
-
-                searchResultsModel->appendRow({nameItem, sizeItem, typeItem, dateItem, pathItem});
-            }
+    const CSearchQuery compiled(query);
+    if (!compiled.isValid()) return;
 
-            if (model->isDir(index)) {
-                searchRecursive(index);
-            }
-        }
-    };
+    searchResultsModel->clear();
 
-    searchRecursive(rootIndex);
+    activeSearchId = searchEngine->start(compiled, rootInfo.absoluteFilePath());
 
     contentView->setModel(searchResultsModel);
     contentView->setRootIndex(QModelIndex());
@@ -314,10 +447,17 @@ void CExplorer::performSearch(const QString &query, const QString &location) {
     contentView->setColumnWidth(1, 100);
     contentView->setColumnWidth(2, 150);
     contentView->setColumnWidth(3, 150);
+    contentView->setColumnHidden(CSearchResultsModel::MatchColumn, compiled.contentText().isEmpty());
 
     inSearchMode = true;
 }
 
+void CExplorer::appendSearchResults(quint64 searchId, const QList<CSearchResult> &results) {
+    if (searchId != activeSearchId) return;
+
+    searchResultsModel->append(results);
+}
+
 void CExplorer::populatePinnedFolders()
 {
     struct Item { QString name; QString path; };
@@ -338,16 +478,47 @@ void CExplorer::populatePinnedFolders()
         if (it.path.isEmpty())
             wItem->setIcon(QIcon(":/icons/pc.png"));
         else
-            wItem->setIcon(iconProv.icon(QFileInfo(it.path)));
+            wItem->setIcon(iconService->icon(it.path, QFileIconProvider::Folder));
         pinnedList->addItem(wItem);
     }
+
+    const QString trashPath = CTrash::homeTrashFilesPath();
+    if (!trashPath.isEmpty()) {
+        auto *trashItem = new QListWidgetItem(iconProv.icon(QFileIconProvider::Trashcan), tr("Trash"));
+        trashItem->setData(Qt::UserRole, trashPath);
+        trashItem->setData(Qt::UserRole + 1, true);
+        pinnedList->addItem(trashItem);
+    }
+}
+
+QString CExplorer::pathForIndex(QAbstractItemView *view, const QModelIndex &index) const {
+    if (!index.isValid()) return QString();
+    if (view == treeView) return model->filePath(index);
+    if (inSearchMode) return searchResultsModel->filePath(index.row());
+    return listingModel->filePath(index);
+}
+
+QStringList CExplorer::selectedPaths() const {
+    QAbstractItemView *view = nullptr;
+    if (treeView->hasFocus())
+        view = treeView;
+    else if (contentView->hasFocus())
+        view = contentView;
+
+    QStringList paths;
+    if (!view) return paths;
+
+    const QModelIndexList rows = view->selectionModel()->selectedRows();
+    for (const QModelIndex &index : rows)
+        paths.append(pathForIndex(view, index));
+    return paths;
 }
 
 void CExplorer::showContextMenu(const QPoint &pos, QAbstractItemView *view) {
-    selectedIndex = view->indexAt(pos);
-    if (!selectedIndex.isValid()) return;
+    selectedPath = pathForIndex(view, view->indexAt(pos));
+    if (selectedPath.isEmpty()) return;
 
-    QString filePath = model->filePath(selectedIndex);
+    QString filePath = selectedPath;
     QFileInfo fileInfo(filePath);
 
     QMenu contextMenu(this);
@@ -356,8 +527,10 @@ void CExplorer::showContextMenu(const QPoint &pos, QAbstractItemView *view) {
         QAction *cutAction = contextMenu.addAction("Cut");
         QAction *copyAction = contextMenu.addAction("Copy");
         QAction *deleteAction = contextMenu.addAction("Delete");
+        QAction *deletePermanentlyAction = contextMenu.addAction("Delete Permanently");
         QAction *renameAction = contextMenu.addAction("Rename");
         QAction *pasteAction = contextMenu.addAction("Paste");
+        contextMenu.addAction(verifyMovesAction);
         QAction *copyPathAction = contextMenu.addAction("Copy File Path");
         QAction *createFileAction = contextMenu.addAction("Create New File");
         QAction *createFolderAction = contextMenu.addAction("Create New Folder");
@@ -366,6 +539,7 @@ void CExplorer::showContextMenu(const QPoint &pos, QAbstractItemView *view) {
         connect(cutAction, &QAction::triggered, this, &CExplorer::cut);
         connect(copyAction, &QAction::triggered, this, &CExplorer::copy);
         connect(deleteAction, &QAction::triggered, this, &CExplorer::deleteItems);
+        connect(deletePermanentlyAction, &QAction::triggered, this, &CExplorer::deleteItemsPermanently);
         connect(renameAction, &QAction::triggered, this, &CExplorer::renameFile);
         connect(pasteAction, &QAction::triggered, this, &CExplorer::paste);
         connect(copyPathAction, &QAction::triggered, this, &CExplorer::copyPath);
@@ -377,25 +551,31 @@ void CExplorer::showContextMenu(const QPoint &pos, QAbstractItemView *view) {
         QAction *cutAction = contextMenu.addAction("Cut");
         QAction *copyAction = contextMenu.addAction("Copy");
         QAction *deleteAction = contextMenu.addAction("Delete");
+        QAction *deletePermanentlyAction = contextMenu.addAction("Delete Permanently");
         QAction *renameAction = contextMenu.addAction("Rename");
         QAction *pasteAction = contextMenu.addAction("Paste");
+        contextMenu.addAction(verifyMovesAction);
         QAction *copyPathAction = contextMenu.addAction("Copy Folder Path");
         QAction *createFileAction = contextMenu.addAction("Create New File");
         QAction *createFolderAction = contextMenu.addAction("Create New Folder");
+        QAction *findDuplicatesAction = contextMenu.addAction("Find Duplicates");
         QAction *propertiesAction = contextMenu.addAction("Properties");
 
         connect(cutAction, &QAction::triggered, this, &CExplorer::cut);
         connect(copyAction, &QAction::triggered, this, &CExplorer::copy);
         connect(deleteAction, &QAction::triggered, this, &CExplorer::deleteItems);
+        connect(deletePermanentlyAction, &QAction::triggered, this, &CExplorer::deleteItemsPermanently);
         connect(renameAction, &QAction::triggered, this, &CExplorer::renameFolder);
         connect(pasteAction, &QAction::triggered, this, &CExplorer::paste);
         connect(copyPathAction, &QAction::triggered, this, &CExplorer::copyPath);
         connect(createFileAction, &QAction::triggered, this, &CExplorer::createFile);
         connect(createFolderAction, &QAction::triggered, this, &CExplorer::createFolder);
+        connect(findDuplicatesAction, &QAction::triggered, this, &CExplorer::findDuplicates);
         connect(propertiesAction, &QAction::triggered, this, &CExplorer::showProperties);
     }
     else {
         QAction *pasteAction = contextMenu.addAction("Paste");
+        contextMenu.addAction(verifyMovesAction);
         QAction *copyPathAction = contextMenu.addAction("Copy Drive Path");
         QAction *createFileAction = contextMenu.addAction("Create New File");
         QAction *createFolderAction = contextMenu.addAction("Create New Folder");
@@ -411,10 +591,10 @@ void CExplorer::showContextMenu(const QPoint &pos, QAbstractItemView *view) {
 }
 
 void CExplorer::renameFile() {
-    if (!selectedIndex.isValid()) return;
+    if (selectedPath.isEmpty()) return;
 
-    QString oldName = model->filePath(selectedIndex);
-    QString newName = QInputDialog::getText(this, "Rename File", "New name:", QLineEdit::Normal, model->fileName(selectedIndex));
+    QString oldName = selectedPath;
+    QString newName = QInputDialog::getText(this, "Rename File", "New name:", QLineEdit::Normal, QFileInfo(oldName).fileName());
 
     if (!newName.isEmpty()) {
         QString newPath = QFileInfo(oldName).absolutePath() + "/" + newName;
@@ -423,101 +603,38 @@ void CExplorer::renameFile() {
 }
 
 void CExplorer::copy() {
-    QModelIndexList selectedIndexes;
-
-    if (treeView->hasFocus())
-        selectedIndexes = treeView->selectionModel()->selectedRows();
-    else if (contentView->hasFocus())
-        selectedIndexes = contentView->selectionModel()->selectedRows();
+    const QStringList paths = selectedPaths();
 
-    if (selectedIndexes.isEmpty()) {
+    if (paths.isEmpty()) {
         QMessageBox::warning(this, "Copy", "No files or folders selected to copy.");
         return;
     }
 
-    QList<QUrl> urls;
-    QSet<QString> addedPaths;
-
-    for (const QModelIndex &index : std::as_const(selectedIndexes)) {
-        QString path = model->filePath(index);
-        if (addedPaths.contains(path)) continue;
-
-        addedPaths.insert(path);
-        urls.append(QUrl::fromLocalFile(path));
-    }
-
-    if (urls.isEmpty()) {
+    clipboardOperation->set(CClipboardOperation::Copy, paths);
+    if (clipboardOperation->isEmpty()) {
         QMessageBox::warning(this, "Copy", "No valid file or folder paths found.");
         return;
     }
 
-    QClipboard *clipboard = QGuiApplication::clipboard();
-    QMimeData *mimeData = new QMimeData();
-    mimeData->setUrls(urls);
-    clipboard->setMimeData(mimeData);
+    QGuiApplication::clipboard()->setMimeData(clipboardOperation->createMimeData());
 
     QMessageBox::information(this, "Copy", "Copied to clipboard!");
 }
 
 void CExplorer::cut() {
-    QModelIndexList selectedIndexes;
+    const QStringList paths = selectedPaths();
 
-    if (treeView->hasFocus())
-        selectedIndexes = treeView->selectionModel()->selectedRows();
-    else if (contentView->hasFocus())
-        selectedIndexes = contentView->selectionModel()->selectedRows();
-
-    if (selectedIndexes.isEmpty()) return;
+    if (paths.isEmpty()) return;
 
-    cutPaths.clear();
-    QList<QUrl> urlList;
-
-    for (const QModelIndex &index : std::as_const(selectedIndexes)) {
-        QString path = model->filePath(index);
-        cutPaths << path;
-        urlList << QUrl::fromLocalFile(path);
-    }
-
-    QMimeData *mimeData = new QMimeData();
-    mimeData->setUrls(urlList);
-
-    QGuiApplication::clipboard()->setMimeData(mimeData);
-    isCutOperation = true;
-
-    static_cast<CFileSystemModel *>(model)->setCutPaths(cutPaths);
-}
-
-bool CExplorer::copyFolderRecursively(const QString &sourceFolder, const QString &destinationFolder) {
-    QDir sourceDir(sourceFolder);
-    if (!sourceDir.exists())
-        return false;
-
-    QDir destDir(destinationFolder);
-    if (!destDir.exists()) {
-        if (!destDir.mkpath(".")) return false;
-    }
-
-    QFileInfoList entries = sourceDir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries);
-    for (const QFileInfo &entry : std::as_const(entries)) {
-        QString srcPath = entry.absoluteFilePath();
-        QString destPath = destinationFolder + QDir::separator() + entry.fileName();
-
-        if (entry.isDir()) {
-            if (!copyFolderRecursively(srcPath, destPath))
-                return false;
-        } else {
-            if (!QFile::copy(srcPath, destPath))
-                return false;
-        }
-    }
-    return true;
+    clipboardOperation->set(CClipboardOperation::Cut, paths);
+    QGuiApplication::clipboard()->setMimeData(clipboardOperation->createMimeData());
 }
 
 void CExplorer::paste() {
-    if (!selectedIndex.isValid()) return;
+    if (selectedPath.isEmpty()) return;
 
     QString destinationDirPath;
-    QFileInfo selectedInfo(model->filePath(selectedIndex));
+    QFileInfo selectedInfo(selectedPath);
 
     if (selectedInfo.isDir()) {
         destinationDirPath = selectedInfo.absoluteFilePath();
@@ -525,193 +642,185 @@ void CExplorer::paste() {
         destinationDirPath = selectedInfo.absolutePath();
     }
 
-    const QClipboard *clipboard = QGuiApplication::clipboard();
+    QClipboard *clipboard = QGuiApplication::clipboard();
     const QMimeData *mimeData = clipboard->mimeData();
 
-    if (!mimeData->hasUrls()) {
-        QMessageBox::warning(this, "Paste", "Clipboard does not contain any valid files or folders.");
-        return;
-    }
+    QStringList sourcePaths;
+    bool isCut = false;
 
-    QList<QUrl> urls = mimeData->urls();
-    if (urls.isEmpty()) {
-        QMessageBox::warning(this, "Paste", "No items found in clipboard.");
-        return;
+    if (clipboardOperation->matches(mimeData)) {
+        sourcePaths = clipboardOperation->pendingPaths(destinationDirPath);
+        isCut = clipboardOperation->isCut();
+        if (sourcePaths.isEmpty()) {
+            QMessageBox::information(this, "Paste", "All items have already been pasted here.");
+            return;
+        }
+    } else {
+        if (!mimeData || !mimeData->hasUrls()) {
+            QMessageBox::warning(this, "Paste", "Clipboard does not contain any valid files or folders.");
+            return;
+        }
+
+        const QList<QUrl> urls = mimeData->urls();
+        for (const QUrl &url : urls) {
+            if (url.isLocalFile())
+                sourcePaths.append(url.toLocalFile());
+        }
+        if (sourcePaths.isEmpty()) {
+            QMessageBox::warning(this, "Paste", "No items found in clipboard.");
+            return;
+        }
     }
 
-    for (const QUrl &url : std::as_const(urls)) {
-        QString sourcePath = url.toLocalFile();
+    QList<CCopyJob::Item> copyItems;
+    QList<CCopyJob::Item> moveItems;
+    QStringList problems;
+
+    for (const QString &sourcePath : std::as_const(sourcePaths)) {
         QFileInfo sourceInfo(sourcePath);
 
         if (!sourceInfo.exists()) {
-            QMessageBox::warning(this, "Paste", "Source item does not exist:\n" + sourcePath);
+            problems.append("Source item does not exist:\n" + sourcePath);
             continue;
         }
 
-        QString originalName = sourceInfo.fileName();
-        QString targetPath = destinationDirPath + QDir::separator() + originalName;
+        QString targetPath = destinationDirPath + QDir::separator() + sourceInfo.fileName();
 
-        if (isCutOperation && cutPaths.contains(sourcePath) &&
-            sourceInfo.absoluteFilePath() == QFileInfo(targetPath).absoluteFilePath()) {
+        if (isCut && sourceInfo.absoluteFilePath() == QFileInfo(targetPath).absoluteFilePath()) {
+            clipboardOperation->markDone(sourcePath, destinationDirPath);
             continue;
         }
 
-        QString baseName;
-        QString extension;
-        bool isFile = sourceInfo.isFile();
-        int counter = 1;
-
-        if (isFile) {
-            baseName = sourceInfo.completeBaseName();
-            extension = sourceInfo.suffix();
+        if (sourceInfo.isDir() && QDir::cleanPath(targetPath).startsWith(sourceInfo.absoluteFilePath() + "/")) {
+            problems.append("Cannot paste a folder into itself:\n" + sourcePath);
+            continue;
         }
 
-        bool renameInstead = false;
-        bool cancelThisItem = false;
-
-        if (QFile::exists(targetPath)) {
-            QMessageBox::StandardButton reply = QMessageBox::question(
-                this, "Conflict Detected",
-                QString("The file or folder '%1' already exists in the destination.\n\n"
-                        "Do you want to overwrite it?")
-                    .arg(originalName),
-                QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel,
-                QMessageBox::No
-                );
-
-            if (reply == QMessageBox::Yes) {
-                if (!moveToRecycleBin(targetPath)) {
-                    QMessageBox::warning(this, "Paste", "Failed to delete existing item:\n" + targetPath);
-                    continue;
-                }
-            } else if (reply == QMessageBox::No) {
-                renameInstead = true;
-            } else {
-                cancelThisItem = true;
-            }
+        if (isCut) {
+            moveItems.append({sourcePath, targetPath});
+        } else {
+            copyItems.append({sourcePath, targetPath});
         }
+    }
 
-        if (cancelThisItem) continue;
+    if (!problems.isEmpty()) {
+        QMessageBox::warning(this, "Paste", problems.join("\n\n"));
+    }
 
-        while (renameInstead && QFile::exists(targetPath)) {
-            QString newName;
-            if (isFile) {
-                newName = QString("%1_%2%3").arg(baseName).arg(counter++)
-                .arg(extension.isEmpty() ? "" : "." + extension);
-            } else {
-                newName = QString("%1_%2").arg(originalName).arg(counter++);
-            }
+    if (!moveItems.isEmpty()) {
+        CCopyJob *moveJob = new CCopyJob(moveItems, CCopyJob::Move);
+        moveJob->setVerify(verifyMovesAction->isChecked());
+        enqueueCopyJob(moveJob, destinationDirPath);
+    }
+    if (!copyItems.isEmpty()) {
+        enqueueCopyJob(new CCopyJob(copyItems, CCopyJob::Copy), destinationDirPath);
+    }
+}
 
-            targetPath = destinationDirPath + QDir::separator() + newName;
+void CExplorer::enqueueCopyJob(CCopyJob *job, const QString &destinationDirPath) {
+    connect(job, &CCopyJob::conflictsFound, this, [this, job](const QList<CCopyJob::Item> &conflicts) {
+        CConflictDialog dialog(conflicts, this);
+        if (dialog.exec() == QDialog::Accepted) {
+            job->resolveConflicts(dialog.resolutions());
+        } else {
+            job->cancel();
         }
+    });
 
-        bool success = false;
+    // Completed items are marked on the clipboard operation they came from, so
+    // pasting again after a cancel or failure only picks up what is left.
+    const quint64 operationId = clipboardOperation->id();
+    connect(job, &CCopyJob::itemCompleted, this, [this, operationId, destinationDirPath](const CCopyJob::Item &item) {
+        if (clipboardOperation->id() != operationId) return;
 
-        if (isCutOperation && cutPaths.contains(sourcePath)) {
-            if (sourceInfo.isFile()) {
-                success = QFile::rename(sourcePath, targetPath);
-            } else if (sourceInfo.isDir()) {
-                QDir sourceDir(sourcePath);
-                success = sourceDir.rename(sourcePath, targetPath);
-            }
-        } else {
-            if (sourceInfo.isFile()) {
-                success = QFile::copy(sourcePath, targetPath);
-            } else if (sourceInfo.isDir()) {
-                success = copyFolderRecursively(sourcePath, targetPath);
-            }
-        }
+        QClipboard *clipboard = QGuiApplication::clipboard();
+        const bool ownsClipboard = clipboardOperation->matches(clipboard->mimeData());
 
-        if (!success) {
-            QMessageBox::warning(this, "Paste", "Failed to paste:\n" + sourcePath);
+        clipboardOperation->markDone(item.source, destinationDirPath);
+        if (clipboardOperation->isCut() && clipboardOperation->isEmpty()) {
+            if (ownsClipboard)
+                clipboard->clear();
+            clipboardOperation->clear();
         }
-    }
+    });
+
+    jobQueue->enqueue(job);
+}
 
-    cutPaths.clear();
-    isCutOperation = false;
-    static_cast<CFileSystemModel *>(model)->clearCutPaths();
+void CExplorer::reportJobErrors(CFileJob *job, bool, const QStringList &errors) {
+    if (errors.isEmpty()) return;
 
-    QMessageBox::information(this, "Paste", "Paste operation completed.");
+    QMessageBox box(QMessageBox::Warning, job->description(),
+                    QString("%1 problem%2 occurred. The remaining items were processed.")
+                        .arg(errors.size())
+                        .arg(errors.size() == 1 ? "" : "s"),
+                    QMessageBox::Ok, this);
+    box.setDetailedText(errors.join("\n\n"));
+    box.exec();
 }
 
-bool CExplorer::moveToRecycleBin(const QString &path) {
-    QFileInfo fileInfo(path);
+void CExplorer::deleteItems() {
+    removeSelectedItems(CTrash::isSupported() ? CDeleteJob::Trash : CDeleteJob::Permanent);
+}
 
-#ifdef Q_OS_WIN
-    QString pathWithNull = QDir::toNativeSeparators(path) + '\0';
+void CExplorer::deleteItemsPermanently() {
+    removeSelectedItems(CDeleteJob::Permanent);
+}
 
-    SHFILEOPSTRUCT fileOp = {};
-    fileOp.wFunc = FO_DELETE;
-    fileOp.pFrom = reinterpret_cast<LPCWSTR>(pathWithNull.utf16());
-    fileOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION | FOF_SILENT;
+void CExplorer::removeSelectedItems(CDeleteJob::Mode mode) {
+    const QStringList selected = selectedPaths();
 
-    if (SHFileOperation(&fileOp) == 0) {
-        return true;
-    }
-#endif
+    if (selected.isEmpty()) return;
 
-    if (fileInfo.isDir()) {
-        QDir dir(path);
-        return dir.removeRecursively();
-    } else {
-        return QFile::remove(path);
-    }
-}
+    const QString count = selected.count() == 1 ? "" : QString::number(selected.count()) + " ";
+    const QString plural = selected.count() > 1 ? "s" : "";
 
-void CExplorer::deleteItems() {
-    QModelIndexList selectedIndexes;
+    QMessageBox::StandardButton confirm = mode == CDeleteJob::Trash
+        ? QMessageBox::question(
+              this, "Delete",
+              QString("Move the selected %1item%2 to the trash?").arg(count, plural),
+              QMessageBox::Yes | QMessageBox::No)
+        : QMessageBox::warning(
+              this, "Delete",
+              QString("Are you sure you want to delete the selected %1item%2?\nThis action cannot be undone.")
+                  .arg(count, plural),
+              QMessageBox::Yes | QMessageBox::No);
 
-    if (treeView->hasFocus())
-        selectedIndexes = treeView->selectionModel()->selectedRows();
-    else if (contentView->hasFocus())
-        selectedIndexes = contentView->selectionModel()->selectedRows();
+    if (confirm != QMessageBox::Yes) return;
+
+    QStringList paths;
+    for (const QString &path : selected) {
+        if (!paths.contains(path))
+            paths.append(path);
+    }
 
-    if (selectedIndexes.isEmpty()) return;
+    jobQueue->enqueue(new CDeleteJob(paths, mode));
+}
 
+void CExplorer::emptyTrash() {
     QMessageBox::StandardButton confirm = QMessageBox::warning(
-        this, "Delete",
-        QString("Are you sure you want to delete the selected %1item%2?\nThis action cannot be undone.")
-            .arg(selectedIndexes.count() == 1 ? "" : QString::number(selectedIndexes.count()) + " ",
-                    selectedIndexes.count() > 1 ? "s" : ""),
+        this, "Empty Trash",
+        "Are you sure you want to permanently delete all items in the trash?\nThis action cannot be undone.",
         QMessageBox::Yes | QMessageBox::No
         );
 
     if (confirm != QMessageBox::Yes) return;
 
-    for (const QModelIndex &index : std::as_const(selectedIndexes)) {
-        QString path = model->filePath(index);
-        QFileInfo fileInfo(path);
-
-#ifdef Q_OS_WIN
-        QString pathWithNull = QDir::toNativeSeparators(path) + '\0';
-
-        SHFILEOPSTRUCT fileOp = {};
-        fileOp.wFunc = FO_DELETE;
-        fileOp.pFrom = reinterpret_cast<LPCWSTR>(pathWithNull.utf16());
-        fileOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION | FOF_SILENT;
+    jobQueue->enqueue(new CDeleteJob(QStringList(), CDeleteJob::EmptyTrash));
+}
 
-        if (SHFileOperation(&fileOp) == 0) {
-            continue;
-        }
-#endif
+void CExplorer::expungeTrash(const QStringList &stagedPaths) {
+    if (stagedPaths.isEmpty()) return;
 
-        if (fileInfo.isDir()) {
-            QDir dir(path);
-            if (!dir.removeRecursively()) {
-                QMessageBox::warning(this, "Error", "Failed to delete folder:\n" + path);
-            }
-        } else {
-            if (!QFile::remove(path)) {
-                QMessageBox::warning(this, "Error", "Failed to delete file:\n" + path);
-            }
-        }
-    }
+    CDeleteJob *job = new CDeleteJob(stagedPaths, CDeleteJob::Permanent);
+    job->setDescription("Emptying the trash");
+    jobQueue->enqueue(job);
 }
 
 void CExplorer::renameFolder() {
-    if (!selectedIndex.isValid()) return;
+    if (selectedPath.isEmpty()) return;
 
-    QString oldPath = model->filePath(selectedIndex);
+    QString oldPath = selectedPath;
     QFileInfo folderInfo(oldPath);
 
     if (!folderInfo.isDir()) return;
@@ -734,9 +843,9 @@ void CExplorer::renameFolder() {
 }
 
 void CExplorer::copyPath() {
-    if (!selectedIndex.isValid()) return;
+    if (selectedPath.isEmpty()) return;
 
-    QString path = model->filePath(selectedIndex);
+    QString path = selectedPath;
 
     QClipboard *clipboard = QApplication::clipboard();
     clipboard->setText(path);
@@ -745,9 +854,9 @@ void CExplorer::copyPath() {
 }
 
 void CExplorer::createFile() {
-    if (!selectedIndex.isValid()) return;
+    if (selectedPath.isEmpty()) return;
 
-    QString dirPath = model->filePath(selectedIndex);
+    QString dirPath = selectedPath;
     QFileInfo info(dirPath);
 
     if (info.isFile()) {
@@ -795,9 +904,9 @@ void CExplorer::createFile() {
 }
 
 void CExplorer::createFolder() {
-    if (!selectedIndex.isValid()) return;
+    if (selectedPath.isEmpty()) return;
 
-    QString dirPath = model->filePath(selectedIndex);
+    QString dirPath = selectedPath;
     QFileInfo info(dirPath);
 
     if (info.isFile()) {
@@ -835,10 +944,21 @@ void CExplorer::createFolder() {
     }
 }
 
+void CExplorer::findDuplicates() {
+    if (selectedPath.isEmpty()) return;
+
+    CDuplicatesDialog *dialog = new CDuplicatesDialog(duplicateFinder, selectedPath, this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    connect(dialog, &CDuplicatesDialog::showInFolder, this, [this](const QString &path) {
+        navigateTo(QFileInfo(path).absolutePath());
+    });
+    dialog->show();
+}
+
 void CExplorer::showProperties() {
-    if (!selectedIndex.isValid()) return;
+    if (selectedPath.isEmpty()) return;
 
-    QString path = model->filePath(selectedIndex);
+    QString path = selectedPath;
 
 #ifdef Q_OS_WIN
     SHELLEXECUTEINFOW sei = {};
@@ -852,6 +972,12 @@ void CExplorer::showProperties() {
         QMessageBox::warning(this, "Error", "Failed to open properties.");
     }
 #else
-    QMessageBox::information(this, "Unsupported", "Properties are only supported on Windows.");
+    // A whole selection is shown together when the clicked item is part of it.
+    QStringList paths = selectedPaths();
+    if (!paths.contains(path)) paths = QStringList{path};
+
+    CPropertiesDialog *dialog = new CPropertiesDialog(paths, this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
 #endif
 }
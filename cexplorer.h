@@ -1,18 +1,34 @@
 #ifndef CEXPLORER_H
 #define CEXPLORER_H
 
+#include "cchangewatcher.h"
+#include "cclipboardoperation.h"
+#include "cdirlistingmodel.h"
+#include "cdiskusageview.h"
+#include "cduplicatefinder.h"
 #include "cfilesystemmodel.h"
+#include "cfoldersizeprovider.h"
+#include "ciconservice.h"
+#include "csearchengine.h"
+#include "csearchindex.h"
+#include "csearchresultsmodel.h"
+#include "ccopyjob.h"
+#include "cdeletejob.h"
+#include "cjobqueue.h"
+#include "ctransfermanager.h"
 
 #include <QMainWindow>
 #include <QTreeView>
 #include <QTableView>
+#include <QThreadPool>
+#include <QStackedWidget>
 #include <QToolButton>
+#include <QAction>
 #include <QStack>
 #include <QLineEdit>
 #include <QListWidget>
 #include <QStandardPaths>
 #include <QFileIconProvider>
-#include <QStandardItemModel>
 
 class CExplorer : public QMainWindow {
     Q_OBJECT
@@ -23,25 +39,35 @@ public:
 private slots:
     void navigateTo(const QString &path);
     void performSearch(const QString &query, const QString &location);
+    void appendSearchResults(quint64 searchId, const QList<CSearchResult> &results);
     void showContextMenu(const QPoint &pos, QAbstractItemView *view);
     void renameFile();
     void copy();
     void cut();
-    bool copyFolderRecursively(const QString &sourceFolder, const QString &destinationFolder);
     void paste();
-    bool moveToRecycleBin(const QString &path);
     void deleteItems();
+    void deleteItemsPermanently();
+    void emptyTrash();
     void renameFolder();
     void copyPath();
     void createFile();
     void createFolder();
+    void findDuplicates();
     void showProperties();
+    void reportJobErrors(CFileJob *job, bool success, const QStringList &errors);
 
 private:
     CFileSystemModel *model;
+    CDirListingModel *listingModel;
+    CChangeWatcher *changeWatcher;
+    CFolderSizeProvider *folderSizeProvider;
+    CDuplicateFinder *duplicateFinder;
+    CIconService *iconService;
 
     QToolButton *backButton;
     QToolButton *forwardButton;
+    QToolButton *diskUsageButton;
+    QAction *verifyMovesAction;
 
     QStack<QString> backHistory;
     QStack<QString> forwardHistory;
@@ -50,18 +76,34 @@ private:
     QListWidget *pinnedList;
     QTreeView *treeView;
     QTableView *contentView;
+    CDiskUsageView *diskUsageView;
+    QStackedWidget *contentStack;
 
     QLineEdit *locationBar;
 
+    CJobQueue *jobQueue;
+    CTransferManager *transferManager;
+
     QLineEdit *searchBar;
-    QStandardItemModel *searchResultsModel;
+    CSearchResultsModel *searchResultsModel;
+    CSearchEngine *searchEngine;
+    CSearchIndex *searchIndex;
+    quint64 activeSearchId = 0;
     bool inSearchMode = false;
 
-    QModelIndex selectedIndex;
-    QStringList cutPaths;
-    bool isCutOperation = false;
+    QString selectedPath;
+    CClipboardOperation *clipboardOperation;
+
+    QThreadPool trashPool;
 
     void populatePinnedFolders();
+    QString pathForIndex(QAbstractItemView *view, const QModelIndex &index) const;
+    QStringList selectedPaths() const;
+    void enqueueCopyJob(CCopyJob *job, const QString &destinationDirPath);
+    void removeSelectedItems(CDeleteJob::Mode mode);
+    // Lists the folders next in back/forward history ahead of time.
+    void prefetchHistory();
+    void expungeTrash(const QStringList &stagedPaths);
 };
 
 #endif // CEXPLORER_H
@@ -0,0 +1,443 @@
+#include "cfilecopier.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+constexpr qint64 kBufferSize = 1024 * 1024;
+constexpr qint64 kKernelChunk = 8 * 1024 * 1024;
+
+enum class Result {
+    Done,
+    Unsupported,
+    Failed,
+    Cancelled
+};
+
+// Reads into one buffer while the other is being written on a second thread.
+template<typename Read, typename Write>
+Result pipelinedCopy(Read read, Write write, const CFileCopier::Progress &progress) {
+    struct Slot {
+        std::vector<char> data;
+        qint64 length = 0;
+        bool full = false;
+    };
+
+    Slot slots[2];
+    slots[0].data.resize(kBufferSize);
+    slots[1].data.resize(kBufferSize);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop = false;
+    Result result = Result::Done;
+
+    std::thread writer([&] {
+        for (int i = 0;; i ^= 1) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return slots[i].full || stop; });
+            if (stop) return;
+            const qint64 length = slots[i].length;
+            lock.unlock();
+
+            if (length == 0) return;
+
+            const bool written = write(slots[i].data.data(), length);
+            const bool keepGoing = written && (!progress || progress(length));
+
+            lock.lock();
+            slots[i].full = false;
+            if (!keepGoing) {
+                result = written ? Result::Cancelled : Result::Failed;
+                stop = true;
+            }
+            cv.notify_all();
+            if (stop) return;
+        }
+    });
+
+    for (int i = 0;; i ^= 1) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return !slots[i].full || stop; });
+        if (stop) break;
+        lock.unlock();
+
+        const qint64 length = read(slots[i].data.data(), kBufferSize);
+
+        lock.lock();
+        if (length < 0) {
+            result = Result::Failed;
+            stop = true;
+            cv.notify_all();
+            break;
+        }
+        slots[i].length = length;
+        slots[i].full = true;
+        cv.notify_all();
+        if (length == 0) break;
+    }
+
+    writer.join();
+    return result;
+}
+
+#ifdef Q_OS_LINUX
+Result kernelCopy(int in, int out, bool useSendFile, const CFileCopier::Progress &progress, int &error) {
+    qint64 copied = 0;
+    while (true) {
+        const ssize_t bytes = useSendFile ? ::sendfile(out, in, nullptr, kKernelChunk)
+                                          : ::copy_file_range(in, nullptr, out, nullptr, kKernelChunk, 0);
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            if (copied == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL
+                                || errno == EOPNOTSUPP || errno == EBADF)) {
+                return Result::Unsupported;
+            }
+            error = errno;
+            return Result::Failed;
+        }
+        if (bytes == 0) return Result::Done;
+
+        copied += bytes;
+        if (progress && !progress(bytes)) return Result::Cancelled;
+    }
+}
+
+bool writeAt(int out, const char *data, qint64 size, qint64 offset, int &error) {
+    while (size > 0) {
+        const ssize_t bytes = ::pwrite(out, data, size_t(size), off_t(offset));
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            error = errno;
+            return false;
+        }
+        data += bytes;
+        size -= bytes;
+        offset += bytes;
+    }
+    return true;
+}
+
+// Copies the data extents found with SEEK_DATA and SEEK_HOLE and leaves the
+// holes between them unwritten, so a thin image stays thin. Holes count
+// towards progress like data does.
+Result sparseCopy(int in, int out, qint64 size, const CFileCopier::Progress &progress, qint64 &copied,
+                  int &error) {
+    std::vector<char> buffer;
+    bool useCopyRange = true;
+    qint64 offset = 0;
+
+    while (offset < size) {
+        off_t dataStart = ::lseek(in, off_t(offset), SEEK_DATA);
+        if (dataStart < 0) {
+            if (errno == ENXIO) {
+                // Nothing but a hole up to the end.
+                dataStart = off_t(size);
+            } else if (offset == 0 && (errno == EINVAL || errno == EOPNOTSUPP)) {
+                return Result::Unsupported;
+            } else {
+                error = errno;
+                return Result::Failed;
+            }
+        }
+        const qint64 dataBegin = qMin(qint64(dataStart), size);
+        if (dataBegin > offset && progress && !progress(dataBegin - offset)) return Result::Cancelled;
+        if (dataBegin >= size) break;
+
+        const off_t holeStart = ::lseek(in, dataStart, SEEK_HOLE);
+        if (holeStart < 0) {
+            error = errno;
+            return Result::Failed;
+        }
+        const qint64 dataEnd = qMin(qint64(holeStart), size);
+
+        loff_t from = dataBegin;
+        loff_t to = dataBegin;
+        while (from < dataEnd) {
+            const qint64 length = dataEnd - from;
+            ssize_t bytes;
+            if (useCopyRange) {
+                bytes = ::copy_file_range(in, &from, out, &to, size_t(qMin(length, kKernelChunk)), 0);
+                if (bytes < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                    useCopyRange = false;
+                    continue;
+                }
+            } else {
+                if (buffer.empty()) buffer.resize(kBufferSize);
+                bytes = ::pread(in, buffer.data(), size_t(qMin(length, kBufferSize)), off_t(from));
+                if (bytes > 0) {
+                    if (!writeAt(out, buffer.data(), bytes, to, error)) return Result::Failed;
+                    from += bytes;
+                    to += bytes;
+                }
+            }
+            if (bytes < 0) {
+                if (errno == EINTR) continue;
+                error = errno;
+                return Result::Failed;
+            }
+            // The file was truncated while it was copied.
+            if (bytes == 0) break;
+
+            copied += bytes;
+            if (progress && !progress(bytes)) return Result::Cancelled;
+        }
+        offset = dataEnd;
+    }
+
+    // A hole at the end is made by the length alone.
+    if (::ftruncate(out, off_t(size)) != 0) {
+        error = errno;
+        return Result::Failed;
+    }
+    return Result::Done;
+}
+#endif
+}
+
+#ifdef Q_OS_LINUX
+bool CFileCopier::copyAt(int sourceDirFd, const char *sourceName, int targetDirFd, const char *targetName,
+                         const Progress &progress, QString *errorString, Report *report) {
+    auto fail = [errorString](const QString &message) {
+        if (errorString) *errorString = message;
+        return false;
+    };
+
+    // O_NONBLOCK keeps a FIFO that took the place of a file from blocking
+    // the open; anything but a regular file is turned away below.
+    const int in = ::openat(sourceDirFd, sourceName, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (in < 0) return fail(QString::fromLocal8Bit(std::strerror(errno)));
+
+    struct stat st;
+    if (::fstat(in, &st) != 0) {
+        const int error = errno;
+        ::close(in);
+        return fail(QString::fromLocal8Bit(std::strerror(error)));
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ::close(in);
+        return fail(QString("Not a regular file"));
+    }
+
+    const int out = ::openat(targetDirFd, targetName, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (out < 0) {
+        const int error = errno;
+        ::close(in);
+        return fail(QString::fromLocal8Bit(std::strerror(error)));
+    }
+
+    Result result = Result::Unsupported;
+    Method used = Clone;
+    qint64 physical = 0;
+    int error = 0;
+
+    // A clone shares the blocks, holes included, on file systems with
+    // copy-on-write such as btrfs and XFS.
+    if (st.st_size > 0 && ::ioctl(out, FICLONE, in) == 0) {
+        result = (!progress || progress(st.st_size)) ? Result::Done : Result::Cancelled;
+    }
+    // Fewer blocks than the size needs means the file has holes.
+    if (result == Result::Unsupported && qint64(st.st_blocks) * 512 < qint64(st.st_size)) {
+        used = SparseCopy;
+        result = sparseCopy(in, out, st.st_size, progress, physical, error);
+    }
+    if (result == Result::Unsupported) {
+        used = CopyFileRange;
+        physical = st.st_size;
+        result = kernelCopy(in, out, false, progress, error);
+    }
+    if (result == Result::Unsupported) {
+        used = SendFile;
+        result = kernelCopy(in, out, true, progress, error);
+    }
+    if (result == Result::Unsupported) {
+        used = ReadWrite;
+        result = pipelinedCopy(
+            [in, &error](char *data, qint64 size) -> qint64 {
+                ssize_t bytes;
+                do {
+                    bytes = ::read(in, data, size_t(size));
+                } while (bytes < 0 && errno == EINTR);
+                if (bytes < 0) error = errno;
+                return bytes;
+            },
+            [out, &error](const char *data, qint64 size) {
+                while (size > 0) {
+                    const ssize_t bytes = ::write(out, data, size_t(size));
+                    if (bytes < 0) {
+                        if (errno == EINTR) continue;
+                        error = errno;
+                        return false;
+                    }
+                    data += bytes;
+                    size -= bytes;
+                }
+                return true;
+            },
+            progress);
+    }
+
+    if (result == Result::Done)
+        ::fchmod(out, st.st_mode & 07777);
+
+    ::close(in);
+    if (::close(out) != 0 && result == Result::Done) {
+        error = errno;
+        result = Result::Failed;
+    }
+
+    if (report) {
+        report->method = used;
+        report->logicalBytes = st.st_size;
+        report->physicalBytes = physical;
+    }
+
+    if (result != Result::Done) {
+        ::unlinkat(targetDirFd, targetName, 0);
+        if (result == Result::Cancelled) return fail(QString("Cancelled"));
+        return fail(QString::fromLocal8Bit(std::strerror(error ? error : EIO)));
+    }
+    return true;
+}
+#endif
+
+bool CFileCopier::copy(const QString &source, const QString &target, const Progress &progress,
+                       QString *errorString, Report *report) {
+#ifdef Q_OS_LINUX
+    return copyAt(AT_FDCWD, QFile::encodeName(source).constData(),
+                  AT_FDCWD, QFile::encodeName(target).constData(),
+                  progress, errorString, report);
+#else
+    auto fail = [errorString](const QString &message) {
+        if (errorString) *errorString = message;
+        return false;
+    };
+
+    if (!QFileInfo(source).isFile()) return fail(QString("Not a regular file"));
+
+    QFile in(source);
+    if (!in.open(QIODevice::ReadOnly)) return fail(in.errorString());
+
+    if (QFile::exists(target)) return fail(QString("Destination already exists"));
+
+    QFile out(target);
+    if (!out.open(QIODevice::WriteOnly)) return fail(out.errorString());
+
+    const Result result = pipelinedCopy(
+        [&in](char *data, qint64 size) { return in.read(data, size); },
+        [&out](const char *data, qint64 size) { return out.write(data, size) == size; },
+        progress);
+
+    out.close();
+    if (result != Result::Done) {
+        out.remove();
+        if (result == Result::Cancelled) return fail(QString("Cancelled"));
+        return fail(out.errorString().isEmpty() ? in.errorString() : out.errorString());
+    }
+
+    out.setPermissions(in.permissions());
+    if (report) {
+        report->method = ReadWrite;
+        report->logicalBytes = in.size();
+        report->physicalBytes = in.size();
+    }
+    return true;
+#endif
+}
+
+#ifdef Q_OS_LINUX
+bool CFileCopier::copyLinkAt(int sourceDirFd, const char *sourceName, int targetDirFd, const char *targetName,
+                             QString *errorString) {
+    auto fail = [errorString](int error) {
+        if (errorString) *errorString = QString::fromLocal8Bit(std::strerror(error));
+        return false;
+    };
+
+    std::vector<char> buffer(256);
+    for (;;) {
+        const ssize_t length = ::readlinkat(sourceDirFd, sourceName, buffer.data(), buffer.size());
+        if (length < 0) return fail(errno);
+        if (size_t(length) < buffer.size()) {
+            buffer[size_t(length)] = '\0';
+            break;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+
+    if (::symlinkat(buffer.data(), targetDirFd, targetName) != 0) return fail(errno);
+    return true;
+}
+#endif
+
+bool CFileCopier::copyLink(const QString &source, const QString &target, QString *errorString) {
+#ifdef Q_OS_LINUX
+    return copyLinkAt(AT_FDCWD, QFile::encodeName(source).constData(),
+                      AT_FDCWD, QFile::encodeName(target).constData(), errorString);
+#else
+#if QT_VERSION >= QT_VERSION_CHECK(6, 6, 0)
+    const QString linkTarget = QFileInfo(source).readSymLink();
+#else
+    const QString linkTarget = QFileInfo(source).symLinkTarget();
+#endif
+    if (QFile::link(linkTarget, target)) return true;
+    if (errorString) *errorString = QString("Could not create the link");
+    return false;
+#endif
+}
+
+bool CFileCopier::verify(const QString &source, const QString &target, const Progress &progress,
+                         QString *errorString) {
+    auto fail = [errorString](const QString &message) {
+        if (errorString) *errorString = message;
+        return false;
+    };
+
+    QFile in(source);
+    if (!in.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) return fail(in.errorString());
+    QFile out(target);
+    if (!out.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) return fail(out.errorString());
+    if (in.size() != out.size()) return fail(QString("The copy has a different size"));
+
+#ifdef Q_OS_LINUX
+    ::fdatasync(out.handle());
+    ::posix_fadvise(out.handle(), 0, 0, POSIX_FADV_DONTNEED);
+    ::posix_fadvise(in.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    ::posix_fadvise(out.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    std::vector<char> expected(kBufferSize);
+    std::vector<char> actual(kBufferSize);
+    while (true) {
+        const qint64 length = in.read(expected.data(), kBufferSize);
+        if (length < 0) return fail(in.errorString());
+        if (length == 0) break;
+
+        qint64 done = 0;
+        while (done < length) {
+            const qint64 bytes = out.read(actual.data() + done, length - done);
+            if (bytes < 0) return fail(out.errorString());
+            if (bytes == 0) return fail(QString("The copy is shorter than the original"));
+            done += bytes;
+        }
+        if (std::memcmp(expected.data(), actual.data(), size_t(length)) != 0)
+            return fail(QString("The copy differs from the original"));
+        if (progress && !progress(length)) return fail(QString("Cancelled"));
+    }
+    return true;
+}
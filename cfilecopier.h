@@ -0,0 +1,55 @@
+#ifndef CFILECOPIER_H
+#define CFILECOPIER_H
+
+#include <QString>
+
+#include <functional>
+
+class CFileCopier {
+public:
+    // Called with the number of bytes written since the previous call.
+    // Returning false cancels the copy.
+    using Progress = std::function<bool(qint64 bytes)>;
+
+    enum Method {
+        Clone,
+        // Only the data extents are copied and holes are left as holes.
+        SparseCopy,
+        CopyFileRange,
+        SendFile,
+        ReadWrite
+    };
+
+    struct Report {
+        Method method = ReadWrite;
+        qint64 logicalBytes = 0;
+        // What was actually read and written: less than logicalBytes when
+        // holes were skipped, and 0 for a clone that shares the blocks.
+        qint64 physicalBytes = 0;
+    };
+
+    // Progress counts logical bytes, holes included.
+    static bool copy(const QString &source, const QString &target,
+                     const Progress &progress = Progress(),
+                     QString *errorString = nullptr, Report *report = nullptr);
+
+    // Recreates a symbolic link with the same, possibly relative, target text.
+    static bool copyLink(const QString &source, const QString &target, QString *errorString = nullptr);
+
+    // Compares the contents of two files, reporting progress as copy() does.
+    // On Linux the target is flushed and dropped from the page cache first,
+    // so that what is compared is what reached the disk.
+    static bool verify(const QString &source, const QString &target,
+                       const Progress &progress = Progress(), QString *errorString = nullptr);
+
+#ifdef Q_OS_LINUX
+    // Names are resolved relative to the directory fds, which may be AT_FDCWD.
+    static bool copyAt(int sourceDirFd, const char *sourceName, int targetDirFd, const char *targetName,
+                       const Progress &progress = Progress(),
+                       QString *errorString = nullptr, Report *report = nullptr);
+    static bool copyLinkAt(int sourceDirFd, const char *sourceName, int targetDirFd, const char *targetName,
+                           QString *errorString = nullptr);
+#endif
+};
+
+#endif // CFILECOPIER_H
@@ -0,0 +1,155 @@
+#include "cfilejob.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+namespace {
+constexpr qint64 kPublishIntervalMs = 200;
+}
+
+CFileJob::CFileJob(QObject *parent)
+    : QObject(parent) {
+    qRegisterMetaType<CTransferStats>();
+    qRegisterMetaType<CFileJob::State>();
+}
+
+CFileJob::~CFileJob() {
+    cancel();
+    wait();
+    delete thread;
+}
+
+void CFileJob::start() {
+    if (thread || state() != Queued) return;
+
+    setState(paused ? Paused : Running);
+    clock.start();
+    thread = QThread::create([this] { execute(); });
+    thread->start();
+}
+
+void CFileJob::cancel() {
+    if (cancelled.exchange(true)) return;
+
+    {
+        QMutexLocker locker(&pauseMutex);
+        pauseChanged.wakeAll();
+    }
+
+    if (!thread && state() == Queued) {
+        setState(Finished);
+        emit finished(false, QStringList());
+    }
+}
+
+void CFileJob::pause() {
+    paused = true;
+
+    int expected = Running;
+    if (currentState.compare_exchange_strong(expected, Paused))
+        emit stateChanged(Paused);
+}
+
+void CFileJob::resume() {
+    {
+        QMutexLocker locker(&pauseMutex);
+        paused = false;
+        pauseChanged.wakeAll();
+    }
+
+    int expected = Paused;
+    if (currentState.compare_exchange_strong(expected, Running))
+        emit stateChanged(Running);
+}
+
+void CFileJob::wait() {
+    if (thread)
+        thread->wait();
+}
+
+bool CFileJob::isCancelled() const {
+    return cancelled;
+}
+
+bool CFileJob::isPaused() const {
+    return paused;
+}
+
+CFileJob::State CFileJob::state() const {
+    return State(currentState.load());
+}
+
+CTransferStats CFileJob::stats() const {
+    CTransferStats stats;
+    stats.bytesDone = bytesDone;
+    stats.bytesTotal = bytesTotal;
+    stats.bytesSkipped = bytesSkipped;
+    stats.filesDone = filesDone;
+    stats.filesTotal = filesTotal;
+
+    QMutexLocker locker(&statsMutex);
+    stats.bytesPerSecond = rate;
+    if (rate > 0 && stats.bytesTotal >= stats.bytesDone)
+        stats.etaSeconds = qint64((stats.bytesTotal - stats.bytesDone) / rate);
+    return stats;
+}
+
+bool CFileJob::checkpoint() {
+    if (paused) {
+        QMutexLocker locker(&pauseMutex);
+        while (paused && !cancelled)
+            pauseChanged.wait(&pauseMutex);
+    }
+    return !cancelled;
+}
+
+bool CFileJob::account(qint64 bytes) {
+    bytesDone += bytes;
+    publish(false);
+    return checkpoint();
+}
+
+void CFileJob::addError(const QString &error) {
+    QMutexLocker locker(&errorsMutex);
+    errors.append(error);
+}
+
+void CFileJob::publish(bool force) {
+    if (!force && clock.elapsed() - lastPublishMs < kPublishIntervalMs) return;
+
+    {
+        QMutexLocker locker(&statsMutex);
+        const qint64 now = clock.elapsed();
+        const qint64 elapsed = now - lastPublishMs;
+        if (!force && elapsed < kPublishIntervalMs) return;
+
+        const qint64 done = bytesDone;
+        if (elapsed > 0) {
+            const double instant = double(done - lastPublishBytes) * 1000.0 / double(elapsed);
+            rate = rate > 0 ? rate * 0.7 + instant * 0.3 : instant;
+        }
+        lastPublishMs = now;
+        lastPublishBytes = done;
+    }
+
+    emit progress(stats());
+}
+
+void CFileJob::execute() {
+    run();
+    publish(true);
+
+    QStringList result;
+    if (!cancelled) {
+        QMutexLocker locker(&errorsMutex);
+        result = errors;
+    }
+
+    setState(Finished);
+    emit finished(result.isEmpty() && !cancelled, result);
+}
+
+void CFileJob::setState(State state) {
+    if (currentState.exchange(state) != state)
+        emit stateChanged(state);
+}
@@ -0,0 +1,101 @@
+#ifndef CFILEJOB_H
+#define CFILEJOB_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <QMutex>
+#include <QStringList>
+#include <QWaitCondition>
+
+#include <atomic>
+
+class QThread;
+
+struct CTransferStats {
+    qint64 bytesDone = 0;
+    qint64 bytesTotal = 0;
+    // The part of bytesDone that was never written: holes and cloned extents.
+    qint64 bytesSkipped = 0;
+    qint64 filesDone = 0;
+    qint64 filesTotal = 0;
+    double bytesPerSecond = 0;
+    qint64 etaSeconds = -1;
+};
+
+Q_DECLARE_METATYPE(CTransferStats)
+
+// Base for file operations that run on their own thread. Subclasses implement
+// run(), call checkpoint() between units of work and keep going past failures,
+// collecting them with addError() so they can be reported together.
+class CFileJob : public QObject {
+    Q_OBJECT
+
+public:
+    enum State {
+        Queued,
+        Running,
+        Paused,
+        Finished
+    };
+    Q_ENUM(State)
+
+    explicit CFileJob(QObject *parent = nullptr);
+    ~CFileJob() override;
+
+    void start();
+    void cancel();
+    void pause();
+    void resume();
+    void wait();
+
+    bool isCancelled() const;
+    bool isPaused() const;
+    State state() const;
+
+    virtual QString description() const = 0;
+    CTransferStats stats() const;
+
+signals:
+    void stateChanged(CFileJob::State state);
+    void progress(const CTransferStats &stats);
+    void finished(bool success, const QStringList &errors);
+
+protected:
+    virtual void run() = 0;
+
+    // Blocks while the job is paused. Returns false once it has been cancelled.
+    bool checkpoint();
+    bool account(qint64 bytes);
+    void addError(const QString &error);
+    void publish(bool force);
+
+    std::atomic<qint64> bytesDone{0};
+    std::atomic<qint64> bytesTotal{0};
+    std::atomic<qint64> bytesSkipped{0};
+    std::atomic<qint64> filesDone{0};
+    std::atomic<qint64> filesTotal{0};
+
+private:
+    void execute();
+    void setState(State state);
+
+    QThread *thread = nullptr;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> paused{false};
+    std::atomic<int> currentState{Queued};
+    QMutex pauseMutex;
+    QWaitCondition pauseChanged;
+
+    mutable QMutex statsMutex;
+    QElapsedTimer clock;
+    std::atomic<qint64> lastPublishMs{0};
+    qint64 lastPublishBytes = 0;
+    double rate = 0;
+
+    QMutex errorsMutex;
+    QStringList errors;
+};
+
+#endif // CFILEJOB_H
@@ -0,0 +1,328 @@
+#include "cfileoperations.h"
+#include "cdirwalker.h"
+#include "ctrash.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr size_t kFilesPerChunk = 64;
+}
+
+namespace CFileOperations {
+
+int defaultCopyConcurrency() {
+    bool ok = false;
+    const int configured = qEnvironmentVariableIntValue("CEXPLORER_COPY_THREADS", &ok);
+    if (ok && configured > 0)
+        return configured;
+    return qBound(4, QThread::idealThreadCount() * 2, 32);
+}
+
+bool copyRecursively(const QString &sourceFolder, const QString &destinationFolder,
+                     const CopyOptions &options, QStringList *errors) {
+    QFileInfo sourceInfo(sourceFolder);
+    if (!sourceInfo.isDir())
+        return false;
+
+    if (!QDir().mkpath(destinationFolder))
+        return false;
+
+    const QByteArray sourceRoot = QFile::encodeName(QDir::cleanPath(sourceInfo.absoluteFilePath()));
+    const QByteArray destinationRoot = QFile::encodeName(QDir::cleanPath(QFileInfo(destinationFolder).absoluteFilePath()));
+
+    struct Batch {
+        QByteArray sourceDir;
+        QByteArray targetDir;
+        std::vector<QByteArray> names;
+    };
+
+    CDirWalker walker;
+    QThreadPool pool;
+    pool.setMaxThreadCount(options.concurrency > 0 ? options.concurrency : defaultCopyConcurrency());
+
+    std::atomic<bool> failed{false};
+    std::atomic<bool> stop{false};
+    QMutex mutex;
+    std::deque<Batch> batches;
+    batches.push_back({sourceRoot, destinationRoot, {}});
+
+    auto stopped = [&] {
+        if (!stop && options.isCancelled && options.isCancelled())
+            stop = true;
+        if (stop)
+            walker.cancel();
+        return bool(stop);
+    };
+
+    auto fail = [&](const QString &message) {
+        QMutexLocker locker(&mutex);
+        if (errors)
+            errors->append(message);
+        failed = true;
+        if (options.stopOnError) {
+            stop = true;
+            walker.cancel();
+        }
+        return false;
+    };
+
+    auto copyChunk = [&](const QByteArray &sourceDir, const QByteArray &targetDir,
+                         const std::vector<QByteArray> &names) {
+#ifdef Q_OS_LINUX
+        const int sourceFd = ::open(sourceDir.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        const int targetFd = ::open(targetDir.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (sourceFd < 0 || targetFd < 0) {
+            fail(QString("Failed to open folder:\n%1").arg(QFile::decodeName(sourceFd < 0 ? sourceDir : targetDir)));
+            if (sourceFd >= 0) ::close(sourceFd);
+            if (targetFd >= 0) ::close(targetFd);
+            return;
+        }
+#endif
+        for (const QByteArray &name : names) {
+            if (stopped()) break;
+
+            QString error;
+            CFileCopier::Report report;
+#ifdef Q_OS_LINUX
+            const bool copied = CFileCopier::copyAt(sourceFd, name.constData(), targetFd, name.constData(),
+                                                    options.progress, &error, &report);
+#else
+            const bool copied = CFileCopier::copy(QFile::decodeName(sourceDir + '/' + name),
+                                                  QFile::decodeName(targetDir + '/' + name),
+                                                  options.progress, &error, &report);
+#endif
+            if (!copied) {
+                if (!stopped())
+                    fail(QString("Failed to copy:\n%1\n%2").arg(QFile::decodeName(sourceDir + '/' + name), error));
+                continue;
+            }
+            if (options.fileCopied)
+                options.fileCopied(report);
+        }
+#ifdef Q_OS_LINUX
+        if (sourceFd >= 0) ::close(sourceFd);
+        if (targetFd >= 0) ::close(targetFd);
+#endif
+    };
+
+    CDirWalker::Visitor visitor;
+    visitor.entry = [&](const CDirWalker::Entry &entry) {
+        if (stopped())
+            return false;
+
+        switch (entry.type) {
+        case CDirWalker::Directory: {
+            const QByteArray source = entry.filePath();
+            const QByteArray target = destinationRoot + source.mid(sourceRoot.size());
+            if (!QDir().mkdir(QFile::decodeName(target)) && !QFileInfo(QFile::decodeName(target)).isDir())
+                return fail(QString("Failed to create folder:\n%1").arg(QFile::decodeName(target)));
+
+            QMutexLocker locker(&mutex);
+            entry.childTag = batches.size();
+            batches.push_back({source, target, {}});
+            return true;
+        }
+        case CDirWalker::SymLink: {
+            const QByteArray source = entry.filePath();
+            const QByteArray target = destinationRoot + source.mid(sourceRoot.size());
+            QString error;
+#ifdef Q_OS_LINUX
+            const bool linked = CFileCopier::copyLinkAt(entry.dir.fd, entry.name, AT_FDCWD, target.constData(),
+                                                        &error);
+#else
+            const bool linked = CFileCopier::copyLink(QFile::decodeName(source), QFile::decodeName(target), &error);
+#endif
+            if (!linked)
+                return fail(QString("Failed to copy link:\n%1\n%2").arg(QFile::decodeName(source), error));
+            return false;
+        }
+        case CDirWalker::File: {
+            QMutexLocker locker(&mutex);
+            batches[entry.dir.tag].names.emplace_back(entry.name);
+            return false;
+        }
+        default:
+            // FIFOs, sockets and device nodes would block or never end.
+            return fail(QString("Cannot copy a FIFO, socket or device:\n%1").arg(QFile::decodeName(entry.filePath())));
+        }
+    };
+    visitor.directoryListed = [&](const CDirWalker::Dir &dir) {
+        Batch batch;
+        {
+            QMutexLocker locker(&mutex);
+            batch = std::move(batches[dir.tag]);
+        }
+
+        for (size_t begin = 0; begin < batch.names.size(); begin += kFilesPerChunk) {
+            const size_t end = qMin(batch.names.size(), begin + kFilesPerChunk);
+            std::vector<QByteArray> names(std::make_move_iterator(batch.names.begin() + begin),
+                                          std::make_move_iterator(batch.names.begin() + end));
+            pool.start([&copyChunk, sourceDir = batch.sourceDir, targetDir = batch.targetDir,
+                        names = std::move(names)] {
+                copyChunk(sourceDir, targetDir, names);
+            });
+        }
+    };
+    visitor.error = [&](const QByteArray &path, int) {
+        fail(QString("Failed to read folder:\n%1").arg(QFile::decodeName(path)));
+    };
+
+    const bool walked = walker.walk(sourceInfo.absoluteFilePath(), visitor);
+    pool.waitForDone();
+
+    return walked && !failed && !stop;
+}
+
+bool verifyRecursively(const QString &sourceFolder, const QString &destinationFolder,
+                       const CopyOptions &options, QStringList *errors) {
+    const QByteArray sourceRoot = QFile::encodeName(QDir::cleanPath(QFileInfo(sourceFolder).absoluteFilePath()));
+    const QByteArray destinationRoot = QFile::encodeName(QDir::cleanPath(QFileInfo(destinationFolder).absoluteFilePath()));
+
+    CDirWalker walker;
+    std::atomic<bool> failed{false};
+    std::atomic<bool> stop{false};
+    QMutex mutex;
+
+    auto fail = [&](const QString &message) {
+        QMutexLocker locker(&mutex);
+        if (errors)
+            errors->append(message);
+        failed = true;
+        if (options.stopOnError) {
+            stop = true;
+            walker.cancel();
+        }
+    };
+
+    // The walker threads compare the files themselves, so files in
+    // different folders are read in parallel.
+    CDirWalker::Visitor visitor;
+    visitor.entry = [&](const CDirWalker::Entry &entry) {
+        if (stop || (options.isCancelled && options.isCancelled())) {
+            stop = true;
+            walker.cancel();
+            return false;
+        }
+        if (entry.type == CDirWalker::Directory)
+            return true;
+        if (entry.type != CDirWalker::File)
+            return false;
+
+        const QByteArray source = entry.filePath();
+        const QString sourcePath = QFile::decodeName(source);
+        const QString targetPath = QFile::decodeName(destinationRoot + source.mid(sourceRoot.size()));
+        QString error;
+        if (!CFileCopier::verify(sourcePath, targetPath, options.progress, &error) && !stop)
+            fail(QString("Failed to verify:\n%1\n%2").arg(targetPath, error));
+        return false;
+    };
+    visitor.error = [&](const QByteArray &path, int) {
+        fail(QString("Failed to read folder:\n%1").arg(QFile::decodeName(path)));
+    };
+
+    const bool walked = walker.walk(QFile::decodeName(sourceRoot), visitor);
+    return walked && !failed && !stop;
+}
+
+bool removeRecursively(const QString &path, const std::function<bool()> &removed, QStringList *errors) {
+    QFileInfo info(path);
+    if (!info.exists() && !info.isSymLink())
+        return true;
+
+    QMutex mutex;
+    auto fail = [&](const QByteArray &target, const QString &reason) {
+        if (errors) {
+            QMutexLocker locker(&mutex);
+            errors->append(QString("Failed to delete:\n%1\n%2").arg(QFile::decodeName(target), reason));
+        }
+    };
+
+    if (!info.isDir() || info.isSymLink()) {
+        QFile file(path);
+        if (!file.remove()) {
+            fail(QFile::encodeName(path), file.errorString());
+            return false;
+        }
+        if (removed) removed();
+        return true;
+    }
+
+    CDirWalker walker;
+    std::atomic<bool> failed{false};
+
+    auto count = [&] {
+        if (removed && !removed())
+            walker.cancel();
+    };
+
+    CDirWalker::Visitor visitor;
+    visitor.entry = [&](const CDirWalker::Entry &entry) {
+        if (entry.type == CDirWalker::Directory)
+            return true;
+
+#ifdef Q_OS_LINUX
+        if (::unlinkat(entry.dir.fd, entry.name, 0) != 0) {
+            failed = true;
+            fail(entry.filePath(), QString::fromLocal8Bit(std::strerror(errno)));
+            return false;
+        }
+#else
+        QFile file(QFile::decodeName(entry.filePath()));
+        if (!file.remove()) {
+            failed = true;
+            fail(entry.filePath(), file.errorString());
+            return false;
+        }
+#endif
+        count();
+        return false;
+    };
+    visitor.leaveDirectory = [&](const CDirWalker::Dir &dir) {
+#ifdef Q_OS_LINUX
+        const int parentFd = dir.parent ? dir.parent->fd : AT_FDCWD;
+        const char *name = dir.parent ? dir.name.constData() : dir.path.constData();
+        if (::unlinkat(parentFd, name, AT_REMOVEDIR) != 0) {
+            failed = true;
+            fail(dir.path, QString::fromLocal8Bit(std::strerror(errno)));
+            return;
+        }
+#else
+        if (!QDir().rmdir(QFile::decodeName(dir.path))) {
+            failed = true;
+            fail(dir.path, QString("Directory not empty"));
+            return;
+        }
+#endif
+        count();
+    };
+    visitor.error = [&](const QByteArray &target, int error) {
+        failed = true;
+        fail(target, QString::fromLocal8Bit(std::strerror(error)));
+    };
+
+    return walker.walk(info.absoluteFilePath(), visitor) && !failed;
+}
+
+bool moveToRecycleBin(const QString &path, QString *errorString) {
+    return CTrash::moveToTrash(path, errorString);
+}
+
+}
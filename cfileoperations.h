@@ -0,0 +1,47 @@
+#ifndef CFILEOPERATIONS_H
+#define CFILEOPERATIONS_H
+
+#include "cfilecopier.h"
+
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+namespace CFileOperations {
+
+struct CopyOptions {
+    // Files are copied on several threads at once, so callbacks must be thread-safe.
+    CFileCopier::Progress progress;
+    std::function<void(const CFileCopier::Report &)> fileCopied;
+    std::function<bool()> isCancelled;
+    // When false, failures are recorded and the rest of the tree is still copied.
+    bool stopOnError = true;
+    // Number of file copy workers; 0 picks defaultCopyConcurrency(), 1 copies serially.
+    int concurrency = 0;
+};
+
+int defaultCopyConcurrency();
+
+// Creates the destination folders while walking the source tree and hands
+// each listed folder's files, in chunks, to a pool of copy workers. FIFOs,
+// sockets and device nodes are not copied; each one counts as a failure.
+bool copyRecursively(const QString &sourceFolder, const QString &destinationFolder,
+                     const CopyOptions &options = CopyOptions(), QStringList *errors = nullptr);
+// Compares every file below `sourceFolder` with its copy below
+// `destinationFolder`, several files at a time. Uses progress, isCancelled
+// and stopOnError from `options`.
+bool verifyRecursively(const QString &sourceFolder, const QString &destinationFolder,
+                       const CopyOptions &options = CopyOptions(), QStringList *errors = nullptr);
+// Unlinks relative to the walker's directory fds, so independent subtrees are
+// removed in parallel. `removed` runs after each entry, from several threads;
+// returning false stops the removal.
+bool removeRecursively(const QString &path, const std::function<bool()> &removed = {},
+                       QStringList *errors = nullptr);
+// Uses the recycle bin or the freedesktop trash. Nothing is deleted when the
+// item cannot be trashed; permanent deletion is left to CDeleteJob.
+bool moveToRecycleBin(const QString &path, QString *errorString = nullptr);
+
+}
+
+#endif // CFILEOPERATIONS_H
@@ -1,40 +1,129 @@
 #include "cfilesystemmodel.h"
 #include <QBrush>
 #include <QColor>
+#include <QFileInfo>
+
+#include <algorithm>
 
 CFileSystemModel::CFileSystemModel(QObject *parent)
-    : QFileSystemModel(parent) {}
+    : QFileSystemModel(parent) {
+    connect(this, &QAbstractItemModel::rowsInserted, this, &CFileSystemModel::resolvePendingRows);
+    connect(this, &QAbstractItemModel::rowsAboutToBeRemoved, this, &CFileSystemModel::forgetRemovedRows);
+}
+
+void CFileSystemModel::setClipboardOperation(CClipboardOperation *operation) {
+    if (clipboardOperation)
+        disconnect(clipboardOperation, nullptr, this, nullptr);
+
+    clipboardOperation = operation;
+    if (clipboardOperation)
+        connect(clipboardOperation, &CClipboardOperation::pathsChanged, this, &CFileSystemModel::refreshCutState);
+}
+
+void CFileSystemModel::setIconService(CIconService *service) {
+    if (iconService)
+        disconnect(iconService, nullptr, this, nullptr);
+
+    iconService = service;
+    if (iconService)
+        connect(iconService, &CIconService::thumbnailReady, this, &CFileSystemModel::refreshThumbnail);
+}
 
-void CFileSystemModel::setCutPaths(const QStringList &paths) {
-    cutPathSet = QSet<QString>(paths.begin(), paths.end());
+void CFileSystemModel::refreshThumbnail(const QString &path) {
+    const QModelIndex idx = index(path);
+    if (idx.isValid())
+        emit dataChanged(idx, idx, {Qt::DecorationRole});
+}
+
+void CFileSystemModel::refreshCutState(const QStringList &paths) {
+    const bool cutting = clipboardOperation && clipboardOperation->isCut();
+    if (!cutting)
+        pendingCutNames.clear();
+
+    QHash<QPersistentModelIndex, QList<int>> rowsByParent;
+
+    for (const QString &path : paths) {
+        const bool isCut = cutting && clipboardOperation->contains(path);
 
-    for (const QString &path : std::as_const(cutPathSet)) {
         QModelIndex idx = index(path);
-        if (idx.isValid()) {
-            emit dataChanged(idx, idx.sibling(idx.row(), columnCount(idx.parent()) - 1));
+        if (!idx.isValid()) {
+            if (isCut) {
+                const QFileInfo info(path);
+                pendingCutNames[info.absolutePath()].insert(info.fileName());
+            }
+            continue;
         }
+
+        const bool changed = isCut ? !cutNodes.contains(idx.internalPointer())
+                                   : cutNodes.contains(idx.internalPointer());
+        if (!changed) continue;
+
+        if (isCut)
+            cutNodes.insert(idx.internalPointer());
+        else
+            cutNodes.remove(idx.internalPointer());
+        rowsByParent[idx.parent()].append(idx.row());
     }
+
+    emitRowRanges(rowsByParent);
 }
 
-void CFileSystemModel::clearCutPaths() {
-    QSet<QString> clearedPaths = std::move(cutPathSet);
-    cutPathSet.clear();
+void CFileSystemModel::resolvePendingRows(const QModelIndex &parent, int first, int last) {
+    if (pendingCutNames.isEmpty()) return;
 
-    for (const QString &path : clearedPaths) {
-        QModelIndex idx = index(path);
-        if (idx.isValid()) {
-            emit dataChanged(idx, idx.sibling(idx.row(), columnCount(idx.parent()) - 1));
+    auto pending = pendingCutNames.find(filePath(parent));
+    if (pending == pendingCutNames.end()) return;
+
+    QHash<QPersistentModelIndex, QList<int>> rowsByParent;
+    for (int row = first; row <= last; ++row) {
+        const QModelIndex idx = index(row, 0, parent);
+        if (pending->remove(fileName(idx))) {
+            cutNodes.insert(idx.internalPointer());
+            rowsByParent[parent].append(row);
         }
     }
+
+    if (pending->isEmpty())
+        pendingCutNames.erase(pending);
+
+    emitRowRanges(rowsByParent);
 }
 
-QVariant CFileSystemModel::data(const QModelIndex &index, int role) const {
-    if (role == Qt::ForegroundRole) {
-        QString path = filePath(index);
-        if (cutPathSet.contains(path)) {
-            return QBrush(Qt::gray);
+void CFileSystemModel::forgetRemovedRows(const QModelIndex &parent, int first, int last) {
+    if (cutNodes.isEmpty()) return;
+
+    for (int row = first; row <= last; ++row)
+        cutNodes.remove(index(row, 0, parent).internalPointer());
+}
+
+void CFileSystemModel::emitRowRanges(QHash<QPersistentModelIndex, QList<int>> &rowsByParent) {
+    for (auto it = rowsByParent.begin(); it != rowsByParent.end(); ++it) {
+        const QModelIndex parent = it.key();
+        QList<int> &rows = it.value();
+        std::sort(rows.begin(), rows.end());
+
+        const int lastColumn = columnCount(parent) - 1;
+        int start = 0;
+        for (int i = 1; i <= rows.size(); ++i) {
+            if (i < rows.size() && rows.at(i) == rows.at(i - 1) + 1) continue;
+
+            emit dataChanged(index(rows.at(start), 0, parent), index(rows.at(i - 1), lastColumn, parent));
+            start = i;
         }
     }
+}
+
+QVariant CFileSystemModel::data(const QModelIndex &index, int role) const {
+    if (role == Qt::ForegroundRole && !cutNodes.isEmpty() && cutNodes.contains(index.internalPointer())) {
+        return QBrush(Qt::gray);
+    }
+
+    if (role == Qt::DecorationRole && index.column() == 0 && iconService
+        && iconService->canThumbnail(fileName(index))) {
+        const QIcon thumbnail = iconService->thumbnail(filePath(index), lastModified(index));
+        if (!thumbnail.isNull())
+            return thumbnail;
+    }
 
     return QFileSystemModel::data(index, role);
 }
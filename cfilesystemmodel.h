@@ -1,9 +1,14 @@
 #ifndef CFILESYSTEMMODEL_H
 #define CFILESYSTEMMODEL_H
 
+#include "cclipboardoperation.h"
+#include "ciconservice.h"
+
 #include <QFileSystemModel>
-#include <QSet>
+#include <QHash>
 #include <QObject>
+#include <QPointer>
+#include <QSet>
 
 class CFileSystemModel : public QFileSystemModel
 {
@@ -14,11 +19,28 @@ public:
 
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
-    void setCutPaths(const QStringList &paths);
-    void clearCutPaths();
+    void setClipboardOperation(CClipboardOperation *operation);
+
+    // Images get thumbnails from `service` once they are ready.
+    void setIconService(CIconService *service);
+
+private slots:
+    void refreshCutState(const QStringList &paths);
+    void resolvePendingRows(const QModelIndex &parent, int first, int last);
+    void forgetRemovedRows(const QModelIndex &parent, int first, int last);
+    void refreshThumbnail(const QString &path);
 
 private:
-    QSet<QString> cutPathSet;
+    void emitRowRanges(QHash<QPersistentModelIndex, QList<int>> &rowsByParent);
+
+    QPointer<CClipboardOperation> clipboardOperation;
+    // Nodes shown as cut, by the model's internal node pointer, which stays
+    // valid for as long as the row exists.
+    QSet<const void *> cutNodes;
+    // Cut names whose parent folder has not been loaded yet, by parent path.
+    QHash<QString, QSet<QString>> pendingCutNames;
+
+    QPointer<CIconService> iconService;
 };
 
 #endif // CFILESYSTEMMODEL_H
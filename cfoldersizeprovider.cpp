@@ -0,0 +1,211 @@
+#include "cfoldersizeprovider.h"
+#include "cdirwalker.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QStandardPaths>
+
+#include <atomic>
+#include <deque>
+
+namespace {
+// How long a walked total is reused before the folder is walked again.
+constexpr qint64 kMaxRecordAgeMs = 60 * 1000;
+
+QPair<quint64, quint64> keyFor(const CDirWalker::Stat &st, const QByteArray &path) {
+    // Platforms without inode numbers fall back to the path.
+    if (st.inode == 0) return qMakePair(quint64(0), quint64(qHash(path)));
+    return qMakePair(st.device, st.inode);
+}
+}
+
+CFolderSizeProvider::CFolderSizeProvider(QObject *parent)
+    : QObject(parent) {
+    // Earlier versions saved subtree totals that could not be checked.
+    QFile::remove(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/foldersizes.cache");
+
+    clock.start();
+    pool.setMaxThreadCount(2);
+}
+
+CFolderSizeProvider::~CFolderSizeProvider() {
+    cancelPending();
+    pool.waitForDone();
+}
+
+CFolderSizeProvider::Size CFolderSizeProvider::size(const QString &path) {
+    // A stale size is still shown until the new walk replaces it.
+    auto it = known.constFind(path);
+    if (it != known.constEnd() && isFresh(it->computedMs)) return it->size;
+
+    if (!pending.contains(path)) {
+        pending.insert(path);
+        pool.start([this, path] { compute(path); });
+    }
+    return it != known.constEnd() ? it->size : Size();
+}
+
+bool CFolderSizeProvider::isFresh(qint64 walkedMs) const {
+    return clock.elapsed() - walkedMs < kMaxRecordAgeMs;
+}
+
+void CFolderSizeProvider::invalidate(const QString &path) {
+    if (path.isEmpty()) return;
+
+    QList<Key> keys;
+    QString current = QDir::cleanPath(path);
+    while (true) {
+        auto it = known.find(current);
+        if (it != known.end()) {
+            keys.append(it->key);
+            known.erase(it);
+            emit sizeChanged(current);
+        }
+
+        const QByteArray encoded = QFile::encodeName(current);
+        CDirWalker::Stat st;
+        if (CDirWalker::stat(encoded, st))
+            keys.append(keyFor(st, encoded));
+
+        const QString parentPath = QFileInfo(current).path();
+        if (parentPath == current) break;
+        current = parentPath;
+    }
+
+    QMutexLocker locker(&cacheMutex);
+    for (const Key &key : std::as_const(keys))
+        cache.remove(key);
+}
+
+void CFolderSizeProvider::cancelPending() {
+    pool.clear();
+    pending.clear();
+
+    QMutexLocker locker(&walkerMutex);
+    for (CDirWalker *walker : std::as_const(activeWalkers))
+        walker->cancel();
+}
+
+void CFolderSizeProvider::compute(const QString &path) {
+    const QByteArray encodedPath = QFile::encodeName(path);
+
+    auto publish = [this, path](const Key &key, const Size &result) {
+        QMetaObject::invokeMethod(this, [this, path, key, result] {
+            pending.remove(path);
+            known.insert(path, {key, result, clock.elapsed()});
+            emit sizeChanged(path);
+        }, Qt::QueuedConnection);
+    };
+
+    CDirWalker::Stat rootStat;
+    if (!CDirWalker::stat(encodedPath, rootStat)) {
+        publish(Key(), Size());
+        return;
+    }
+    const Key rootKey = keyFor(rootStat, encodedPath);
+
+    {
+        QMutexLocker locker(&cacheMutex);
+        auto it = cache.constFind(rootKey);
+        if (it != cache.constEnd() && it->modifiedMs == rootStat.modifiedMs && isFresh(it->walkedMs)) {
+            publish(rootKey, {it->bytes, it->files, it->folders});
+            return;
+        }
+    }
+
+    struct Totals {
+        Key key;
+        qint64 modifiedMs = 0;
+        Totals *parent = nullptr;
+        std::atomic<qint64> bytes{0};
+        std::atomic<qint64> files{0};
+        std::atomic<qint64> folders{0};
+    };
+
+    QMutex totalsMutex;
+    std::deque<Totals> totals;
+    Totals &root = totals.emplace_back();
+    root.key = rootKey;
+    root.modifiedMs = rootStat.modifiedMs;
+
+    CDirWalker walker;
+    CDirWalker::Visitor visitor;
+    visitor.entry = [&](const CDirWalker::Entry &entry) {
+        Totals *dirTotals = reinterpret_cast<Totals *>(quintptr(entry.dir.tag));
+
+        CDirWalker::Stat st;
+        if (!entry.stat(st)) return false;
+
+        if (entry.type != CDirWalker::Directory) {
+            dirTotals->bytes += st.size;
+            ++dirTotals->files;
+            return false;
+        }
+
+        ++dirTotals->folders;
+        // Like du -x: other file systems mounted below are not counted.
+        if (st.device != rootStat.device) return false;
+
+        const Key key = keyFor(st, st.inode == 0 ? entry.filePath() : QByteArray());
+        {
+            QMutexLocker locker(&cacheMutex);
+            auto it = cache.constFind(key);
+            if (it != cache.constEnd() && it->modifiedMs == st.modifiedMs && isFresh(it->walkedMs)) {
+                dirTotals->bytes += it->bytes;
+                dirTotals->files += it->files;
+                dirTotals->folders += it->folders;
+                return false;
+            }
+        }
+
+        Totals *child;
+        {
+            QMutexLocker locker(&totalsMutex);
+            child = &totals.emplace_back();
+        }
+        child->key = key;
+        child->modifiedMs = st.modifiedMs;
+        child->parent = dirTotals;
+        entry.childTag = quintptr(child);
+        return true;
+    };
+    visitor.leaveDirectory = [&](const CDirWalker::Dir &dir) {
+        Totals *dirTotals = reinterpret_cast<Totals *>(quintptr(dir.tag));
+        const Record record{clock.elapsed(), dirTotals->modifiedMs, dirTotals->bytes, dirTotals->files,
+                            dirTotals->folders};
+
+        {
+            QMutexLocker locker(&cacheMutex);
+            cache.insert(dirTotals->key, record);
+        }
+
+        if (Totals *parentTotals = dirTotals->parent) {
+            parentTotals->bytes += record.bytes;
+            parentTotals->files += record.files;
+            parentTotals->folders += record.folders;
+        }
+    };
+
+    {
+        QMutexLocker locker(&walkerMutex);
+        activeWalkers.append(&walker);
+    }
+
+    const bool walked = walker.walk(path, visitor, quintptr(&root));
+
+    {
+        QMutexLocker locker(&walkerMutex);
+        activeWalkers.removeOne(&walker);
+    }
+
+    // Subfolders that finished before a cancel stay cached for next time.
+    if (walker.isCancelled()) return;
+
+    if (walked) {
+        publish(rootKey, {root.bytes, root.files, root.folders});
+    } else {
+        publish(rootKey, Size());
+    }
+}
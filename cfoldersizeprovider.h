@@ -0,0 +1,80 @@
+#ifndef CFOLDERSIZEPROVIDER_H
+#define CFOLDERSIZEPROVIDER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QThreadPool>
+
+class CDirWalker;
+
+// Recursive folder sizes computed on a background pool. Every folder seen
+// during a walk is cached by (device, inode), so the cache also answers later
+// questions about subfolders. A folder's mtime only follows its direct
+// entries, so a cached total is trusted for a short while and otherwise only
+// as long as the change watcher has not reported anything below it. Nothing
+// is kept across runs.
+class CFolderSizeProvider : public QObject {
+    Q_OBJECT
+
+public:
+    struct Size {
+        qint64 bytes = -1;
+        qint64 files = 0;
+        qint64 folders = 0;
+
+        bool isValid() const { return bytes >= 0; }
+    };
+
+    explicit CFolderSizeProvider(QObject *parent = nullptr);
+    ~CFolderSizeProvider() override;
+
+    // Returns the known size of `path`, or queues it and returns an invalid Size.
+    Size size(const QString &path);
+
+public slots:
+    // Forgets `path` and its ancestors after something below it changed.
+    void invalidate(const QString &path);
+    // Drops queued folders and stops running walks, e.g. after navigating away.
+    void cancelPending();
+
+signals:
+    void sizeChanged(const QString &path);
+
+private:
+    using Key = QPair<quint64, quint64>;
+
+    struct Record {
+        qint64 walkedMs = 0;
+        qint64 modifiedMs = 0;
+        qint64 bytes = 0;
+        qint64 files = 0;
+        qint64 folders = 0;
+    };
+
+    struct Known {
+        Key key;
+        Size size;
+        qint64 computedMs = 0;
+    };
+
+    bool isFresh(qint64 walkedMs) const;
+    void compute(const QString &path);
+
+    QElapsedTimer clock;
+    QThreadPool pool;
+
+    QMutex cacheMutex;
+    QHash<Key, Record> cache;
+
+    QMutex walkerMutex;
+    QList<CDirWalker *> activeWalkers;
+
+    QHash<QString, Known> known;
+    QSet<QString> pending;
+};
+
+#endif // CFOLDERSIZEPROVIDER_H
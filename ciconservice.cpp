@@ -0,0 +1,171 @@
+#include "ciconservice.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMimeDatabase>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrl>
+
+namespace {
+// The "normal" size of the freedesktop.org thumbnail cache.
+constexpr int kThumbnailSize = 128;
+constexpr qint64 kMaxThumbnailSourceBytes = 64 * 1024 * 1024;
+constexpr int kMaxCachedThumbnails = 512;
+constexpr int kMaxCachedPathTypes = 4096;
+
+QString thumbnailKey(const QString &path, qint64 modifiedSecs) {
+    return path + '\n' + QString::number(modifiedSecs);
+}
+}
+
+CIconService::CIconService(QObject *parent)
+    : QObject(parent) {
+    iconPool.setMaxThreadCount(1);
+    thumbnailPool.setMaxThreadCount(2);
+    thumbnails.setMaxCost(kMaxCachedThumbnails);
+    pathMimeTypes.setMaxCost(kMaxCachedPathTypes);
+
+    const QString thumbnailRoot = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/thumbnails";
+    thumbnailDirectory = thumbnailRoot + "/normal";
+    if (QDir().mkpath(thumbnailDirectory)) {
+        const QFile::Permissions ownerOnly = QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner;
+        QFile::setPermissions(thumbnailRoot, ownerOnly);
+        QFile::setPermissions(thumbnailDirectory, ownerOnly);
+    }
+
+    const QList<QByteArray> formats = QImageReader::supportedImageFormats();
+    for (const QByteArray &format : formats)
+        thumbnailSuffixes.insert(format.toLower());
+}
+
+CIconService::~CIconService() {
+    iconPool.clear();
+    thumbnailPool.clear();
+    iconPool.waitForDone();
+    thumbnailPool.waitForDone();
+}
+
+QIcon CIconService::icon(const QString &path, QFileIconProvider::IconType placeholder) {
+    // Folders are never typed by their suffix.
+    const QString suffix = placeholder == QFileIconProvider::File ? QFileInfo(path).suffix().toLower() : QString();
+    if (!suffix.isEmpty()) {
+        auto it = suffixMimeTypes.constFind(suffix);
+        if (it == suffixMimeTypes.constEnd()) {
+            const QList<QMimeType> types = QMimeDatabase().mimeTypesForFileName("file." + suffix);
+            it = suffixMimeTypes.insert(suffix, types.size() == 1 ? types.first().name() : QString());
+        }
+        if (!it->isEmpty()) return iconForMimeType(*it);
+    }
+
+    if (const QString *mimeTypeName = pathMimeTypes.object(path)) return iconForMimeType(*mimeTypeName);
+
+    if (!pendingIcons.contains(path)) {
+        pendingIcons.insert(path);
+        iconPool.start([this, path] {
+            // Detection may read the file, which is slow on network mounts.
+            const QString mimeTypeName = QMimeDatabase().mimeTypeForFile(path).name();
+            QMetaObject::invokeMethod(this, [this, path, mimeTypeName] {
+                pendingIcons.remove(path);
+                pathMimeTypes.insert(path, new QString(mimeTypeName));
+                emit iconReady(path);
+            }, Qt::QueuedConnection);
+        });
+    }
+    return iconProvider.icon(placeholder);
+}
+
+QIcon CIconService::iconForMimeType(const QString &mimeTypeName) {
+    auto it = mimeIcons.constFind(mimeTypeName);
+    if (it != mimeIcons.constEnd()) return it.value();
+
+    const QMimeType mime = QMimeDatabase().mimeTypeForName(mimeTypeName);
+    const QIcon fallback = mime.inherits("inode/directory") ? iconProvider.icon(QFileIconProvider::Folder)
+                                                             : iconProvider.icon(QFileIconProvider::File);
+    const QIcon icon = QIcon::fromTheme(mime.iconName(), QIcon::fromTheme(mime.genericIconName(), fallback));
+    mimeIcons.insert(mimeTypeName, icon);
+    return icon;
+}
+
+bool CIconService::canThumbnail(const QString &fileName) const {
+    const int dot = fileName.lastIndexOf('.');
+    if (dot <= 0) return false;
+    return thumbnailSuffixes.contains(fileName.mid(dot + 1).toLower().toLatin1());
+}
+
+QIcon CIconService::thumbnail(const QString &path, const QDateTime &lastModified) {
+    const qint64 modifiedSecs = lastModified.toSecsSinceEpoch();
+    const QString key = thumbnailKey(path, modifiedSecs);
+
+    if (QIcon *cached = thumbnails.object(key)) return *cached;
+    if (pendingThumbnails.contains(key) || failedThumbnails.contains(key)) return QIcon();
+
+    pendingThumbnails.insert(key);
+    const QString cacheDirectory = thumbnailDirectory;
+    // Newer requests first, so the rows on screen win over ones scrolled past.
+    thumbnailPool.start([this, path, key, modifiedSecs, cacheDirectory] {
+        const QImage image = loadThumbnail(path, modifiedSecs, cacheDirectory);
+        QMetaObject::invokeMethod(this, [this, path, key, image] {
+            pendingThumbnails.remove(key);
+            if (image.isNull()) {
+                failedThumbnails.insert(key);
+                return;
+            }
+            thumbnails.insert(key, new QIcon(QPixmap::fromImage(image)));
+            emit thumbnailReady(path);
+        }, Qt::QueuedConnection);
+    }, nextPriority++);
+    return QIcon();
+}
+
+void CIconService::cancelPending() {
+    thumbnailPool.clear();
+    pendingThumbnails.clear();
+}
+
+QImage CIconService::loadThumbnail(const QString &path, qint64 modifiedSecs, const QString &cacheDirectory) {
+    const QString uri = QString::fromLatin1(QUrl::fromLocalFile(path).toEncoded());
+    const QString cacheFile = QString("%1/%2.png").arg(
+        cacheDirectory, QString::fromLatin1(QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex()));
+
+    const QImage cached(cacheFile);
+    if (!cached.isNull() && cached.text("Thumb::URI") == uri
+        && cached.text("Thumb::MTime").toLongLong() == modifiedSecs) {
+        return cached;
+    }
+
+    const QFileInfo info(path);
+    if (!info.isFile() || info.size() > kMaxThumbnailSourceBytes) return QImage();
+
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    const QSize sourceSize = reader.size();
+    if (sourceSize.width() > kThumbnailSize || sourceSize.height() > kThumbnailSize)
+        reader.setScaledSize(sourceSize.scaled(kThumbnailSize, kThumbnailSize, Qt::KeepAspectRatio));
+
+    QImage image = reader.read();
+    if (image.isNull()) return QImage();
+    if (image.width() > kThumbnailSize || image.height() > kThumbnailSize)
+        image = image.scaled(kThumbnailSize, kThumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    // Thumbnails of thumbnails are never stored, as the specification asks.
+    if (path.startsWith(QFileInfo(cacheDirectory).absolutePath() + '/')) return image;
+
+    image.setText("Thumb::URI", uri);
+    image.setText("Thumb::MTime", QString::number(modifiedSecs));
+    image.setText("Thumb::Size", QString::number(info.size()));
+    image.setText("Software", "C-Explorer");
+
+    QSaveFile out(cacheFile);
+    if (out.open(QIODevice::WriteOnly) && image.save(&out, "PNG")) {
+        if (out.commit())
+            QFile::setPermissions(cacheFile, QFile::ReadOwner | QFile::WriteOwner);
+    } else {
+        out.cancelWriting();
+    }
+    return image;
+}
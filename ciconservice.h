@@ -0,0 +1,65 @@
+#ifndef CICONSERVICE_H
+#define CICONSERVICE_H
+
+#include <QCache>
+#include <QDateTime>
+#include <QFileIconProvider>
+#include <QHash>
+#include <QIcon>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+// Resolves icons and thumbnails off the GUI thread. Callers get a placeholder
+// or a null icon right away and are told through the signals when the real
+// one is available. Thumbnails are shared with other desktop applications
+// through the freedesktop.org thumbnail cache.
+class CIconService : public QObject {
+    Q_OBJECT
+
+public:
+    explicit CIconService(QObject *parent = nullptr);
+    ~CIconService() override;
+
+    // The icon for the MIME type of `path`, or `placeholder` until the type
+    // has been detected. Files whose suffix names a single type are answered
+    // right away without touching the disk.
+    QIcon icon(const QString &path, QFileIconProvider::IconType placeholder = QFileIconProvider::File);
+
+    // Whether thumbnail() can ever produce anything for this file name.
+    bool canThumbnail(const QString &fileName) const;
+    // The thumbnail of an image, or a null icon until it is ready.
+    QIcon thumbnail(const QString &path, const QDateTime &lastModified);
+
+public slots:
+    // Drops queued thumbnails, e.g. after navigating away.
+    void cancelPending();
+
+signals:
+    void iconReady(const QString &path);
+    void thumbnailReady(const QString &path);
+
+private:
+    QIcon iconForMimeType(const QString &mimeTypeName);
+    static QImage loadThumbnail(const QString &path, qint64 modifiedSecs, const QString &cacheDirectory);
+
+    QThreadPool iconPool;
+    QThreadPool thumbnailPool;
+    int nextPriority = 0;
+    QString thumbnailDirectory;
+    QSet<QByteArray> thumbnailSuffixes;
+
+    QFileIconProvider iconProvider;
+    QHash<QString, QIcon> mimeIcons;
+    // Empty when the suffix is ambiguous and the contents decide.
+    QHash<QString, QString> suffixMimeTypes;
+    QCache<QString, QString> pathMimeTypes;
+    QSet<QString> pendingIcons;
+
+    QCache<QString, QIcon> thumbnails;
+    QSet<QString> pendingThumbnails;
+    QSet<QString> failedThumbnails;
+};
+
+#endif // CICONSERVICE_H
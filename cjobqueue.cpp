@@ -0,0 +1,47 @@
+#include "cjobqueue.h"
+
+CJobQueue::CJobQueue(QObject *parent)
+    : QObject(parent) {
+}
+
+CJobQueue::~CJobQueue() {
+    for (CFileJob *job : std::as_const(active))
+        job->cancel();
+    for (CFileJob *job : std::as_const(active))
+        job->wait();
+}
+
+void CJobQueue::enqueue(CFileJob *job) {
+    job->setParent(this);
+    pending.append(job);
+
+    connect(job, &CFileJob::finished, this, [this, job](bool success, const QStringList &errors) {
+        pending.removeOne(job);
+        active.removeOne(job);
+
+        emit jobFinished(job, success, errors);
+        job->deleteLater();
+
+        startNext();
+    });
+
+    emit jobAdded(job);
+    startNext();
+}
+
+void CJobQueue::setMaxActiveJobs(int count) {
+    maxActiveJobs = qMax(1, count);
+    startNext();
+}
+
+QList<CFileJob *> CJobQueue::jobs() const {
+    return active + pending;
+}
+
+void CJobQueue::startNext() {
+    while (active.size() < maxActiveJobs && !pending.isEmpty()) {
+        CFileJob *job = pending.takeFirst();
+        active.append(job);
+        job->start();
+    }
+}
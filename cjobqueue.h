@@ -0,0 +1,35 @@
+#ifndef CJOBQUEUE_H
+#define CJOBQUEUE_H
+
+#include "cfilejob.h"
+
+#include <QList>
+#include <QObject>
+
+// Owns file jobs and runs up to maxActiveJobs of them at a time; the rest wait
+// in submission order. Finished jobs are deleted after jobFinished().
+class CJobQueue : public QObject {
+    Q_OBJECT
+
+public:
+    explicit CJobQueue(QObject *parent = nullptr);
+    ~CJobQueue() override;
+
+    void enqueue(CFileJob *job);
+    void setMaxActiveJobs(int count);
+
+    QList<CFileJob *> jobs() const;
+
+signals:
+    void jobAdded(CFileJob *job);
+    void jobFinished(CFileJob *job, bool success, const QStringList &errors);
+
+private:
+    void startNext();
+
+    QList<CFileJob *> pending;
+    QList<CFileJob *> active;
+    int maxActiveJobs = 2;
+};
+
+#endif // CJOBQUEUE_H
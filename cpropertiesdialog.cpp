@@ -0,0 +1,239 @@
+#include "cpropertiesdialog.h"
+#include "cdirwalker.h"
+
+#include <QDateTime>
+#include <QDialogButtonBox>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFormLayout>
+#include <QFrame>
+#include <QLocale>
+#include <QMimeDatabase>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QSet>
+#include <QVBoxLayout>
+
+#include <atomic>
+
+namespace {
+constexpr int kUpdateIntervalMs = 200;
+
+QString permissionString(QFile::Permissions permissions) {
+    const struct {
+        QFile::Permission flag;
+        char letter;
+    } bits[] = {
+        {QFile::ReadOwner, 'r'}, {QFile::WriteOwner, 'w'}, {QFile::ExeOwner, 'x'},
+        {QFile::ReadGroup, 'r'}, {QFile::WriteGroup, 'w'}, {QFile::ExeGroup, 'x'},
+        {QFile::ReadOther, 'r'}, {QFile::WriteOther, 'w'}, {QFile::ExeOther, 'x'},
+    };
+
+    QString text;
+    int octal = 0;
+    for (const auto &bit : bits) {
+        octal <<= 1;
+        if (permissions & bit.flag) {
+            text += QLatin1Char(bit.letter);
+            octal |= 1;
+        } else {
+            text += QLatin1Char('-');
+        }
+    }
+    return QString("%1 (%2)").arg(text, QString::number(octal, 8).rightJustified(3, '0'));
+}
+
+QString dateString(const QDateTime &dateTime) {
+    if (!dateTime.isValid()) return QString();
+    return QLocale::system().toString(dateTime, QLocale::LongFormat);
+}
+
+QLabel *valueLabel(const QString &text, QWidget *parent) {
+    QLabel *label = new QLabel(text, parent);
+    label->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    label->setWordWrap(true);
+    return label;
+}
+}
+
+struct CPropertiesDialog::Scan {
+    CDirWalker walker;
+    std::atomic<bool> done{false};
+    std::atomic<qint64> bytes{0};
+    std::atomic<qint64> allocated{0};
+    std::atomic<qint64> files{0};
+    std::atomic<qint64> folders{0};
+    std::atomic<qint64> unreadable{0};
+
+    // Hard linked files take up their space once.
+    QMutex linkMutex;
+    QSet<QPair<quint64, quint64>> seenLinks;
+
+    void add(const CDirWalker::Stat &st) {
+        if (st.type == CDirWalker::Directory) {
+            ++folders;
+            return;
+        }
+        ++files;
+        bytes += st.size;
+        if (st.linkCount > 1) {
+            QMutexLocker locker(&linkMutex);
+            const QPair<quint64, quint64> key(st.device, st.inode);
+            if (seenLinks.contains(key)) return;
+            seenLinks.insert(key);
+        }
+        allocated += st.allocatedSize;
+    }
+};
+
+CPropertiesDialog::CPropertiesDialog(const QStringList &selectedPaths, QWidget *parent)
+    : QDialog(parent), paths(selectedPaths) {
+    const QFileInfo firstInfo(paths.first());
+    setWindowTitle(paths.size() == 1 ? QString("%1 Properties").arg(firstInfo.fileName().isEmpty()
+                                                                          ? paths.first() : firstInfo.fileName())
+                                     : QString("Properties of %1 Items").arg(paths.size()));
+    setMinimumWidth(420);
+
+    sizeLabel = valueLabel(QString(), this);
+    allocatedLabel = valueLabel(QString(), this);
+    containsLabel = valueLabel(QString(), this);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QFormLayout *form = new QFormLayout;
+    form->setLabelAlignment(Qt::AlignRight);
+    layout->addLayout(form);
+
+    if (paths.size() == 1) {
+        addDetails(form, paths.first());
+    } else {
+        QString location = QFileInfo(paths.first()).absolutePath();
+        for (const QString &path : std::as_const(paths)) {
+            if (QFileInfo(path).absolutePath() != location) {
+                location = "Various folders";
+                break;
+            }
+        }
+        form->addRow("Items:", valueLabel(QString::number(paths.size()), this));
+        form->addRow("Location:", valueLabel(location, this));
+    }
+
+    QFrame *line = new QFrame(this);
+    line->setFrameShape(QFrame::HLine);
+    line->setFrameShadow(QFrame::Sunken);
+    layout->addWidget(line);
+
+    QFormLayout *totals = new QFormLayout;
+    totals->setLabelAlignment(Qt::AlignRight);
+    totals->addRow("Size:", sizeLabel);
+    totals->addRow("Size on disk:", allocatedLabel);
+    if (paths.size() > 1 || (firstInfo.isDir() && !firstInfo.isSymLink()))
+        totals->addRow("Contains:", containsLabel);
+    else
+        containsLabel->hide();
+    layout->addLayout(totals);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    layout->addStretch(1);
+    layout->addWidget(buttons);
+
+    updateTimer = new QTimer(this);
+    updateTimer->setInterval(kUpdateIntervalMs);
+    connect(updateTimer, &QTimer::timeout, this, &CPropertiesDialog::updateTotals);
+
+    scan = std::make_shared<Scan>();
+    pool.setMaxThreadCount(1);
+    pool.start([this, session = scan, selected = paths] {
+        for (const QString &path : selected) {
+            if (session->walker.isCancelled()) break;
+
+            CDirWalker::Stat rootStat;
+            if (!CDirWalker::stat(QFile::encodeName(path), rootStat)) {
+                ++session->unreadable;
+                continue;
+            }
+            session->add(rootStat);
+            if (rootStat.type != CDirWalker::Directory) continue;
+            // The selected folder is not counted among its contents.
+            --session->folders;
+
+            CDirWalker::Visitor visitor;
+            visitor.entry = [&session, &rootStat](const CDirWalker::Entry &entry) {
+                CDirWalker::Stat st;
+                if (!entry.stat(st)) {
+                    ++session->unreadable;
+                    return false;
+                }
+                session->add(st);
+                // Like du -x: other file systems mounted below are left out.
+                return st.type == CDirWalker::Directory && st.device == rootStat.device;
+            };
+            visitor.error = [&session](const QByteArray &, int) {
+                ++session->unreadable;
+            };
+            session->walker.walk(path, visitor);
+        }
+        session->done = true;
+        QMetaObject::invokeMethod(this, [this] { updateTotals(); }, Qt::QueuedConnection);
+    });
+
+    updateTotals();
+    updateTimer->start();
+}
+
+CPropertiesDialog::~CPropertiesDialog() {
+    scan->walker.cancel();
+    pool.waitForDone();
+}
+
+void CPropertiesDialog::addDetails(QFormLayout *form, const QString &path) {
+    const QFileInfo info(path);
+
+    QString type;
+    if (info.isSymLink())
+        type = "Symbolic link";
+    else if (info.isDir())
+        type = "Folder";
+    else
+        type = QMimeDatabase().mimeTypeForFile(info).comment();
+
+    form->addRow("Name:", valueLabel(info.fileName().isEmpty() ? path : info.fileName(), this));
+    form->addRow("Type:", valueLabel(type, this));
+    if (info.isSymLink())
+        form->addRow("Target:", valueLabel(info.symLinkTarget(), this));
+    form->addRow("Location:", valueLabel(QDir::toNativeSeparators(info.absolutePath()), this));
+    form->addRow("Owner:", valueLabel(QString("%1, group %2").arg(info.owner(), info.group()), this));
+    form->addRow("Permissions:", valueLabel(permissionString(info.permissions()), this));
+    form->addRow("Modified:", valueLabel(dateString(info.lastModified()), this));
+    form->addRow("Accessed:", valueLabel(dateString(info.lastRead()), this));
+    form->addRow("Changed:", valueLabel(dateString(info.metadataChangeTime()), this));
+    if (info.birthTime().isValid())
+        form->addRow("Created:", valueLabel(dateString(info.birthTime()), this));
+}
+
+void CPropertiesDialog::updateTotals() {
+    const QLocale locale = QLocale::system();
+    const qint64 bytes = scan->bytes;
+    const qint64 allocated = scan->allocated;
+    const qint64 files = scan->files;
+    const qint64 folders = scan->folders;
+    const qint64 unreadable = scan->unreadable;
+    const bool done = scan->done;
+
+    sizeLabel->setText(QString("%1 (%2 bytes)").arg(locale.formattedDataSize(bytes), locale.toString(bytes)));
+    allocatedLabel->setText(QString("%1 (%2 bytes)").arg(locale.formattedDataSize(allocated),
+                                                         locale.toString(allocated)));
+
+    QString contains = QString("%1 file%2, %3 folder%4")
+                           .arg(locale.toString(files), files == 1 ? "" : "s")
+                           .arg(locale.toString(folders), folders == 1 ? "" : "s");
+    if (unreadable > 0)
+        contains += QString(", %1 unreadable").arg(locale.toString(unreadable));
+    if (!done)
+        contains += "...";
+    containsLabel->setText(contains);
+
+    if (done) updateTimer->stop();
+}
@@ -0,0 +1,39 @@
+#ifndef CPROPERTIESDIALOG_H
+#define CPROPERTIESDIALOG_H
+
+#include <QDialog>
+#include <QFormLayout>
+#include <QLabel>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <memory>
+
+// Shows the size, counts, permissions and dates of one or more items. The
+// contents of folders are added up on a background walk, and the totals
+// update while it runs. Closing the dialog stops the walk.
+class CPropertiesDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit CPropertiesDialog(const QStringList &paths, QWidget *parent = nullptr);
+    ~CPropertiesDialog() override;
+
+private:
+    struct Scan;
+
+    void addDetails(QFormLayout *form, const QString &path);
+    void updateTotals();
+
+    QStringList paths;
+    std::shared_ptr<Scan> scan;
+    QThreadPool pool;
+    QTimer *updateTimer;
+
+    QLabel *sizeLabel;
+    QLabel *allocatedLabel;
+    QLabel *containsLabel;
+};
+
+#endif // CPROPERTIESDIALOG_H
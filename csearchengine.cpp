@@ -0,0 +1,210 @@
+#include "csearchengine.h"
+#include "ccontentscanner.h"
+#include "cdirwalker.h"
+#include "csearchindex.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <atomic>
+#include <cstring>
+
+namespace {
+constexpr int kBatchSize = 512;
+constexpr qint64 kBatchIntervalMs = 100;
+constexpr qint64 kDefaultContentSizeLimit = 256 * 1024 * 1024;
+// Files with many hits are cut short rather than flooding the results.
+constexpr int kMaxHitsPerFile = 100;
+}
+
+struct CSearchEngine::Session {
+    quint64 id = 0;
+    CSearchQuery query;
+    std::unique_ptr<CContentScanner> scanner;
+    qint64 contentSizeLimit = 0;
+    std::atomic<bool> cancelled{false};
+    CDirWalker walker;
+
+    QMutex mutex;
+    QList<CSearchResult> batch;
+    QElapsedTimer sinceFlush;
+};
+
+CSearchEngine::CSearchEngine(QObject *parent)
+    : QObject(parent) {
+    qRegisterMetaType<CSearchResult>();
+    qRegisterMetaType<QList<CSearchResult>>();
+}
+
+CSearchEngine::~CSearchEngine() {
+    cancel();
+    pool.waitForDone();
+}
+
+void CSearchEngine::setIndex(CSearchIndex *searchIndex) {
+    index = searchIndex;
+}
+
+quint64 CSearchEngine::start(const CSearchQuery &query, const QString &rootPath) {
+    cancel();
+
+    if (index)
+        index->ensureIndexed(rootPath);
+
+    auto session = std::make_shared<Session>();
+    session->id = nextSearchId++;
+    session->query = query;
+    if (!query.contentText().isEmpty())
+        session->scanner = std::make_unique<CContentScanner>(query.contentText());
+    // A size: term the user gave replaces the default limit, so that
+    // content:TODO size:>1G still reads the large files it asks for.
+    session->contentSizeLimit = query.maxSize() >= 0 ? query.maxSize() : kDefaultContentSizeLimit;
+    session->sinceFlush.start();
+    current = session;
+
+    pool.start([this, session, rootPath] {
+        run(session, rootPath);
+    });
+    return session->id;
+}
+
+void CSearchEngine::cancel() {
+    if (current) {
+        current->cancelled = true;
+        current->walker.cancel();
+        current.reset();
+    }
+}
+
+void CSearchEngine::run(const std::shared_ptr<Session> &session, const QString &rootPath) {
+    // Content searches read the files anyway, so they always run on the
+    // parallel walker rather than the index.
+    if (index && !session->scanner) {
+        bool served = index->query(session->query, rootPath, [this, &session](const QList<CSearchResult> &results) {
+            if (session->cancelled) return false;
+            emit resultsReady(session->id, results);
+            return true;
+        });
+
+        if (served) {
+            emit finished(session->id, session->cancelled);
+            return;
+        }
+    }
+
+    CDirWalker::Visitor visitor;
+    visitor.entry = [this, &session](const CDirWalker::Entry &entry) {
+        if (entry.name[0] == '.')
+            return false;
+
+        const int nameLength = int(std::strlen(entry.name));
+        const QByteArray folded = CSearchQuery::fold(entry.name, nameLength);
+        CSearchQuery::Subject subject;
+        subject.name = entry.name;
+        subject.nameLength = nameLength;
+        subject.folded = folded.constData();
+        subject.foldedLength = int(folded.size());
+        subject.isDir = entry.type == CDirWalker::Directory;
+
+        // Entries are only stat'ed when the query needs their size or date,
+        // or once they match.
+        CDirWalker::Stat st;
+        CSearchQuery::Match match = session->query.match(subject);
+        if (match == CSearchQuery::NeedsMetadata) {
+            match = CSearchQuery::No;
+            if (entry.stat(st)) {
+                subject.hasMetadata = true;
+                subject.size = st.size;
+                subject.modifiedMs = st.modifiedMs;
+                match = session->query.match(subject);
+            }
+        }
+
+        if (match != CSearchQuery::Yes) return true;
+        if (session->scanner) {
+            scanContents(session, entry, subject.hasMetadata ? &st : nullptr);
+            return true;
+        }
+
+        if (!subject.hasMetadata)
+            entry.stat(st);
+
+        CSearchResult result;
+        result.path = QFile::decodeName(entry.filePath());
+        result.name = entry.fileName();
+        result.isDir = entry.type == CDirWalker::Directory;
+        result.size = result.isDir ? 0 : st.size;
+        result.lastModified = QDateTime::fromMSecsSinceEpoch(st.modifiedMs);
+
+        {
+            QMutexLocker locker(&session->mutex);
+            session->batch.append(result);
+        }
+        flush(session, false);
+        return true;
+    };
+
+    session->walker.walk(rootPath, visitor);
+
+    flush(session, true);
+    emit finished(session->id, session->cancelled);
+}
+
+void CSearchEngine::scanContents(const std::shared_ptr<Session> &session, const CDirWalker::Entry &entry,
+                                 const CDirWalker::Stat *known) {
+    // Links are left out so that no file is read twice.
+    if (entry.type != CDirWalker::File) return;
+
+    CDirWalker::Stat st;
+    if (known)
+        st = *known;
+    else if (!entry.stat(st))
+        return;
+    if (st.size == 0 || st.size > session->contentSizeLimit) return;
+
+    const QString path = QFile::decodeName(entry.filePath());
+    QVector<CContentScanner::Hit> hits;
+    if (session->scanner->scan(path, kMaxHitsPerFile, session->cancelled, hits) != CContentScanner::Scanned
+        || hits.isEmpty()) {
+        return;
+    }
+
+    const QString name = entry.fileName();
+    const QDateTime lastModified = QDateTime::fromMSecsSinceEpoch(st.modifiedMs);
+    {
+        QMutexLocker locker(&session->mutex);
+        for (const CContentScanner::Hit &hit : std::as_const(hits)) {
+            CSearchResult result;
+            result.path = path;
+            result.name = name;
+            result.size = st.size;
+            result.lastModified = lastModified;
+            result.matchOffset = hit.offset;
+            result.matchLine = hit.line;
+            result.matchPreview = hit.preview;
+            session->batch.append(result);
+        }
+    }
+    flush(session, false);
+}
+
+void CSearchEngine::flush(const std::shared_ptr<Session> &session, bool force) {
+    QList<CSearchResult> results;
+
+    {
+        QMutexLocker locker(&session->mutex);
+        if (!force && session->batch.size() < kBatchSize
+            && session->sinceFlush.elapsed() < kBatchIntervalMs) {
+            return;
+        }
+        results.swap(session->batch);
+        session->sinceFlush.restart();
+    }
+
+    if (!results.isEmpty() && !session->cancelled) {
+        emit resultsReady(session->id, results);
+    }
+}
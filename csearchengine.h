@@ -0,0 +1,62 @@
+#ifndef CSEARCHENGINE_H
+#define CSEARCHENGINE_H
+
+#include "cdirwalker.h"
+#include "csearchquery.h"
+
+#include <QObject>
+#include <QThreadPool>
+#include <QDateTime>
+#include <QList>
+#include <QMetaType>
+
+#include <memory>
+
+class CSearchIndex;
+
+struct CSearchResult {
+    QString path;
+    QString name;
+    qint64 size = 0;
+    QDateTime lastModified;
+    bool isDir = false;
+    // Where a content search found its text; matchLine is 0 for name matches.
+    qint64 matchOffset = -1;
+    int matchLine = 0;
+    QString matchPreview;
+};
+
+Q_DECLARE_METATYPE(CSearchResult)
+
+class CSearchEngine : public QObject {
+    Q_OBJECT
+
+public:
+    explicit CSearchEngine(QObject *parent = nullptr);
+    ~CSearchEngine() override;
+
+    void setIndex(CSearchIndex *searchIndex);
+
+    quint64 start(const CSearchQuery &query, const QString &rootPath);
+    void cancel();
+
+signals:
+    void resultsReady(quint64 searchId, const QList<CSearchResult> &results);
+    void finished(quint64 searchId, bool cancelled);
+
+private:
+    struct Session;
+
+    void run(const std::shared_ptr<Session> &session, const QString &rootPath);
+    // Adds a result for every line of `entry` that has the content text.
+    void scanContents(const std::shared_ptr<Session> &session, const CDirWalker::Entry &entry,
+                      const CDirWalker::Stat *known);
+    void flush(const std::shared_ptr<Session> &session, bool force);
+
+    QThreadPool pool;
+    CSearchIndex *index = nullptr;
+    std::shared_ptr<Session> current;
+    quint64 nextSearchId = 1;
+};
+
+#endif // CSEARCHENGINE_H
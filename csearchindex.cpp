@@ -0,0 +1,879 @@
+#include "csearchindex.h"
+#include "cchangewatcher.h"
+#include "cdirwalker.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+#include <QWriteLocker>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+namespace {
+constexpr char kMagic[8] = {'C', 'E', 'X', 'I', 'D', 'X', '0', '1'};
+constexpr quint32 kVersion = 1;
+constexpr quint32 kNoParent = 0xffffffffu;
+constexpr int kResultBatch = 512;
+constexpr int kRefreshDelayMs = 500;
+constexpr int kOverlayRebuildThreshold = 4096;
+constexpr qint64 kMaxIndexAgeMs = 24 * 60 * 60 * 1000;
+
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 rootPathLength;
+    qint64 builtAtMs;
+    quint64 entryCount;
+    quint64 nameCount;
+    quint64 suffixCount;
+    quint64 dirCount;
+    quint64 nameBytes;
+    quint64 foldedBytes;
+    quint64 entriesOffset;
+    quint64 namesOffset;
+    quint64 postingsOffset;
+    quint64 suffixesOffset;
+    quint64 dirsOffset;
+    quint64 nameBytesOffset;
+    quint64 foldedBytesOffset;
+};
+
+struct EntryRecord {
+    quint32 parent;
+    quint32 nameId;
+    qint64 size;
+    qint64 modifiedMs;
+    quint32 type;
+    quint32 reserved;
+};
+
+struct NameRecord {
+    quint32 nameOffset;
+    quint32 foldedOffset;
+    quint32 firstPosting;
+    quint32 postingCount;
+    quint16 nameLength;
+    quint16 foldedLength;
+};
+
+struct DirRecord {
+    quint64 hash;
+    quint32 entry;
+    quint32 firstChild;
+    quint32 childCount;
+    quint32 reserved;
+};
+
+quint64 pathHash(const QByteArray &path) {
+    quint64 hash = 1469598103934665603ull;
+    for (char c : path) {
+        hash ^= uchar(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+QByteArray joinPath(const QByteArray &dir, const QByteArray &name) {
+    if (dir.endsWith('/')) return dir + name;
+    return dir + '/' + name;
+}
+
+bool isUnder(const QByteArray &path, const QByteArray &location) {
+    if (path == location) return true;
+    if (location.endsWith('/')) return path.startsWith(location);
+    return path.startsWith(location) && path.size() > location.size() && path.at(location.size()) == '/';
+}
+
+qint64 align8(qint64 value) {
+    return (value + 7) & ~qint64(7);
+}
+
+CDirWalker::EntryType typeOf(const QFileInfo &info) {
+    if (info.isSymLink()) return CDirWalker::SymLink;
+    if (info.isDir()) return CDirWalker::Directory;
+    if (info.isFile()) return CDirWalker::File;
+    return CDirWalker::Other;
+}
+
+bool writeIndex(const QString &rootPath, const QString &fileName, CDirWalker &walker) {
+    QMutex mutex;
+    std::vector<EntryRecord> entries;
+    std::vector<QByteArray> names;
+    QHash<QByteArray, quint32> nameIds;
+    std::vector<DirRecord> dirs;
+
+    auto internName = [&](const QByteArray &name) {
+        auto it = nameIds.constFind(name);
+        if (it != nameIds.constEnd()) return it.value();
+        quint32 id = quint32(names.size());
+        names.push_back(name);
+        nameIds.insert(name, id);
+        return id;
+    };
+
+    const QByteArray encodedRoot = QFile::encodeName(rootPath);
+    CDirWalker::Stat rootStat;
+    CDirWalker::stat(encodedRoot, rootStat);
+    entries.push_back({kNoParent, internName(QByteArray()), 0, rootStat.modifiedMs, CDirWalker::Directory, 0});
+    dirs.push_back({pathHash(encodedRoot), 0, 0, 0, 0});
+
+    CDirWalker::Visitor visitor;
+    visitor.entry = [&](const CDirWalker::Entry &entry) {
+        if (entry.name[0] == '.') return false;
+
+        CDirWalker::Stat st;
+        entry.stat(st);
+        const bool isDir = entry.type == CDirWalker::Directory;
+        const QByteArray name(entry.name);
+        const QByteArray path = isDir ? entry.filePath() : QByteArray();
+
+        QMutexLocker locker(&mutex);
+        quint32 id = quint32(entries.size());
+        entries.push_back({quint32(entry.dir.tag), internName(name), isDir ? 0 : st.size,
+                           st.modifiedMs, quint32(entry.type), 0});
+        if (isDir) {
+            dirs.push_back({pathHash(path), id, 0, 0, 0});
+            entry.childTag = id;
+        }
+        return true;
+    };
+
+    if (!walker.walk(rootPath, visitor, 0)) return false;
+
+    // Renumber breadth-first so that the children of every directory are contiguous.
+    const quint32 count = quint32(entries.size());
+    std::vector<quint32> childStart(count + 1, 0);
+    for (quint32 i = 1; i < count; ++i) ++childStart[entries[i].parent + 1];
+    for (quint32 i = 0; i < count; ++i) childStart[i + 1] += childStart[i];
+
+    std::vector<quint32> byParent(count);
+    {
+        std::vector<quint32> cursor(childStart.begin(), childStart.end() - 1);
+        for (quint32 i = 1; i < count; ++i) byParent[cursor[entries[i].parent]++] = i;
+    }
+
+    std::vector<quint32> order;
+    std::vector<quint32> newId(count, 0);
+    order.reserve(count);
+    order.push_back(0);
+    for (size_t head = 0; head < order.size(); ++head) {
+        quint32 old = order[head];
+        for (quint32 k = childStart[old]; k < childStart[old + 1]; ++k) {
+            newId[byParent[k]] = quint32(order.size());
+            order.push_back(byParent[k]);
+        }
+    }
+
+    std::vector<EntryRecord> sorted(count);
+    for (quint32 i = 0; i < count; ++i) {
+        sorted[i] = entries[order[i]];
+        sorted[i].parent = i == 0 ? kNoParent : newId[sorted[i].parent];
+    }
+    entries.clear();
+    entries.shrink_to_fit();
+
+    for (DirRecord &dir : dirs) {
+        quint32 old = dir.entry;
+        dir.entry = newId[old];
+        dir.childCount = childStart[old + 1] - childStart[old];
+        dir.firstChild = dir.childCount ? newId[byParent[childStart[old]]] : 0;
+    }
+    std::sort(dirs.begin(), dirs.end(), [](const DirRecord &a, const DirRecord &b) {
+        return a.hash < b.hash;
+    });
+
+    const quint32 nameCount = quint32(names.size());
+    std::vector<NameRecord> nameRecords(nameCount);
+    QByteArray nameBytes;
+    QByteArray foldedBytes;
+    for (quint32 id = 0; id < nameCount; ++id) {
+        const QByteArray folded = QFile::decodeName(names[id]).toCaseFolded().toUtf8();
+        NameRecord &record = nameRecords[id];
+        record.nameOffset = quint32(nameBytes.size());
+        record.nameLength = quint16(qMin<qsizetype>(names[id].size(), 0xffff));
+        record.foldedOffset = quint32(foldedBytes.size());
+        record.foldedLength = quint16(qMin<qsizetype>(folded.size(), 0xffff));
+        nameBytes.append(names[id]).append('\0');
+        foldedBytes.append(folded).append('\0');
+    }
+
+    std::vector<quint32> postings(count);
+    for (quint32 i = 0; i < count; ++i) ++nameRecords[sorted[i].nameId].postingCount;
+    quint32 running = 0;
+    for (NameRecord &record : nameRecords) {
+        record.firstPosting = running;
+        running += record.postingCount;
+        record.postingCount = 0;
+    }
+    for (quint32 i = 0; i < count; ++i) {
+        NameRecord &record = nameRecords[sorted[i].nameId];
+        postings[record.firstPosting + record.postingCount++] = i;
+    }
+
+    std::vector<quint32> suffixes;
+    const char *folded = foldedBytes.constData();
+    for (const NameRecord &record : nameRecords) {
+        for (quint32 pos = 0; pos < record.foldedLength; ++pos) {
+            if ((uchar(folded[record.foldedOffset + pos]) & 0xC0) != 0x80)
+                suffixes.push_back(record.foldedOffset + pos);
+        }
+    }
+    std::sort(suffixes.begin(), suffixes.end(), [folded](quint32 a, quint32 b) {
+        return std::strcmp(folded + a, folded + b) < 0;
+    });
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.rootPathLength = quint32(encodedRoot.size());
+    header.builtAtMs = QDateTime::currentMSecsSinceEpoch();
+    header.entryCount = count;
+    header.nameCount = nameCount;
+    header.suffixCount = suffixes.size();
+    header.dirCount = dirs.size();
+    header.nameBytes = quint64(nameBytes.size());
+    header.foldedBytes = quint64(foldedBytes.size());
+
+    qint64 offset = align8(sizeof(Header) + encodedRoot.size());
+    auto place = [&offset](quint64 &field, qint64 bytes) {
+        field = quint64(offset);
+        offset = align8(offset + bytes);
+    };
+    place(header.entriesOffset, qint64(count) * sizeof(EntryRecord));
+    place(header.namesOffset, qint64(nameCount) * sizeof(NameRecord));
+    place(header.postingsOffset, qint64(count) * sizeof(quint32));
+    place(header.suffixesOffset, qint64(suffixes.size()) * sizeof(quint32));
+    place(header.dirsOffset, qint64(dirs.size()) * sizeof(DirRecord));
+    place(header.nameBytesOffset, nameBytes.size());
+    place(header.foldedBytesOffset, foldedBytes.size());
+
+    QSaveFile out(fileName);
+    if (!out.open(QIODevice::WriteOnly)) return false;
+
+    bool ok = true;
+    auto writeAt = [&](quint64 at, const void *data, qint64 bytes) {
+        static const char zeros[8] = {};
+        while (ok && out.pos() < qint64(at))
+            ok = out.write(zeros, qMin<qint64>(8, qint64(at) - out.pos())) > 0;
+        if (ok && bytes > 0)
+            ok = out.write(static_cast<const char *>(data), bytes) == bytes;
+    };
+    writeAt(0, &header, sizeof(header));
+    writeAt(sizeof(header), encodedRoot.constData(), encodedRoot.size());
+    writeAt(header.entriesOffset, sorted.data(), qint64(count) * sizeof(EntryRecord));
+    writeAt(header.namesOffset, nameRecords.data(), qint64(nameCount) * sizeof(NameRecord));
+    writeAt(header.postingsOffset, postings.data(), qint64(count) * sizeof(quint32));
+    writeAt(header.suffixesOffset, suffixes.data(), qint64(suffixes.size()) * sizeof(quint32));
+    writeAt(header.dirsOffset, dirs.data(), qint64(dirs.size()) * sizeof(DirRecord));
+    writeAt(header.nameBytesOffset, nameBytes.constData(), nameBytes.size());
+    writeAt(header.foldedBytesOffset, foldedBytes.constData(), foldedBytes.size());
+
+    if (!ok) {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
+}
+
+struct CSearchIndex::Root {
+    struct OverlayEntry {
+        QByteArray name;
+        QByteArray folded;
+        CDirWalker::EntryType type = CDirWalker::Unknown;
+        qint64 size = 0;
+        qint64 modifiedMs = 0;
+    };
+
+    struct OverlayDir {
+        QVector<OverlayEntry> entries;
+        QSet<QByteArray> subdirs;
+    };
+
+    ~Root();
+
+    QString path;
+    QByteArray encodedPath;
+    QString fileName;
+    QFile file;
+    std::atomic<bool> obsolete{false};
+
+    const Header *header = nullptr;
+    const EntryRecord *entries = nullptr;
+    const NameRecord *names = nullptr;
+    const quint32 *postings = nullptr;
+    const quint32 *suffixes = nullptr;
+    const DirRecord *dirs = nullptr;
+    const char *nameBytes = nullptr;
+    const char *foldedBytes = nullptr;
+
+    QMutex overlayMutex;
+    QHash<QByteArray, OverlayDir> overlay;
+
+    QByteArray nameOf(quint32 entry) const;
+    QByteArray pathOf(quint32 entry, QHash<quint32, QByteArray> &cache) const;
+    const DirRecord *findDir(const QByteArray &path) const;
+};
+
+CSearchIndex::Root::~Root() {
+    file.close();
+    if (obsolete) QFile::remove(fileName);
+}
+
+QByteArray CSearchIndex::Root::nameOf(quint32 entry) const {
+    const NameRecord &name = names[entries[entry].nameId];
+    return QByteArray(nameBytes + name.nameOffset, name.nameLength);
+}
+
+QByteArray CSearchIndex::Root::pathOf(quint32 entry, QHash<quint32, QByteArray> &cache) const {
+    if (entry == 0) return encodedPath;
+
+    auto it = cache.constFind(entry);
+    if (it != cache.constEnd()) return it.value();
+
+    QByteArray path = joinPath(pathOf(entries[entry].parent, cache), nameOf(entry));
+    if (entries[entry].type == CDirWalker::Directory)
+        cache.insert(entry, path);
+    return path;
+}
+
+const DirRecord *CSearchIndex::Root::findDir(const QByteArray &path) const {
+    const quint64 hash = pathHash(path);
+    const DirRecord *end = dirs + header->dirCount;
+    const DirRecord *it = std::lower_bound(dirs, end, hash, [](const DirRecord &record, quint64 value) {
+        return record.hash < value;
+    });
+
+    QHash<quint32, QByteArray> cache;
+    for (; it != end && it->hash == hash; ++it) {
+        if (pathOf(it->entry, cache) == path) return it;
+    }
+    return nullptr;
+}
+
+CSearchIndex::CSearchIndex(QObject *parent)
+    : QObject(parent) {
+    indexDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/index";
+    QDir().mkpath(indexDirectory);
+    pool.setMaxThreadCount(2);
+
+    refreshTimer = new QTimer(this);
+    refreshTimer->setSingleShot(true);
+    refreshTimer->setInterval(kRefreshDelayMs);
+    connect(refreshTimer, &QTimer::timeout, this, &CSearchIndex::refreshPending);
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QStringList stale;
+    const QStringList files = QDir(indexDirectory).entryList({"*.idx"}, QDir::Files, QDir::Time);
+    for (const QString &file : files) {
+        std::shared_ptr<Root> root = load(indexDirectory + "/" + file);
+        if (!root) continue;
+
+        if (roots.contains(root->path)) {
+            root->obsolete = true;
+            continue;
+        }
+
+        roots.insert(root->path, root);
+        if (now - root->header->builtAtMs > kMaxIndexAgeMs)
+            stale.append(root->path);
+    }
+
+    for (const QString &rootPath : std::as_const(stale))
+        rebuild(rootPath);
+}
+
+CSearchIndex::~CSearchIndex() {
+    {
+        QMutexLocker locker(&buildMutex);
+        for (CDirWalker *walker : std::as_const(activeWalkers))
+            walker->cancel();
+    }
+    pool.clear();
+    pool.waitForDone();
+}
+
+QString CSearchIndex::indexFileFor(const QString &rootPath) const {
+    const QByteArray hash = QCryptographicHash::hash(rootPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QString("%1/%2-%3.idx").arg(indexDirectory, QString::fromLatin1(hash))
+        .arg(QDateTime::currentMSecsSinceEpoch());
+}
+
+std::shared_ptr<CSearchIndex::Root> CSearchIndex::load(const QString &fileName) const {
+    auto root = std::make_shared<Root>();
+    root->fileName = fileName;
+    root->file.setFileName(fileName);
+    if (!root->file.open(QIODevice::ReadOnly)) return nullptr;
+
+    const quint64 size = quint64(root->file.size());
+    const uchar *data = size >= sizeof(Header) ? root->file.map(0, qint64(size)) : nullptr;
+    if (!data) {
+        root->obsolete = true;
+        return nullptr;
+    }
+
+    const Header *header = reinterpret_cast<const Header *>(data);
+    auto fits = [size](quint64 offset, quint64 count, quint64 elementSize) {
+        return offset <= size && count <= (size - offset) / elementSize;
+    };
+
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion
+        || header->entryCount == 0 || header->foldedBytes == 0
+        || !fits(sizeof(Header), header->rootPathLength, 1)
+        || !fits(header->entriesOffset, header->entryCount, sizeof(EntryRecord))
+        || !fits(header->namesOffset, header->nameCount, sizeof(NameRecord))
+        || !fits(header->postingsOffset, header->entryCount, sizeof(quint32))
+        || !fits(header->suffixesOffset, header->suffixCount, sizeof(quint32))
+        || !fits(header->dirsOffset, header->dirCount, sizeof(DirRecord))
+        || !fits(header->nameBytesOffset, header->nameBytes, 1)
+        || !fits(header->foldedBytesOffset, header->foldedBytes, 1)) {
+        root->obsolete = true;
+        return nullptr;
+    }
+
+    root->header = header;
+    root->entries = reinterpret_cast<const EntryRecord *>(data + header->entriesOffset);
+    root->names = reinterpret_cast<const NameRecord *>(data + header->namesOffset);
+    root->postings = reinterpret_cast<const quint32 *>(data + header->postingsOffset);
+    root->suffixes = reinterpret_cast<const quint32 *>(data + header->suffixesOffset);
+    root->dirs = reinterpret_cast<const DirRecord *>(data + header->dirsOffset);
+    root->nameBytes = reinterpret_cast<const char *>(data + header->nameBytesOffset);
+    root->foldedBytes = reinterpret_cast<const char *>(data + header->foldedBytesOffset);
+    root->encodedPath = QByteArray(reinterpret_cast<const char *>(data + sizeof(Header)), header->rootPathLength);
+    root->path = QFile::decodeName(root->encodedPath);
+    return root;
+}
+
+std::shared_ptr<CSearchIndex::Root> CSearchIndex::rootFor(const QString &path) const {
+    const QByteArray encoded = QFile::encodeName(QDir::cleanPath(path));
+
+    QReadLocker locker(&lock);
+    std::shared_ptr<Root> best;
+    for (const std::shared_ptr<Root> &root : roots) {
+        if (isUnder(encoded, root->encodedPath)
+            && (!best || root->encodedPath.size() > best->encodedPath.size())) {
+            best = root;
+        }
+    }
+    return best;
+}
+
+bool CSearchIndex::covers(const QString &path) const {
+    return rootFor(path) != nullptr;
+}
+
+void CSearchIndex::setChangeWatcher(CChangeWatcher *watcher) {
+    changeWatcher = watcher;
+    connect(changeWatcher, &CChangeWatcher::directoryChanged, this, &CSearchIndex::invalidateDirectory);
+    connect(changeWatcher, &CChangeWatcher::treeWatched, this, &CSearchIndex::treeWatched);
+    connect(changeWatcher, &CChangeWatcher::treeOverflowed, this, [this](const QString &rootPath) {
+        {
+            QWriteLocker locker(&lock);
+            currentRoots.remove(rootPath);
+        }
+        rebuild(rootPath);
+    });
+    // A new index may have missed changes made while it was being built.
+    connect(this, &CSearchIndex::rootIndexed, this, [this](const QString &rootPath) {
+        if (watchedRoots.contains(rootPath))
+            reconcile(rootPath);
+        else
+            changeWatcher->watchTree(rootPath);
+    });
+
+    QStringList rootPaths;
+    {
+        QReadLocker locker(&lock);
+        rootPaths = roots.keys();
+    }
+    for (const QString &rootPath : std::as_const(rootPaths))
+        changeWatcher->watchTree(rootPath);
+}
+
+void CSearchIndex::ensureIndexed(const QString &rootPath) {
+    std::shared_ptr<Root> root = rootFor(rootPath);
+    if (!root)
+        rebuild(rootPath);
+    else if (QDateTime::currentMSecsSinceEpoch() - root->header->builtAtMs > kMaxIndexAgeMs)
+        rebuild(root->path);
+}
+
+void CSearchIndex::rebuild(const QString &rootPath) {
+    const QString clean = QDir::cleanPath(QFileInfo(rootPath).absoluteFilePath());
+    {
+        QWriteLocker locker(&lock);
+        if (building.contains(clean)) return;
+        building.insert(clean);
+    }
+
+    const QString fileName = indexFileFor(clean);
+    pool.start([this, clean, fileName] {
+        CDirWalker walker;
+        {
+            QMutexLocker locker(&buildMutex);
+            activeWalkers.append(&walker);
+        }
+
+        const bool written = writeIndex(clean, fileName, walker);
+
+        {
+            QMutexLocker locker(&buildMutex);
+            activeWalkers.removeOne(&walker);
+        }
+
+        std::shared_ptr<Root> root = written ? load(fileName) : nullptr;
+        std::shared_ptr<Root> previous;
+        {
+            QWriteLocker locker(&lock);
+            building.remove(clean);
+            if (root) {
+                previous = roots.value(clean);
+                roots.insert(clean, root);
+            }
+        }
+
+        if (previous) previous->obsolete = true;
+        if (!written) QFile::remove(fileName);
+        if (root) emit rootIndexed(clean);
+    });
+}
+
+void CSearchIndex::treeWatched(const QString &rootPath, bool complete) {
+    if (!complete) {
+        watchedRoots.remove(rootPath);
+        QWriteLocker locker(&lock);
+        currentRoots.remove(rootPath);
+        return;
+    }
+
+    watchedRoots.insert(rootPath);
+    reconcile(rootPath);
+}
+
+void CSearchIndex::reconcile(const QString &rootPath) {
+    std::shared_ptr<Root> root;
+    {
+        QReadLocker locker(&lock);
+        root = roots.value(rootPath);
+    }
+    if (!root) return;
+
+    // Whatever changed before the watch was in place shows as a folder whose
+    // time differs from the index; those folders are listed again before the
+    // root answers queries.
+    pool.start([this, root] {
+        CDirWalker walker;
+        {
+            QMutexLocker locker(&buildMutex);
+            activeWalkers.append(&walker);
+        }
+
+        QMutex mutex;
+        QStringList stale;
+        auto check = [&](const QByteArray &path) {
+            CDirWalker::Stat st;
+            const DirRecord *record = root->findDir(path);
+            if (record && CDirWalker::stat(path, st) && st.modifiedMs == root->entries[record->entry].modifiedMs)
+                return true;
+
+            QMutexLocker locker(&mutex);
+            stale.append(QFile::decodeName(path));
+            return record != nullptr;
+        };
+
+        CDirWalker::Visitor visitor;
+        visitor.entry = [&](const CDirWalker::Entry &entry) {
+            if (entry.name[0] == '.' || entry.type != CDirWalker::Directory) return false;
+            // Folders missing from the index are picked up with their parent.
+            return check(entry.filePath());
+        };
+        check(root->encodedPath);
+        const bool walked = walker.walk(root->path, visitor);
+
+        {
+            QMutexLocker locker(&buildMutex);
+            activeWalkers.removeOne(&walker);
+        }
+        if (!walked) return;
+
+        for (const QString &path : std::as_const(stale))
+            refreshDirectory(root, path);
+
+        QWriteLocker locker(&lock);
+        currentRoots.insert(root->path);
+    });
+}
+
+void CSearchIndex::invalidateDirectory(const QString &path) {
+    if (path.isEmpty()) return;
+
+    pendingRefresh.insert(QDir::cleanPath(path));
+    refreshTimer->start();
+}
+
+void CSearchIndex::refreshPending() {
+    const QSet<QString> paths = std::move(pendingRefresh);
+    pendingRefresh.clear();
+
+    for (const QString &path : paths) {
+        std::shared_ptr<Root> root = rootFor(path);
+        if (!root) continue;
+
+        const QByteArray relative = QFile::encodeName(path).mid(root->encodedPath.size());
+        if (relative.startsWith('.') || relative.contains("/.")) continue;
+
+        pool.start([this, root, path] {
+            refreshDirectory(root, path);
+        });
+    }
+}
+
+void CSearchIndex::refreshDirectory(const std::shared_ptr<Root> &root, const QString &path) {
+    const QByteArray encodedPath = QFile::encodeName(path);
+
+    auto listDirectory = [](const QString &dirPath) {
+        Root::OverlayDir listing;
+        const QFileInfoList infos = QDir(dirPath).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System);
+        for (const QFileInfo &info : infos) {
+            Root::OverlayEntry entry;
+            entry.name = QFile::encodeName(info.fileName());
+            entry.folded = info.fileName().toCaseFolded().toUtf8();
+            entry.type = typeOf(info);
+            entry.size = entry.type == CDirWalker::Directory ? 0 : info.size();
+            entry.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+            if (entry.type == CDirWalker::Directory)
+                listing.subdirs.insert(entry.name);
+            listing.entries.append(entry);
+        }
+        return listing;
+    };
+
+    QHash<QByteArray, Root::OverlayDir> fresh;
+    Root::OverlayDir listing = listDirectory(path);
+    const DirRecord *record = QFileInfo(path).isDir() ? root->findDir(encodedPath) : nullptr;
+
+    bool changed = record == nullptr || record->childCount != quint32(listing.entries.size());
+    if (!changed) {
+        QHash<QByteArray, quint32> base;
+        for (quint32 i = 0; i < record->childCount; ++i)
+            base.insert(root->nameOf(record->firstChild + i), record->firstChild + i);
+
+        for (const Root::OverlayEntry &entry : std::as_const(listing.entries)) {
+            auto it = base.constFind(entry.name);
+            if (it == base.constEnd()) {
+                changed = true;
+                break;
+            }
+            const EntryRecord &known = root->entries[it.value()];
+            if (known.type != quint32(entry.type)
+                || (entry.type != CDirWalker::Directory
+                    && (known.size != entry.size || known.modifiedMs != entry.modifiedMs))) {
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (changed && QFileInfo(path).isDir()) {
+        for (const QByteArray &subdir : std::as_const(listing.subdirs)) {
+            const QByteArray childPath = joinPath(encodedPath, subdir);
+            if (root->findDir(childPath)) continue;
+
+            QMutex mutex;
+            fresh.insert(childPath, Root::OverlayDir());
+
+            CDirWalker walker;
+            CDirWalker::Visitor visitor;
+            visitor.entry = [&](const CDirWalker::Entry &entry) {
+                if (entry.name[0] == '.') return false;
+
+                CDirWalker::Stat st;
+                entry.stat(st);
+
+                Root::OverlayEntry overlayEntry;
+                overlayEntry.name = QByteArray(entry.name);
+                overlayEntry.folded = entry.fileName().toCaseFolded().toUtf8();
+                overlayEntry.type = entry.type;
+                overlayEntry.size = entry.type == CDirWalker::Directory ? 0 : st.size;
+                overlayEntry.modifiedMs = st.modifiedMs;
+
+                QMutexLocker locker(&mutex);
+                Root::OverlayDir &dir = fresh[entry.dir.path];
+                dir.entries.append(overlayEntry);
+                if (entry.type == CDirWalker::Directory) {
+                    dir.subdirs.insert(overlayEntry.name);
+                    fresh[entry.filePath()];
+                }
+                return true;
+            };
+            walker.walk(QFile::decodeName(childPath), visitor);
+        }
+        fresh.insert(encodedPath, listing);
+    }
+
+    int overlaySize = 0;
+    {
+        QMutexLocker locker(&root->overlayMutex);
+        if (changed) {
+            for (auto it = fresh.constBegin(); it != fresh.constEnd(); ++it)
+                root->overlay.insert(it.key(), it.value());
+        } else {
+            root->overlay.remove(encodedPath);
+        }
+        overlaySize = root->overlay.size();
+    }
+
+    if (overlaySize > kOverlayRebuildThreshold)
+        rebuild(root->path);
+}
+
+bool CSearchIndex::query(const CSearchQuery &query, const QString &location, const ResultSink &sink) const {
+    std::shared_ptr<Root> root = rootFor(location);
+    if (!root) return false;
+    {
+        QReadLocker locker(&lock);
+        if (!currentRoots.contains(root->path)) return false;
+    }
+
+    const QByteArray encodedLocation = QFile::encodeName(QDir::cleanPath(location));
+
+    QHash<QByteArray, Root::OverlayDir> overlay;
+    {
+        QMutexLocker locker(&root->overlayMutex);
+        overlay = root->overlay;
+    }
+
+    QList<CSearchResult> batch;
+    bool keepGoing = true;
+    const Header &header = *root->header;
+    const char *foldedBytes = root->foldedBytes;
+    std::vector<quint32> nameIds;
+
+    // Names that contain what every match must contain are found through the
+    // suffix array; queries without such a part look at every name.
+    const QByteArray required = query.requiredSubstring();
+    if (required.isEmpty()) {
+        nameIds.resize(header.nameCount);
+        std::iota(nameIds.begin(), nameIds.end(), 0u);
+    } else {
+        const quint32 *suffixEnd = root->suffixes + header.suffixCount;
+        const quint32 *lower = std::lower_bound(root->suffixes, suffixEnd, required,
+                                                [foldedBytes](quint32 pos, const QByteArray &text) {
+            return std::strncmp(foldedBytes + pos, text.constData(), text.size()) < 0;
+        });
+        const quint32 *upper = std::upper_bound(lower, suffixEnd, required,
+                                                [foldedBytes](const QByteArray &text, quint32 pos) {
+            return std::strncmp(foldedBytes + pos, text.constData(), text.size()) > 0;
+        });
+
+        nameIds.reserve(upper - lower);
+        const NameRecord *namesEnd = root->names + header.nameCount;
+        for (const quint32 *it = lower; it != upper; ++it) {
+            const NameRecord *name = std::upper_bound(root->names, namesEnd, *it,
+                                                      [](quint32 pos, const NameRecord &record) {
+                return pos < record.foldedOffset;
+            });
+            nameIds.push_back(quint32(name - root->names - 1));
+        }
+        std::sort(nameIds.begin(), nameIds.end());
+        nameIds.erase(std::unique(nameIds.begin(), nameIds.end()), nameIds.end());
+    }
+
+    auto matches = [&query](const QByteArray &name, const QByteArray &folded, CDirWalker::EntryType type,
+                            qint64 size, qint64 modifiedMs) {
+        CSearchQuery::Subject subject;
+        subject.name = name.constData();
+        subject.nameLength = int(name.size());
+        subject.folded = folded.constData();
+        subject.foldedLength = int(folded.size());
+        subject.isDir = type == CDirWalker::Directory;
+        subject.hasMetadata = true;
+        subject.size = size;
+        subject.modifiedMs = modifiedMs;
+        return query.match(subject) == CSearchQuery::Yes;
+    };
+
+    // A change can still be on its way to the overlay, so every hit is looked
+    // up on disk and reported as it is now, if it still matches.
+    auto add = [&](const QByteArray &path, const QByteArray &name, const QByteArray &folded) {
+        CDirWalker::Stat st;
+        if (!CDirWalker::stat(path, st)) return;
+        const qint64 size = st.type == CDirWalker::Directory ? 0 : st.size;
+        if (!matches(name, folded, st.type, size, st.modifiedMs)) return;
+
+        CSearchResult result;
+        result.path = QFile::decodeName(path);
+        result.name = QFile::decodeName(name);
+        result.isDir = st.type == CDirWalker::Directory;
+        result.size = size;
+        result.lastModified = QDateTime::fromMSecsSinceEpoch(st.modifiedMs);
+        batch.append(result);
+
+        if (batch.size() >= kResultBatch) {
+            keepGoing = sink(batch);
+            batch.clear();
+        }
+    };
+
+    QHash<quint32, QByteArray> pathCache;
+    QHash<quint32, bool> visibleDirs;
+    auto isVisibleDir = [&](quint32 dir) {
+        auto it = visibleDirs.constFind(dir);
+        if (it != visibleDirs.constEnd()) return it.value();
+
+        const QByteArray dirPath = root->pathOf(dir, pathCache);
+        bool visible = isUnder(dirPath, encodedLocation) && !overlay.contains(dirPath);
+        for (quint32 cur = dir; visible && cur != 0; cur = root->entries[cur].parent) {
+            auto parent = overlay.constFind(root->pathOf(root->entries[cur].parent, pathCache));
+            if (parent != overlay.constEnd() && !parent->subdirs.contains(root->nameOf(cur)))
+                visible = false;
+        }
+
+        visibleDirs.insert(dir, visible);
+        return visible;
+    };
+
+    for (quint32 nameId : nameIds) {
+        const NameRecord &name = root->names[nameId];
+        const QByteArray nameBytes = QByteArray::fromRawData(root->nameBytes + name.nameOffset, name.nameLength);
+        const QByteArray folded = QByteArray::fromRawData(foldedBytes + name.foldedOffset, name.foldedLength);
+        for (quint32 i = 0; keepGoing && i < name.postingCount; ++i) {
+            const quint32 entry = root->postings[name.firstPosting + i];
+            const EntryRecord &record = root->entries[entry];
+            if (record.parent == kNoParent) continue;
+            if (!matches(nameBytes, folded, CDirWalker::EntryType(record.type), record.size, record.modifiedMs))
+                continue;
+            if (!isVisibleDir(record.parent)) continue;
+
+            const QByteArray entryName = root->nameOf(entry);
+            add(joinPath(root->pathOf(record.parent, pathCache), entryName), entryName, folded);
+        }
+        if (!keepGoing) return true;
+    }
+
+    for (auto it = overlay.constBegin(); keepGoing && it != overlay.constEnd(); ++it) {
+        if (!isUnder(it.key(), encodedLocation)) continue;
+
+        for (const Root::OverlayEntry &entry : it->entries) {
+            if (!keepGoing) break;
+            if (matches(entry.name, entry.folded, entry.type, entry.size, entry.modifiedMs))
+                add(joinPath(it.key(), entry.name), entry.name, entry.folded);
+        }
+    }
+
+    if (keepGoing && !batch.isEmpty())
+        sink(batch);
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef CSEARCHINDEX_H
+#define CSEARCHINDEX_H
+
+#include "csearchengine.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <functional>
+#include <memory>
+
+class CChangeWatcher;
+class CDirWalker;
+
+class CSearchIndex : public QObject {
+    Q_OBJECT
+
+public:
+    using ResultSink = std::function<bool(const QList<CSearchResult> &)>;
+
+    explicit CSearchIndex(QObject *parent = nullptr);
+    ~CSearchIndex() override;
+
+    // Indexed roots are kept current with a tree watch from `watcher`, and
+    // only answer queries while that watch is complete.
+    void setChangeWatcher(CChangeWatcher *watcher);
+
+    bool covers(const QString &path) const;
+    // Builds an index for `rootPath` unless one covers it, or rebuilds the
+    // covering one once it is older than a day.
+    void ensureIndexed(const QString &rootPath);
+    void rebuild(const QString &rootPath);
+
+    // Streams matches below `location` to `sink` until it returns false.
+    // Returns false without calling `sink` if no indexed root covers
+    // `location`, or if changes below the root are not being followed.
+    bool query(const CSearchQuery &query, const QString &location, const ResultSink &sink) const;
+
+public slots:
+    void invalidateDirectory(const QString &path);
+
+signals:
+    void rootIndexed(const QString &rootPath);
+
+private:
+    struct Root;
+
+    std::shared_ptr<Root> rootFor(const QString &path) const;
+    std::shared_ptr<Root> load(const QString &fileName) const;
+    void refreshPending();
+    void refreshDirectory(const std::shared_ptr<Root> &root, const QString &path);
+    void treeWatched(const QString &rootPath, bool complete);
+    void reconcile(const QString &rootPath);
+    QString indexFileFor(const QString &rootPath) const;
+
+    QString indexDirectory;
+    QThreadPool pool;
+    CChangeWatcher *changeWatcher = nullptr;
+    // Roots whose tree watch is complete.
+    QSet<QString> watchedRoots;
+
+    QSet<QString> pendingRefresh;
+    QTimer *refreshTimer;
+
+    QMutex buildMutex;
+    QList<CDirWalker *> activeWalkers;
+
+    mutable QReadWriteLock lock;
+    QHash<QString, std::shared_ptr<Root>> roots;
+    QSet<QString> building;
+    // Watched roots that have been checked against the disk since their
+    // index was built; only these answer queries.
+    QSet<QString> currentRoots;
+};
+
+#endif // CSEARCHINDEX_H
@@ -0,0 +1,774 @@
+#include "csearchquery.h"
+
+#include <QDate>
+#include <QDateTime>
+#include <QFile>
+#include <QList>
+#include <QRegularExpression>
+#include <QVector>
+
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+constexpr qint64 kMinValue = std::numeric_limits<qint64>::min();
+constexpr qint64 kMaxValue = std::numeric_limits<qint64>::max();
+constexpr qint64 kMinuteMs = 60 * 1000;
+constexpr qint64 kDayMs = 24 * 60 * kMinuteMs;
+
+// Whether `needle` occurs in `data`; both are folded already.
+bool containsBytes(const char *data, int length, const QByteArray &needle) {
+    const int needleLength = int(needle.size());
+    if (needleLength == 0) return true;
+
+    const char *pattern = needle.constData();
+    const int last = length - needleLength;
+    int i = 0;
+#ifdef __SSE2__
+    // Screens 16 starting positions at once by the first and last byte of the
+    // needle, and compares the whole needle only where both agree.
+    const __m128i head = _mm_set1_epi8(pattern[0]);
+    const __m128i tail = _mm_set1_epi8(pattern[needleLength - 1]);
+    for (; i + 15 <= last; i += 16) {
+        const __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), head);
+        const __m128i final =
+            _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + needleLength - 1)), tail);
+        uint mask = uint(_mm_movemask_epi8(_mm_and_si128(first, final)));
+        while (mask) {
+            const int at = i + qCountTrailingZeroBits(mask);
+            if (std::memcmp(data + at, pattern, needleLength) == 0) return true;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        if (data[i] == pattern[0] && std::memcmp(data + i, pattern, needleLength) == 0) return true;
+    }
+    return false;
+}
+
+int utf8Length(uchar lead) {
+    if (lead < 0xC0) return 1;
+    if (lead < 0xE0) return 2;
+    if (lead < 0xF0) return 3;
+    return 4;
+}
+
+// Matches the `[...]` set starting at pattern[p] against `c`. Returns the
+// position after the set, or -1 if it is not closed and `[` is literal.
+int matchSet(const QByteArray &pattern, int p, uchar c, bool &matched) {
+    const int length = int(pattern.size());
+    int i = p + 1;
+    const bool negated = i < length && (pattern.at(i) == '!' || pattern.at(i) == '^');
+    if (negated) ++i;
+
+    bool found = false;
+    for (const int first = i; i < length; ++i) {
+        const uchar ch = uchar(pattern.at(i));
+        if (ch == ']' && i > first) {
+            matched = found != negated;
+            return i + 1;
+        }
+        if (i + 2 < length && pattern.at(i + 1) == '-' && pattern.at(i + 2) != ']') {
+            found = found || (c >= ch && c <= uchar(pattern.at(i + 2)));
+            i += 2;
+        } else {
+            found = found || c == ch;
+        }
+    }
+    return -1;
+}
+
+// Shell-style match of the whole name: * is any run, ? one character and
+// [...] one byte out of a set.
+bool globMatches(const QByteArray &pattern, const char *name, int length) {
+    const int patternLength = int(pattern.size());
+    int p = 0;
+    int n = 0;
+    int star = -1;
+    int starName = 0;
+    while (n < length) {
+        if (p < patternLength) {
+            const char pc = pattern.at(p);
+            if (pc == '*') {
+                star = ++p;
+                starName = n;
+                continue;
+            }
+            if (pc == '?') {
+                n = qMin(length, n + utf8Length(uchar(name[n])));
+                ++p;
+                continue;
+            }
+
+            bool matched = false;
+            const int next = pc == '[' ? matchSet(pattern, p, uchar(name[n]), matched) : -1;
+            if (next >= 0) {
+                if (matched) {
+                    p = next;
+                    ++n;
+                    continue;
+                }
+            } else if (pc == name[n]) {
+                ++p;
+                ++n;
+                continue;
+            }
+        }
+        if (star < 0) return false;
+        p = star;
+        n = ++starName;
+    }
+    while (p < patternLength && pattern.at(p) == '*')
+        ++p;
+    return p == patternLength;
+}
+
+// The longest part of a glob without wildcards; every match contains it.
+QByteArray longestLiteral(const QByteArray &pattern) {
+    QByteArray longest;
+    QByteArray current;
+    for (int i = 0; i < pattern.size(); ++i) {
+        const char c = pattern.at(i);
+        if (c == '*' || c == '?' || c == '[') {
+            if (current.size() > longest.size()) longest = current;
+            current.clear();
+            if (c == '[') {
+                bool matched;
+                const int next = matchSet(pattern, i, 0, matched);
+                if (next >= 0) i = next - 1;
+            }
+            continue;
+        }
+        current.append(c);
+    }
+    return current.size() > longest.size() ? current : longest;
+}
+
+QByteArray foldText(const QString &text) {
+    return text.toCaseFolded().toUtf8();
+}
+
+bool parseSize(const QString &text, qint64 &bytes) {
+    static const QRegularExpression pattern("^(\\d+(?:\\.\\d+)?)\\s*([kmgt]?)b?$",
+                                            QRegularExpression::CaseInsensitiveOption);
+    const QRegularExpressionMatch match = pattern.match(text.trimmed());
+    if (!match.hasMatch()) return false;
+
+    double value = match.captured(1).toDouble();
+    const QString unit = match.captured(2).toLower();
+    const int steps = unit.isEmpty() ? 0 : int(QString("kmgt").indexOf(unit)) + 1;
+    for (int i = 0; i < steps; ++i)
+        value *= 1024.0;
+    if (value >= double(kMaxValue)) return false;
+    bytes = qint64(value);
+    return true;
+}
+
+// A date covers the whole day, [first, last]; an age is the instant that
+// long before `nowMs`.
+bool parseTime(const QString &text, qint64 nowMs, qint64 &first, qint64 &last, bool &age) {
+    const QString value = text.trimmed().toLower();
+    age = false;
+
+    QDate date;
+    if (value == "today")
+        date = QDateTime::fromMSecsSinceEpoch(nowMs).date();
+    else if (value == "yesterday")
+        date = QDateTime::fromMSecsSinceEpoch(nowMs).date().addDays(-1);
+    else
+        date = QDate::fromString(value, Qt::ISODate);
+
+    if (date.isValid()) {
+        first = date.startOfDay().toMSecsSinceEpoch();
+        last = date.addDays(1).startOfDay().toMSecsSinceEpoch() - 1;
+        return true;
+    }
+
+    static const QRegularExpression pattern("^(\\d+)\\s*([mhdw])$");
+    const QRegularExpressionMatch match = pattern.match(value);
+    if (!match.hasMatch()) return false;
+
+    qint64 unit = kMinuteMs;
+    switch (match.captured(2).at(0).unicode()) {
+    case 'h': unit = 60 * kMinuteMs; break;
+    case 'd': unit = kDayMs; break;
+    case 'w': unit = 7 * kDayMs; break;
+    }
+    first = last = nowMs - match.captured(1).toLongLong() * unit;
+    age = true;
+    return true;
+}
+
+// Splits a leading comparison off `value`; no operator means "=".
+QString takeOperator(QString &value) {
+    for (const char *op : {">=", "<=", ">", "<", "="}) {
+        if (value.startsWith(QLatin1String(op))) {
+            value = value.mid(int(std::strlen(op)));
+            return QString(op);
+        }
+    }
+    return QString("=");
+}
+}
+
+struct CSearchQuery::Node {
+    enum Kind {
+        All,
+        And,
+        Or,
+        Not,
+        Substring,
+        Glob,
+        Regex,
+        Extensions,
+        Size,
+        Modified,
+        Type,
+        Content
+    };
+
+    Kind kind = All;
+    std::vector<std::shared_ptr<Node>> children;
+    // Folded text of a substring, the folded pattern of a glob, or the
+    // UTF-8 text looked for inside files.
+    QByteArray bytes;
+    // For globs, the longest part without wildcards.
+    QByteArray literal;
+    // Folded, with the leading dot.
+    QList<QByteArray> extensions;
+    QRegularExpression regex;
+    // Inclusive bounds of a size or time.
+    qint64 low = kMinValue;
+    qint64 high = kMaxValue;
+    bool wantDir = false;
+
+    Match match(const Subject &subject) const;
+    QByteArray required() const;
+};
+
+CSearchQuery::Match CSearchQuery::Node::match(const Subject &subject) const {
+    switch (kind) {
+    case All:
+        return Yes;
+    case And: {
+        Match result = Yes;
+        for (const std::shared_ptr<Node> &child : children) {
+            const Match childMatch = child->match(subject);
+            if (childMatch == No) return No;
+            if (childMatch == NeedsMetadata) result = NeedsMetadata;
+        }
+        return result;
+    }
+    case Or: {
+        Match result = No;
+        for (const std::shared_ptr<Node> &child : children) {
+            const Match childMatch = child->match(subject);
+            if (childMatch == Yes) return Yes;
+            if (childMatch == NeedsMetadata) result = NeedsMetadata;
+        }
+        return result;
+    }
+    case Not: {
+        const Match childMatch = children.front()->match(subject);
+        if (childMatch == NeedsMetadata) return NeedsMetadata;
+        return childMatch == Yes ? No : Yes;
+    }
+    case Substring:
+        return containsBytes(subject.folded, subject.foldedLength, bytes) ? Yes : No;
+    case Glob:
+        if (!containsBytes(subject.folded, subject.foldedLength, literal)) return No;
+        return globMatches(bytes, subject.folded, subject.foldedLength) ? Yes : No;
+    case Regex: {
+        const QString name = QFile::decodeName(QByteArray::fromRawData(subject.name, subject.nameLength));
+        return regex.match(name).hasMatch() ? Yes : No;
+    }
+    case Extensions:
+        if (subject.isDir) return No;
+        for (const QByteArray &extension : extensions) {
+            const int length = int(extension.size());
+            if (subject.foldedLength > length
+                && std::memcmp(subject.folded + subject.foldedLength - length, extension.constData(), length) == 0) {
+                return Yes;
+            }
+        }
+        return No;
+    case Size:
+        if (subject.isDir) return No;
+        if (!subject.hasMetadata) return NeedsMetadata;
+        return subject.size >= low && subject.size <= high ? Yes : No;
+    case Modified:
+        if (!subject.hasMetadata) return NeedsMetadata;
+        return subject.modifiedMs >= low && subject.modifiedMs <= high ? Yes : No;
+    case Type:
+        return subject.isDir == wantDir ? Yes : No;
+    case Content:
+        // Only files have contents; whether they match is up to the caller.
+        return subject.isDir ? No : Yes;
+    }
+    return No;
+}
+
+QByteArray CSearchQuery::Node::required() const {
+    switch (kind) {
+    case Substring:
+        return bytes;
+    case Glob:
+        return literal;
+    case Extensions:
+        return extensions.size() == 1 ? extensions.first() : QByteArray();
+    case And: {
+        QByteArray longest;
+        for (const std::shared_ptr<Node> &child : children) {
+            const QByteArray part = child->required();
+            if (part.size() > longest.size()) longest = part;
+        }
+        return longest;
+    }
+    default:
+        return QByteArray();
+    }
+}
+
+class CSearchQuery::Parser {
+public:
+    explicit Parser(const QString &text);
+
+    std::shared_ptr<Node> parse();
+    QString error;
+
+private:
+    struct Token {
+        enum Kind {
+            Word,
+            Phrase,
+            Pattern,
+            Open,
+            Close,
+            Or,
+            Not,
+            End
+        };
+
+        Kind kind = End;
+        QString text;
+    };
+
+    void tokenize(const QString &text);
+    const Token &peek() const;
+    Token take();
+
+    std::shared_ptr<Node> parseOr();
+    std::shared_ptr<Node> parseAnd();
+    std::shared_ptr<Node> parseUnary();
+    std::shared_ptr<Node> term(const Token &token);
+    std::shared_ptr<Node> regexTerm(const QString &pattern);
+    std::shared_ptr<Node> sizeTerm(const QString &value);
+    std::shared_ptr<Node> modifiedTerm(const QString &value);
+    std::shared_ptr<Node> fail(const QString &message);
+
+    QVector<Token> tokens;
+    Token end;
+    int position = 0;
+    qint64 nowMs;
+};
+
+CSearchQuery::Parser::Parser(const QString &text)
+    : nowMs(QDateTime::currentMSecsSinceEpoch()) {
+    tokenize(text);
+}
+
+void CSearchQuery::Parser::tokenize(const QString &text) {
+    const int length = int(text.size());
+    int i = 0;
+    while (i < length && error.isEmpty()) {
+        const QChar c = text.at(i);
+        if (c.isSpace()) {
+            ++i;
+        } else if (c == '(') {
+            tokens.append({Token::Open, QString()});
+            ++i;
+        } else if (c == ')') {
+            tokens.append({Token::Close, QString()});
+            ++i;
+        } else if (c == '|') {
+            tokens.append({Token::Or, QString()});
+            ++i;
+        } else if (c == '-' && i + 1 < length && !text.at(i + 1).isSpace()) {
+            tokens.append({Token::Not, QString()});
+            ++i;
+        } else if (c == '"') {
+            const int close = text.indexOf('"', i + 1);
+            const int stop = close < 0 ? length : close;
+            tokens.append({Token::Phrase, text.mid(i + 1, stop - i - 1)});
+            i = stop + 1;
+        } else if (c == '/') {
+            QString pattern;
+            int j = i + 1;
+            for (; j < length && text.at(j) != '/'; ++j) {
+                if (text.at(j) == '\\' && j + 1 < length && text.at(j + 1) == '/') ++j;
+                else if (text.at(j) == '\\' && j + 1 < length) pattern.append(text.at(j++));
+                pattern.append(text.at(j));
+            }
+            if (j >= length) {
+                error = "The regular expression is missing its closing /.";
+                return;
+            }
+            tokens.append({Token::Pattern, pattern});
+            i = j + 1;
+        } else {
+            // re: runs to the next space, so that the expression can use
+            // parentheses and bars.
+            const bool regexWord = text.mid(i, 3).compare("re:", Qt::CaseInsensitive) == 0;
+            int j = i;
+            QString word;
+            while (j < length && !text.at(j).isSpace()
+                   && (regexWord || (text.at(j) != '(' && text.at(j) != ')' && text.at(j) != '|'))) {
+                if (text.at(j) == ':' && j + 1 < length && text.at(j + 1) == '"') {
+                    // key:"value with spaces"
+                    const int close = text.indexOf('"', j + 2);
+                    const int stop = close < 0 ? length : close;
+                    word = text.mid(i, j + 1 - i) + text.mid(j + 2, stop - j - 2);
+                    j = stop + 1;
+                    break;
+                }
+                ++j;
+            }
+            if (word.isEmpty())
+                word = text.mid(i, j - i);
+            if (word == "OR")
+                tokens.append({Token::Or, QString()});
+            else if (word == "NOT")
+                tokens.append({Token::Not, QString()});
+            else if (word != "AND")
+                tokens.append({Token::Word, word});
+            i = j;
+        }
+    }
+}
+
+const CSearchQuery::Parser::Token &CSearchQuery::Parser::peek() const {
+    return position < tokens.size() ? tokens.at(position) : end;
+}
+
+CSearchQuery::Parser::Token CSearchQuery::Parser::take() {
+    return position < tokens.size() ? tokens.at(position++) : end;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::fail(const QString &message) {
+    if (error.isEmpty()) error = message;
+    return nullptr;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::parse() {
+    if (!error.isEmpty()) return nullptr;
+    if (tokens.isEmpty()) return std::make_shared<Node>();
+
+    std::shared_ptr<Node> node = parseOr();
+    if (!node) return nullptr;
+    if (peek().kind == Token::Close) return fail("There is a ) without a matching (.");
+    return node;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::parseOr() {
+    std::shared_ptr<Node> first = parseAnd();
+    if (!first || peek().kind != Token::Or) return first;
+
+    auto node = std::make_shared<Node>();
+    node->kind = Node::Or;
+    node->children.push_back(first);
+    while (peek().kind == Token::Or) {
+        take();
+        std::shared_ptr<Node> next = parseAnd();
+        if (!next) return nullptr;
+        node->children.push_back(next);
+    }
+    return node;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::parseAnd() {
+    std::vector<std::shared_ptr<Node>> terms;
+    while (peek().kind != Token::End && peek().kind != Token::Close && peek().kind != Token::Or) {
+        std::shared_ptr<Node> term = parseUnary();
+        if (!term) return nullptr;
+        terms.push_back(term);
+    }
+    if (terms.empty()) return fail("The query is missing a search term.");
+    if (terms.size() == 1) return terms.front();
+
+    auto node = std::make_shared<Node>();
+    node->kind = Node::And;
+    node->children = terms;
+    return node;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::parseUnary() {
+    const Token token = take();
+    switch (token.kind) {
+    case Token::Not: {
+        std::shared_ptr<Node> child = parseUnary();
+        if (!child) return nullptr;
+        auto node = std::make_shared<Node>();
+        node->kind = Node::Not;
+        node->children.push_back(child);
+        return node;
+    }
+    case Token::Open: {
+        std::shared_ptr<Node> inner = parseOr();
+        if (!inner) return nullptr;
+        if (take().kind != Token::Close) return fail("There is a ( without a matching ).");
+        return inner;
+    }
+    case Token::Word:
+    case Token::Phrase:
+    case Token::Pattern:
+        return term(token);
+    default:
+        return fail("The query is missing a search term.");
+    }
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::term(const Token &token) {
+    if (token.kind == Token::Pattern) return regexTerm(token.text);
+
+    auto node = std::make_shared<Node>();
+    if (token.kind == Token::Phrase) {
+        node->kind = Node::Substring;
+        node->bytes = foldText(token.text);
+        return node;
+    }
+
+    const int colon = token.text.indexOf(':');
+    const QString key = colon > 0 ? token.text.left(colon).toLower() : QString();
+    const QString value = token.text.mid(colon + 1);
+    if (key == "re") return regexTerm(value);
+    if (key == "size") return sizeTerm(value);
+    if (key == "modified") return modifiedTerm(value);
+
+    if (key == "content") {
+        if (value.isEmpty()) return fail("content: needs the text to look for, as in content:\"TODO\".");
+        node->kind = Node::Content;
+        node->bytes = value.toUtf8();
+        return node;
+    }
+
+    if (key == "ext") {
+        node->kind = Node::Extensions;
+        const QStringList extensions = value.split(QRegularExpression("[,;]"), Qt::SkipEmptyParts);
+        for (QString extension : extensions) {
+            while (extension.startsWith('*') || extension.startsWith('.'))
+                extension.remove(0, 1);
+            if (!extension.isEmpty())
+                node->extensions.append('.' + foldText(extension));
+        }
+        if (node->extensions.isEmpty()) return fail("ext: needs at least one extension, as in ext:jpg,png.");
+        return node;
+    }
+
+    if (key == "type") {
+        const QString type = value.toLower();
+        node->kind = Node::Type;
+        if (type == "dir" || type == "folder" || type == "directory")
+            node->wantDir = true;
+        else if (type != "file")
+            return fail(QString("Unknown type \"%1\"; use type:file or type:dir.").arg(value));
+        return node;
+    }
+
+    node->bytes = foldText(token.text);
+    if (token.text.contains('*') || token.text.contains('?') || token.text.contains('[')) {
+        node->kind = Node::Glob;
+        node->literal = longestLiteral(node->bytes);
+    } else {
+        node->kind = Node::Substring;
+    }
+    return node;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::regexTerm(const QString &pattern) {
+    auto node = std::make_shared<Node>();
+    node->kind = Node::Regex;
+    node->regex = QRegularExpression(pattern, QRegularExpression::CaseInsensitiveOption);
+    if (!node->regex.isValid())
+        return fail(QString("Invalid regular expression \"%1\": %2.").arg(pattern, node->regex.errorString()));
+    node->regex.optimize();
+    return node;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::sizeTerm(const QString &value) {
+    auto node = std::make_shared<Node>();
+    node->kind = Node::Size;
+    const QString invalid = QString("Unknown size \"%1\"; use for example size:>10M or size:1k..4M.").arg(value);
+
+    const int range = value.indexOf("..");
+    if (range >= 0) {
+        if (!parseSize(value.left(range), node->low) || !parseSize(value.mid(range + 2), node->high))
+            return fail(invalid);
+        return node;
+    }
+
+    QString operand = value;
+    const QString op = takeOperator(operand);
+    qint64 bytes;
+    if (!parseSize(operand, bytes)) return fail(invalid);
+
+    if (op == ">") node->low = bytes + 1;
+    else if (op == ">=") node->low = bytes;
+    else if (op == "<") node->high = bytes - 1;
+    else if (op == "<=") node->high = bytes;
+    else node->low = node->high = bytes;
+    return node;
+}
+
+std::shared_ptr<CSearchQuery::Node> CSearchQuery::Parser::modifiedTerm(const QString &value) {
+    auto node = std::make_shared<Node>();
+    node->kind = Node::Modified;
+    const QString invalid =
+        QString("Unknown date \"%1\"; use for example modified:>2024-01-31 or modified:<7d.").arg(value);
+
+    qint64 first;
+    qint64 last;
+    bool age;
+    const int range = value.indexOf("..");
+    if (range >= 0) {
+        qint64 otherFirst;
+        qint64 otherLast;
+        if (!parseTime(value.left(range), nowMs, first, last, age)
+            || !parseTime(value.mid(range + 2), nowMs, otherFirst, otherLast, age)) {
+            return fail(invalid);
+        }
+        node->low = qMin(first, otherFirst);
+        node->high = qMax(last, otherLast);
+        return node;
+    }
+
+    QString operand = value;
+    const QString op = takeOperator(operand);
+    if (!parseTime(operand, nowMs, first, last, age)) return fail(invalid);
+
+    if (age) {
+        // Ages count backwards: modified:<7d is newer than a week ago, and
+        // modified:7d means within the last week.
+        if (op.startsWith('>')) node->high = first;
+        else node->low = first;
+    } else if (op == ">") {
+        node->low = last + 1;
+    } else if (op == ">=") {
+        node->low = first;
+    } else if (op == "<") {
+        node->high = first - 1;
+    } else if (op == "<=") {
+        node->high = last;
+    } else {
+        node->low = first;
+        node->high = last;
+    }
+    return node;
+}
+
+CSearchQuery::CSearchQuery()
+    : root(std::make_shared<Node>()) {
+}
+
+CSearchQuery::CSearchQuery(const QString &text)
+    : source(text) {
+    Parser parser(text);
+    root = parser.parse();
+    error = parser.error;
+    if (!root) return;
+
+    // Contents are searched once everything else has matched, so a content:
+    // term has to be required by the query as a whole.
+    int contentTerms = 0;
+    bool nested = false;
+    std::function<void(const Node &, bool)> visit = [&](const Node &node, bool topLevel) {
+        if (node.kind == Node::Content) {
+            ++contentTerms;
+            nested = nested || !topLevel;
+            content = node.bytes;
+        }
+        if (node.kind == Node::Size && topLevel)
+            sizeBound = sizeBound < 0 ? node.high : qMin(sizeBound, node.high);
+        for (const std::shared_ptr<Node> &child : node.children)
+            visit(*child, topLevel && node.kind == Node::And);
+    };
+    visit(*root, true);
+
+    if (nested || contentTerms > 1) {
+        error = nested ? QString("content: cannot be used under OR or NOT.")
+                       : QString("Only one content: term can be used at a time.");
+        root.reset();
+        content.clear();
+        sizeBound = -1;
+        return;
+    }
+    required = root->required();
+}
+
+bool CSearchQuery::isValid() const {
+    return root != nullptr;
+}
+
+QString CSearchQuery::errorString() const {
+    return error;
+}
+
+QString CSearchQuery::text() const {
+    return source;
+}
+
+CSearchQuery::Match CSearchQuery::match(const Subject &subject) const {
+    return root ? root->match(subject) : No;
+}
+
+QByteArray CSearchQuery::requiredSubstring() const {
+    return required;
+}
+
+QByteArray CSearchQuery::contentText() const {
+    return content;
+}
+
+qint64 CSearchQuery::maxSize() const {
+    return sizeBound;
+}
+
+QByteArray CSearchQuery::fold(const char *name, int length) {
+    // ASCII names, the common case, are folded byte by byte; anything else
+    // goes through QString so the result is what the index stores.
+    int i = 0;
+    bool ascii = true;
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(name + i)))) break;
+    }
+#endif
+    for (; i < length && ascii; ++i)
+        ascii = uchar(name[i]) < 0x80;
+    if (!ascii) return foldText(QFile::decodeName(QByteArray::fromRawData(name, length)));
+
+    QByteArray folded(name, length);
+    char *data = folded.data();
+    i = 0;
+#ifdef __SSE2__
+    const __m128i belowUpper = _mm_set1_epi8('A' - 1);
+    const __m128i aboveUpper = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= length; i += 16) {
+        auto *at = reinterpret_cast<__m128i *>(data + i);
+        const __m128i bytes = _mm_loadu_si128(at);
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, belowUpper), _mm_cmplt_epi8(bytes, aboveUpper));
+        _mm_storeu_si128(at, _mm_or_si128(bytes, _mm_and_si128(upper, caseBit)));
+    }
+#endif
+    for (; i < length; ++i) {
+        if (data[i] >= 'A' && data[i] <= 'Z') data[i] = char(data[i] | 0x20);
+    }
+    return folded;
+}
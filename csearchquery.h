@@ -0,0 +1,85 @@
+#ifndef CSEARCHQUERY_H
+#define CSEARCHQUERY_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <memory>
+
+// A search query, compiled once and then matched against every name of a
+// walk or of the index. Names are compared in their case-folded UTF-8 form
+// (see fold()), so matching never converts a name to UTF-16.
+//
+// Terms are separated by spaces and must all match. "OR" or "|" between
+// terms, "-" or "NOT" in front of one, and parentheses combine them:
+//   report                name contains "report"
+//   "annual report"       name contains the phrase
+//   *.log  img_??.png     glob against the whole name
+//   /^img_\d+/  re:^img   regular expression
+//   ext:jpg,png           extension is one of the list
+//   size:>10M  size:1k..4M               file size; k, M, G and T are powers of 1024
+//   modified:>2024-01-31  modified:<7d   date, or age in m, h, d or w
+//   type:dir  type:file
+//   content:TODO  content:"fix me"        text inside files; see CContentScanner
+//
+// Content searches skip files over 256M unless a size: term that every match
+// must satisfy says otherwise, as in content:TODO size:<2G.
+class CSearchQuery {
+public:
+    enum Match {
+        No,
+        Yes,
+        // The answer depends on the size or date, which the subject lacks.
+        NeedsMetadata
+    };
+
+    struct Subject {
+        const char *name = nullptr;
+        int nameLength = 0;
+        // fold() of the name.
+        const char *folded = nullptr;
+        int foldedLength = 0;
+        bool isDir = false;
+        bool hasMetadata = false;
+        qint64 size = 0;
+        qint64 modifiedMs = 0;
+    };
+
+    // Matches everything.
+    CSearchQuery();
+    explicit CSearchQuery(const QString &text);
+
+    bool isValid() const;
+    QString errorString() const;
+    QString text() const;
+
+    Match match(const Subject &subject) const;
+
+    // Folded bytes that every matching name contains, for narrowing a lookup
+    // in an index; empty if there are none.
+    QByteArray requiredSubstring() const;
+
+    // The text to look for inside files that match the rest of the query,
+    // or empty for a query on names alone.
+    QByteArray contentText() const;
+
+    // The upper bound of the size: terms that every match has to satisfy, or
+    // -1 if there are none.
+    qint64 maxSize() const;
+
+    // The case-folded UTF-8 form of a file name, as the index stores it.
+    static QByteArray fold(const char *name, int length);
+
+private:
+    struct Node;
+    class Parser;
+
+    std::shared_ptr<const Node> root;
+    QString source;
+    QString error;
+    QByteArray required;
+    QByteArray content;
+    qint64 sizeBound = -1;
+};
+
+#endif // CSEARCHQUERY_H
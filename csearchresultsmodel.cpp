@@ -0,0 +1,236 @@
+#include "csearchresultsmodel.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QMimeDatabase>
+
+#include <algorithm>
+
+namespace {
+int compareNoCase(const QByteArray &left, const QByteArray &right) {
+    const int length = qMin(left.size(), right.size());
+    for (int i = 0; i < length; ++i) {
+        const uchar a = uchar(left.at(i)) | ((uchar(left.at(i)) - 'A' < 26u) ? 0x20 : 0);
+        const uchar b = uchar(right.at(i)) | ((uchar(right.at(i)) - 'A' < 26u) ? 0x20 : 0);
+        if (a != b) return a < b ? -1 : 1;
+    }
+    return left.size() == right.size() ? 0 : (left.size() < right.size() ? -1 : 1);
+}
+}
+
+CSearchResultsModel::CSearchResultsModel(QObject *parent)
+    : QAbstractTableModel(parent) {
+    pathOffsets.append(0);
+}
+
+int CSearchResultsModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : int(order.size());
+}
+
+int CSearchResultsModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant CSearchResultsModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case NameColumn: return QString("Name");
+    case SizeColumn: return QString("Size");
+    case TypeColumn: return QString("Type");
+    case DateColumn: return QString("Date Modified");
+    case PathColumn: return QString("Path");
+    case MatchColumn: return QString("Match");
+    }
+    return QVariant();
+}
+
+QVariant CSearchResultsModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= order.size())
+        return QVariant();
+
+    const int record = recordAt(index.row());
+
+    if (role == Qt::DecorationRole && index.column() == NameColumn)
+        return typeInfo(record).icon;
+
+    if (role == Qt::ToolTipRole && index.column() == MatchColumn && matchLines[record] > 0)
+        return QString("Line %1, byte %2").arg(matchLines[record]).arg(matchOffsets[record]);
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (index.column()) {
+    case NameColumn:
+        return QFile::decodeName(nameBytes(record));
+    case SizeColumn:
+        return dirFlags[record] ? QString() : QString::number(sizes[record]);
+    case TypeColumn:
+        return typeInfo(record).name;
+    case DateColumn:
+        return QDateTime::fromMSecsSinceEpoch(modified[record]).toString("yyyy-MM-dd hh:mm");
+    case PathColumn:
+        return QFile::decodeName(pathBytes(record));
+    case MatchColumn:
+        return matchLines[record] > 0 ? QString("%1: %2").arg(matchLines[record]).arg(matchPreviews[record])
+                                      : QString();
+    }
+    return QVariant();
+}
+
+void CSearchResultsModel::clear() {
+    beginResetModel();
+    pathArena.clear();
+    pathOffsets.clear();
+    pathOffsets.append(0);
+    nameStarts.clear();
+    sizes.clear();
+    modified.clear();
+    dirFlags.clear();
+    matchOffsets.clear();
+    matchLines.clear();
+    matchPreviews.clear();
+    order.clear();
+    endResetModel();
+}
+
+void CSearchResultsModel::append(const QList<CSearchResult> &results) {
+    if (results.isEmpty()) return;
+
+    const int first = int(order.size());
+    beginInsertRows(QModelIndex(), first, first + results.size() - 1);
+
+    for (const CSearchResult &result : results) {
+        const QByteArray path = QFile::encodeName(result.path);
+        const int slash = path.lastIndexOf('/');
+
+        pathArena.append(path);
+        pathOffsets.append(quint32(pathArena.size()));
+        nameStarts.append(quint16(qBound(0, slash + 1, 0xffff)));
+        sizes.append(result.size);
+        modified.append(result.lastModified.toMSecsSinceEpoch());
+        dirFlags.append(result.isDir);
+        matchOffsets.append(result.matchOffset);
+        matchLines.append(result.matchLine);
+        matchPreviews.append(result.matchPreview);
+        order.append(int(order.size()));
+    }
+
+    endInsertRows();
+}
+
+QString CSearchResultsModel::filePath(int row) const {
+    if (row < 0 || row >= order.size()) return QString();
+    return QFile::decodeName(pathBytes(recordAt(row)));
+}
+
+QString CSearchResultsModel::fileName(int row) const {
+    if (row < 0 || row >= order.size()) return QString();
+    return QFile::decodeName(nameBytes(recordAt(row)));
+}
+
+bool CSearchResultsModel::isDir(int row) const {
+    if (row < 0 || row >= order.size()) return false;
+    return dirFlags[recordAt(row)];
+}
+
+QByteArray CSearchResultsModel::pathBytes(int record) const {
+    const quint32 begin = pathOffsets[record];
+    return QByteArray::fromRawData(pathArena.constData() + begin, int(pathOffsets[record + 1] - begin));
+}
+
+QByteArray CSearchResultsModel::nameBytes(int record) const {
+    const quint32 begin = pathOffsets[record] + nameStarts[record];
+    return QByteArray::fromRawData(pathArena.constData() + begin, int(pathOffsets[record + 1] - begin));
+}
+
+const CSearchResultsModel::TypeInfo &CSearchResultsModel::typeInfo(int record) const {
+    QByteArray key;
+    if (dirFlags[record]) {
+        key = "/";
+    } else {
+        const QByteArray name = nameBytes(record);
+        const int dot = name.lastIndexOf('.');
+        key = dot > 0 ? name.mid(dot + 1).toLower() : QByteArray();
+    }
+
+    auto it = typeCache.find(key);
+    if (it != typeCache.end()) return it.value();
+
+    TypeInfo info;
+    if (dirFlags[record]) {
+        info.name = QString("Folder");
+        info.icon = iconProvider.icon(QFileIconProvider::Folder);
+    } else {
+        QMimeDatabase mimeDatabase;
+        const QMimeType mime = mimeDatabase.mimeTypeForFile(QFile::decodeName(nameBytes(record)),
+                                                            QMimeDatabase::MatchExtension);
+        info.name = key.isEmpty() ? QString("File") : QString("%1 File").arg(QString::fromUtf8(key));
+        info.icon = QIcon::fromTheme(mime.iconName(),
+                                     QIcon::fromTheme(mime.genericIconName(),
+                                                      iconProvider.icon(QFileIconProvider::File)));
+    }
+    return typeCache.insert(key, info).value();
+}
+
+bool CSearchResultsModel::lessThan(int column, int left, int right) const {
+    switch (column) {
+    case SizeColumn:
+        if (sizes[left] != sizes[right]) return sizes[left] < sizes[right];
+        break;
+    case TypeColumn: {
+        const int cmp = QString::compare(typeInfo(left).name, typeInfo(right).name, Qt::CaseInsensitive);
+        if (cmp != 0) return cmp < 0;
+        break;
+    }
+    case DateColumn:
+        if (modified[left] != modified[right]) return modified[left] < modified[right];
+        break;
+    case PathColumn: {
+        const int cmp = compareNoCase(pathBytes(left), pathBytes(right));
+        if (cmp != 0) return cmp < 0;
+        break;
+    }
+    case MatchColumn: {
+        const int cmp = compareNoCase(pathBytes(left), pathBytes(right));
+        if (cmp != 0) return cmp < 0;
+        if (matchLines[left] != matchLines[right]) return matchLines[left] < matchLines[right];
+        break;
+    }
+    default:
+        break;
+    }
+
+    const int cmp = compareNoCase(nameBytes(left), nameBytes(right));
+    return cmp != 0 ? cmp < 0 : left < right;
+}
+
+void CSearchResultsModel::sort(int column, Qt::SortOrder sortOrder) {
+    if (column < 0 || column >= ColumnCount || order.isEmpty()) return;
+
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    const QModelIndexList persistent = persistentIndexList();
+    QVector<int> persistentRecords;
+    persistentRecords.reserve(persistent.size());
+    for (const QModelIndex &index : persistent)
+        persistentRecords.append(recordAt(index.row()));
+
+    std::sort(order.begin(), order.end(), [this, column, sortOrder](int left, int right) {
+        return sortOrder == Qt::AscendingOrder ? lessThan(column, left, right)
+                                               : lessThan(column, right, left);
+    });
+
+    QVector<int> rowOf(order.size());
+    for (int row = 0; row < order.size(); ++row)
+        rowOf[order[row]] = row;
+
+    QModelIndexList updated;
+    updated.reserve(persistent.size());
+    for (int i = 0; i < persistent.size(); ++i)
+        updated.append(index(rowOf[persistentRecords[i]], persistent[i].column()));
+    changePersistentIndexList(persistent, updated);
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
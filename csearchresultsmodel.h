@@ -0,0 +1,70 @@
+#ifndef CSEARCHRESULTSMODEL_H
+#define CSEARCHRESULTSMODEL_H
+
+#include "csearchengine.h"
+
+#include <QAbstractTableModel>
+#include <QFileIconProvider>
+#include <QHash>
+#include <QIcon>
+#include <QVector>
+
+class CSearchResultsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        NameColumn,
+        SizeColumn,
+        TypeColumn,
+        DateColumn,
+        PathColumn,
+        // Line and preview of a content search hit.
+        MatchColumn,
+        ColumnCount
+    };
+
+    explicit CSearchResultsModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    void clear();
+    void append(const QList<CSearchResult> &results);
+
+    QString filePath(int row) const;
+    QString fileName(int row) const;
+    bool isDir(int row) const;
+
+private:
+    struct TypeInfo {
+        QString name;
+        QIcon icon;
+    };
+
+    int recordAt(int row) const { return order[row]; }
+    QByteArray pathBytes(int record) const;
+    QByteArray nameBytes(int record) const;
+    const TypeInfo &typeInfo(int record) const;
+    bool lessThan(int column, int left, int right) const;
+
+    QByteArray pathArena;
+    QVector<quint32> pathOffsets;
+    QVector<quint16> nameStarts;
+    QVector<qint64> sizes;
+    QVector<qint64> modified;
+    QVector<bool> dirFlags;
+    QVector<qint64> matchOffsets;
+    QVector<int> matchLines;
+    QVector<QString> matchPreviews;
+    QVector<int> order;
+
+    QFileIconProvider iconProvider;
+    mutable QHash<QByteArray, TypeInfo> typeCache;
+};
+
+#endif // CSEARCHRESULTSMODEL_H
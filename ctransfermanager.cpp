@@ -0,0 +1,38 @@
+#include "ctransfermanager.h"
+#include "ctransferpanel.h"
+
+#include <QScrollArea>
+
+CTransferManager::CTransferManager(CJobQueue *queue, QWidget *parent)
+    : QDockWidget("Transfers", parent) {
+    setObjectName("transferManager");
+    setAllowedAreas(Qt::BottomDockWidgetArea | Qt::TopDockWidgetArea);
+
+    QWidget *jobsWidget = new QWidget(this);
+    jobsLayout = new QVBoxLayout(jobsWidget);
+    jobsLayout->setContentsMargins(4, 4, 4, 4);
+    jobsLayout->addStretch();
+
+    QScrollArea *scrollArea = new QScrollArea(this);
+    scrollArea->setWidgetResizable(true);
+    scrollArea->setWidget(jobsWidget);
+    setWidget(scrollArea);
+
+    connect(queue, &CJobQueue::jobAdded, this, &CTransferManager::addJob);
+
+    hide();
+}
+
+void CTransferManager::addJob(CFileJob *job) {
+    CTransferPanel *panel = new CTransferPanel(job, this);
+    jobsLayout->insertWidget(jobsLayout->count() - 1, panel);
+    ++jobCount;
+
+    connect(job, &QObject::destroyed, panel, [this, panel] {
+        panel->deleteLater();
+        if (--jobCount == 0)
+            hide();
+    });
+
+    show();
+}
@@ -0,0 +1,23 @@
+#ifndef CTRANSFERMANAGER_H
+#define CTRANSFERMANAGER_H
+
+#include "cjobqueue.h"
+
+#include <QDockWidget>
+#include <QVBoxLayout>
+
+class CTransferManager : public QDockWidget {
+    Q_OBJECT
+
+public:
+    explicit CTransferManager(CJobQueue *queue, QWidget *parent = nullptr);
+
+private slots:
+    void addJob(CFileJob *job);
+
+private:
+    QVBoxLayout *jobsLayout;
+    int jobCount = 0;
+};
+
+#endif // CTRANSFERMANAGER_H
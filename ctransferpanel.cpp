@@ -0,0 +1,100 @@
+#include "ctransferpanel.h"
+
+#include <QHBoxLayout>
+#include <QLocale>
+
+CTransferPanel::CTransferPanel(CFileJob *fileJob, QWidget *parent)
+    : QWidget(parent), job(fileJob) {
+    titleLabel = new QLabel(job->description(), this);
+    statsLabel = new QLabel(this);
+    progressBar = new QProgressBar(this);
+    progressBar->setRange(0, 1000);
+    progressBar->setTextVisible(false);
+    progressBar->setMaximumWidth(250);
+
+    pauseButton = new QToolButton(this);
+    pauseButton->setText("Pause");
+
+    cancelButton = new QToolButton(this);
+    cancelButton->setText("Cancel");
+
+    QHBoxLayout *layout = new QHBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(titleLabel);
+    layout->addWidget(progressBar);
+    layout->addWidget(statsLabel, 1);
+    layout->addWidget(pauseButton);
+    layout->addWidget(cancelButton);
+
+    connect(pauseButton, &QToolButton::clicked, this, [this] {
+        if (!job) return;
+        if (job->isPaused())
+            job->resume();
+        else
+            job->pause();
+        pauseButton->setText(job->isPaused() ? "Resume" : "Pause");
+    });
+    connect(cancelButton, &QToolButton::clicked, this, [this] {
+        if (job) job->cancel();
+    });
+
+    connect(job, &CFileJob::progress, this, &CTransferPanel::updateStats);
+    connect(job, &CFileJob::stateChanged, this, &CTransferPanel::updateState);
+    updateState(job->state());
+}
+
+void CTransferPanel::updateStats(const CTransferStats &stats) {
+    lastStats = stats;
+    if (stats.bytesTotal > 0)
+        progressBar->setValue(int(stats.bytesDone * 1000 / stats.bytesTotal));
+    else if (stats.filesTotal > 0)
+        progressBar->setValue(int(stats.filesDone * 1000 / stats.filesTotal));
+
+    if (job && job->state() == CFileJob::Running)
+        statsLabel->setText(formatStats(stats));
+}
+
+void CTransferPanel::updateState(CFileJob::State state) {
+    switch (state) {
+    case CFileJob::Queued:
+        statsLabel->setText("Waiting");
+        break;
+    case CFileJob::Running:
+        statsLabel->setText(formatStats(lastStats));
+        break;
+    case CFileJob::Paused:
+        statsLabel->setText("Paused");
+        break;
+    case CFileJob::Finished:
+        pauseButton->setEnabled(false);
+        cancelButton->setEnabled(false);
+        break;
+    }
+}
+
+QString CTransferPanel::formatStats(const CTransferStats &stats) {
+    if (stats.bytesTotal == 0 && stats.filesTotal > 0)
+        return QString("%1 of %2 items").arg(stats.filesDone).arg(stats.filesTotal);
+
+    QLocale locale;
+    QString text = QString("%1 of %2").arg(locale.formattedDataSize(stats.bytesDone),
+                                           locale.formattedDataSize(stats.bytesTotal));
+    if (stats.bytesSkipped > 0)
+        text += QString(" (%1 written)").arg(locale.formattedDataSize(stats.bytesDone - stats.bytesSkipped));
+
+    if (stats.filesTotal > 0)
+        text += QString(", %1 of %2 files").arg(stats.filesDone).arg(stats.filesTotal);
+
+    if (stats.bytesPerSecond > 0)
+        text += QString(" - %1/s").arg(locale.formattedDataSize(qint64(stats.bytesPerSecond)));
+
+    if (stats.etaSeconds >= 0) {
+        const qint64 hours = stats.etaSeconds / 3600;
+        const qint64 minutes = (stats.etaSeconds / 60) % 60;
+        const qint64 seconds = stats.etaSeconds % 60;
+        text += hours > 0
+                    ? QString(" - %1:%2:%3 left").arg(hours).arg(minutes, 2, 10, QChar('0')).arg(seconds, 2, 10, QChar('0'))
+                    : QString(" - %1:%2 left").arg(minutes).arg(seconds, 2, 10, QChar('0'));
+    }
+    return text;
+}
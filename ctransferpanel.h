@@ -0,0 +1,35 @@
+#ifndef CTRANSFERPANEL_H
+#define CTRANSFERPANEL_H
+
+#include "cfilejob.h"
+
+#include <QWidget>
+#include <QLabel>
+#include <QPointer>
+#include <QProgressBar>
+#include <QToolButton>
+
+class CTransferPanel : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit CTransferPanel(CFileJob *job, QWidget *parent = nullptr);
+
+    static QString formatStats(const CTransferStats &stats);
+
+private slots:
+    void updateStats(const CTransferStats &stats);
+    void updateState(CFileJob::State state);
+
+private:
+    QPointer<CFileJob> job;
+    CTransferStats lastStats;
+
+    QLabel *titleLabel;
+    QLabel *statsLabel;
+    QProgressBar *progressBar;
+    QToolButton *pauseButton;
+    QToolButton *cancelButton;
+};
+
+#endif // CTRANSFERPANEL_H
@@ -0,0 +1,290 @@
+#include "ctrash.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <shellapi.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+#ifdef Q_OS_LINUX
+QString errorText(int error) {
+    return QString::fromLocal8Bit(std::strerror(error));
+}
+
+QByteArray join(const QByteArray &dir, const QByteArray &name) {
+    return dir.endsWith('/') ? dir + name : dir + '/' + name;
+}
+
+bool isOwnDirectory(const QByteArray &path) {
+    struct stat st;
+    return ::lstat(path.constData(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == ::getuid();
+}
+
+bool ensureDir(const QByteArray &path) {
+    if (::mkdir(path.constData(), 0700) == 0) return true;
+    return errno == EEXIST && isOwnDirectory(path);
+}
+
+QByteArray homeTrash(bool create) {
+    const QString dataHome = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+    const QByteArray trash = QFile::encodeName(dataHome + "/Trash");
+    if (create) {
+        QDir().mkpath(dataHome);
+        if (!ensureDir(trash)) return QByteArray();
+    }
+    return isOwnDirectory(trash) ? trash : QByteArray();
+}
+
+// $topdir/.Trash/$uid when the administrator set up a shared sticky .Trash,
+// otherwise $topdir/.Trash-$uid.
+QByteArray topdirTrash(const QByteArray &topdir, bool create) {
+    const QByteArray uid = QByteArray::number(::getuid());
+
+    const QByteArray shared = join(topdir, ".Trash");
+    struct stat st;
+    if (::lstat(shared.constData(), &st) == 0 && S_ISDIR(st.st_mode) && (st.st_mode & S_ISVTX)) {
+        const QByteArray trash = join(shared, uid);
+        if (create ? ensureDir(trash) : isOwnDirectory(trash)) return trash;
+    }
+
+    const QByteArray own = join(topdir, ".Trash-" + uid);
+    if (create ? ensureDir(own) : isOwnDirectory(own)) return own;
+    return QByteArray();
+}
+
+QByteArray mountPoint(const QByteArray &path, dev_t device) {
+    QByteArray current = path;
+    while (current != "/") {
+        const int slash = current.lastIndexOf('/');
+        const QByteArray parent = slash > 0 ? current.left(slash) : QByteArray("/");
+
+        struct stat st;
+        if (::lstat(parent.constData(), &st) != 0 || st.st_dev != device) break;
+        current = parent;
+    }
+    return current;
+}
+
+QByteArray decodeMountField(const QByteArray &field) {
+    QByteArray decoded;
+    decoded.reserve(field.size());
+    for (int i = 0; i < field.size(); ++i) {
+        if (field.at(i) == '\\' && i + 3 < field.size()) {
+            decoded.append(char(field.mid(i + 1, 3).toInt(nullptr, 8)));
+            i += 3;
+        } else {
+            decoded.append(field.at(i));
+        }
+    }
+    return decoded;
+}
+
+QList<QByteArray> knownTrashes() {
+    QList<QByteArray> trashes;
+    const QByteArray home = homeTrash(false);
+    if (!home.isEmpty()) trashes.append(home);
+
+    QFile mounts("/proc/self/mounts");
+    if (!mounts.open(QIODevice::ReadOnly)) return trashes;
+
+    const QList<QByteArray> lines = mounts.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        const QList<QByteArray> fields = line.split(' ');
+        if (fields.size() < 2) continue;
+
+        const QByteArray trash = topdirTrash(decodeMountField(fields.at(1)), false);
+        if (!trash.isEmpty() && !trashes.contains(trash)) trashes.append(trash);
+    }
+    return trashes;
+}
+
+QByteArray numberedName(const QByteArray &name, int counter) {
+    const QByteArray suffix = "_" + QByteArray::number(counter);
+    const int dot = name.lastIndexOf('.');
+    if (dot > 0) return name.left(dot) + suffix + name.mid(dot);
+    return name + suffix;
+}
+
+bool writeAll(int fd, const QByteArray &data) {
+    const char *cursor = data.constData();
+    qint64 remaining = data.size();
+    while (remaining > 0) {
+        const ssize_t bytes = ::write(fd, cursor, size_t(remaining));
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        cursor += bytes;
+        remaining -= bytes;
+    }
+    return true;
+}
+#endif
+}
+
+bool CTrash::isSupported() {
+#if defined(Q_OS_WIN) || defined(Q_OS_LINUX) || QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool CTrash::moveToTrash(const QString &path, QString *errorString) {
+    auto fail = [errorString](const QString &message) {
+        if (errorString) *errorString = message;
+        return false;
+    };
+
+#if defined(Q_OS_WIN)
+    QString pathWithNull = QDir::toNativeSeparators(path) + '\0';
+
+    SHFILEOPSTRUCT fileOp = {};
+    fileOp.wFunc = FO_DELETE;
+    fileOp.pFrom = reinterpret_cast<LPCWSTR>(pathWithNull.utf16());
+    fileOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION | FOF_SILENT;
+
+    if (SHFileOperation(&fileOp) == 0) {
+        return true;
+    }
+    return fail(QString("Failed to move to the recycle bin"));
+#elif defined(Q_OS_LINUX)
+    const QByteArray source = QFile::encodeName(QDir::cleanPath(QFileInfo(path).absoluteFilePath()));
+
+    struct stat st;
+    if (::lstat(source.constData(), &st) != 0) return fail(errorText(errno));
+
+    QByteArray topdir;
+    QByteArray trash = homeTrash(true);
+    struct stat trashStat;
+    if (trash.isEmpty() || ::stat(trash.constData(), &trashStat) != 0 || trashStat.st_dev != st.st_dev) {
+        topdir = mountPoint(source, st.st_dev);
+        trash = topdirTrash(topdir, true);
+    }
+    if (trash.isEmpty()) return fail(QString("No trash is available on this device"));
+
+    const QByteArray filesDir = join(trash, "files");
+    const QByteArray infoDir = join(trash, "info");
+    if (!ensureDir(filesDir) || !ensureDir(infoDir)) return fail(errorText(errno));
+
+    // Topdir trashes record the path relative to the mount so the disk can move.
+    QByteArray recordedPath = source;
+    if (!topdir.isEmpty() && topdir != source)
+        recordedPath = source.mid(topdir == "/" ? 1 : topdir.size() + 1);
+
+    const QByteArray info = "[Trash Info]\nPath=" + recordedPath.toPercentEncoding("/")
+                            + "\nDeletionDate="
+                            + QDateTime::currentDateTime().toString("yyyy-MM-ddThh:mm:ss").toLatin1() + "\n";
+
+    const QByteArray name = source.mid(source.lastIndexOf('/') + 1);
+    for (int counter = 1; counter < 10000; ++counter) {
+        const QByteArray candidate = counter == 1 ? name : numberedName(name, counter);
+        const QByteArray infoPath = join(infoDir, candidate + ".trashinfo");
+        const QByteArray target = join(filesDir, candidate);
+
+        // The exclusively created info file reserves the name, as the spec requires.
+        const int fd = ::open(infoPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            if (errno == EEXIST) continue;
+            return fail(errorText(errno));
+        }
+
+        const bool written = writeAll(fd, info);
+        const int writeError = errno;
+        if (::close(fd) != 0 || !written) {
+            ::unlink(infoPath.constData());
+            return fail(errorText(written ? errno : writeError));
+        }
+
+        struct stat existing;
+        if (::lstat(target.constData(), &existing) == 0) {
+            ::unlink(infoPath.constData());
+            continue;
+        }
+
+        if (::rename(source.constData(), target.constData()) != 0) {
+            const int error = errno;
+            ::unlink(infoPath.constData());
+            return fail(errorText(error));
+        }
+        return true;
+    }
+    return fail(QString("Too many items with this name in the trash"));
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    // The macOS Trash and whatever else Qt knows how to reach.
+    QFile file(path);
+    if (file.moveToTrash()) return true;
+    return fail(file.errorString().isEmpty() ? QString("Could not move the item to the trash") : file.errorString());
+#else
+    Q_UNUSED(path);
+    return fail(QString("The trash is not supported on this platform"));
+#endif
+}
+
+QString CTrash::homeTrashFilesPath() {
+#ifdef Q_OS_LINUX
+    const QByteArray trash = homeTrash(true);
+    if (trash.isEmpty()) return QString();
+
+    const QByteArray filesDir = join(trash, "files");
+    ensureDir(filesDir);
+    ensureDir(join(trash, "info"));
+    return QFile::decodeName(filesDir);
+#else
+    return QString();
+#endif
+}
+
+QStringList CTrash::empty() {
+    QStringList staged;
+#ifdef Q_OS_LINUX
+    const QByteArray stamp = QByteArray::number(QDateTime::currentMSecsSinceEpoch());
+    const QList<QByteArray> trashes = knownTrashes();
+    for (const QByteArray &trash : trashes) {
+        const QByteArray expunged = join(trash, "expunged");
+        if (!ensureDir(expunged)) continue;
+
+        for (const QByteArray &subdir : {QByteArray("files"), QByteArray("info")}) {
+            const QByteArray from = join(trash, subdir);
+            const QByteArray to = join(expunged, subdir + '-' + stamp);
+            if (::rename(from.constData(), to.constData()) == 0) {
+                ensureDir(from);
+                staged.append(QFile::decodeName(to));
+            }
+        }
+        ::unlink(join(trash, "directorysizes").constData());
+    }
+#endif
+    return staged;
+}
+
+QStringList CTrash::pendingExpunges() {
+    QStringList pending;
+#ifdef Q_OS_LINUX
+    const QList<QByteArray> trashes = knownTrashes();
+    for (const QByteArray &trash : trashes) {
+        const QByteArray expunged = join(trash, "expunged");
+        if (!isOwnDirectory(expunged)) continue;
+
+        const QDir dir(QFile::decodeName(expunged));
+        const QStringList names = dir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+        for (const QString &name : names)
+            pending.append(dir.filePath(name));
+    }
+#endif
+    return pending;
+}
@@ -0,0 +1,27 @@
+#ifndef CTRASH_H
+#define CTRASH_H
+
+#include <QString>
+#include <QStringList>
+
+// The Windows recycle bin, or the freedesktop.org trash on Linux: items are
+// renamed into a trash directory on their own filesystem, so trashing costs
+// the same for a file or a whole tree. Elsewhere QFile::moveToTrash() is used.
+class CTrash {
+public:
+    static bool isSupported();
+
+    static bool moveToTrash(const QString &path, QString *errorString = nullptr);
+
+    // The home trash's "files" directory, created on demand.
+    static QString homeTrashFilesPath();
+
+    // Moves the contents of every trash aside so it reads as empty at once.
+    // Returns the staged paths, which the caller deletes in the background.
+    static QStringList empty();
+
+    // Staged paths left behind by an empty that never finished.
+    static QStringList pendingExpunges();
+};
+
+#endif // CTRASH_H